@@ -1,23 +1,13 @@
-QT -= gui
-QT += widgets
+# The renderer as a static library, and the demo, the benchmark and the batch renderer linked with it
 
-CONFIG += c++11 console
-CONFIG -= app_bundle
+TEMPLATE = subdirs
 
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+SUBDIRS += \
+        library \
+        demo \
+        bench \
+        batch
 
-SOURCES += \
-        bmploader.cpp \
-        main.cpp \
-        texture.cpp
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
-
-HEADERS += \
-    bmploader.h \
-    texture.h
+demo.depends = library
+bench.depends = library
+batch.depends = library
@@ -0,0 +1,37 @@
+#ifndef ALIGNEDMEMORY_H
+#define ALIGNEDMEMORY_H
+
+#include <stdlib.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#include "profiler.h"
+
+#define CACHE_LINE_SIZE 64
+
+// Allocates a block of memory whose address is a multiple of alignment (a power of two).
+// Blocks returned by this function must be released with alignedFree().
+inline void *alignedAlloc(size_t size, size_t alignment = CACHE_LINE_SIZE)
+{
+    PROFILE_ONLY(Profiler::countAllocation();)
+#if defined(_WIN32)
+    return _aligned_malloc(size, alignment);
+#else
+    void *ptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+inline void alignedFree(void *ptr)
+{
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+#endif // ALIGNEDMEMORY_H
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bmploader.h"
+#include "cubescene.h"
+#include "edgerasterizer.h"
+#include "framebuffer.h"
+#include "framewriter.h"
+#include "rasterizer.h"
+#include "rendercontext.h"
+#include "texturemanager.h"
+#include "threadpool.h"
+
+#define BATCH_WIDTH     800
+#define BATCH_HEIGHT    600
+#define BATCH_FRAMES    100
+#define BATCH_SLOTS     2                                                       // frames a job may have in flight
+
+// A renderer of its own for every frame drawn at the same time, the scene included (it keeps per frame state)
+struct TBatchJob {
+    std::unique_ptr<ThreadPool> pool;
+    std::unique_ptr<RenderContext> context;
+    std::unique_ptr<CubeScene> scene;
+};
+
+// A finished or unfinished frame waiting for its turn to be written. Frame n always goes into slot n % slots, once
+// the frame before it in that slot is written.
+struct TBatchSlot {
+    FrameBuffer frame;
+    int turn;                                                                   // the frame the slot is for next
+    bool ready;                                                                 // holds frame turn, drawn
+};
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Renders frames of the animation as fast as it can and streams them to a file or standard output. Every job draws
+// whole frames on a thread pool of its own, as many frames at a time as there are jobs, while the main thread writes
+// the finished ones in order, so the output goes out while the next frames are drawn.
+int main(int argc, char *argv[])
+{
+    int width = BATCH_WIDTH, height = BATCH_HEIGHT;
+    int first = 0, frames = BATCH_FRAMES, step = 1;
+    int jobCount = 1, threads = 0, frameRate = 25;
+    const char *outputFile = "-";
+    const char *meshFile = NULL;
+    TStreamFormat format = STREAM_Y4M;
+    TRasterizerMode mode = RASTERIZER_SCANLINE;
+    TShadingMode shading = SHADING_FORWARD;
+    TTextureFormat textureFormat = TEXTURE_RGB32;
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (!strncmp(argv[i], "--width=", 8)) width = atoi(argv[i] + 8);
+        else if (!strncmp(argv[i], "--height=", 9)) height = atoi(argv[i] + 9);
+        else if (!strncmp(argv[i], "--first=", 8)) first = atoi(argv[i] + 8);
+        else if (!strncmp(argv[i], "--frames=", 9)) frames = atoi(argv[i] + 9);
+        else if (!strncmp(argv[i], "--step=", 7)) step = atoi(argv[i] + 7);
+        else if (!strncmp(argv[i], "--jobs=", 7)) jobCount = atoi(argv[i] + 7);
+        else if (!strncmp(argv[i], "--threads=", 10)) threads = atoi(argv[i] + 10);
+        else if (!strncmp(argv[i], "--fps=", 6)) frameRate = atoi(argv[i] + 6);
+        else if (!strncmp(argv[i], "--output=", 9)) outputFile = argv[i] + 9;
+        else if (!strcmp(argv[i], "--format=y4m")) format = STREAM_Y4M;
+        else if (!strcmp(argv[i], "--format=ppm")) format = STREAM_PPM;
+        else if (!strcmp(argv[i], "--format=rgba")) format = STREAM_RGBA;
+        else if (!strcmp(argv[i], "--format=bgra")) format = STREAM_BGRA;
+        else if (!strncmp(argv[i], "--mesh=", 7)) meshFile = argv[i] + 7;
+        else if (!strncmp(argv[i], "--textures=", 11)) BMPLoader::addSearchPath(argv[i] + 11);
+        else if (!strcmp(argv[i], "--rasterizer=edge")) mode = RASTERIZER_EDGE;
+        else if (!strcmp(argv[i], "--rasterizer=scanline")) mode = RASTERIZER_SCANLINE;
+        else if (!strcmp(argv[i], "--shading=forward")) shading = SHADING_FORWARD;
+        else if (!strcmp(argv[i], "--shading=visibility")) shading = SHADING_VISIBILITY;
+        else if (!strcmp(argv[i], "--simd=scalar")) setEdgeSimdLevel(SIMD_SCALAR);
+        else if (!strcmp(argv[i], "--simd=sse2")) setEdgeSimdLevel(SIMD_SSE2);
+        else if (!strcmp(argv[i], "--simd=avx2")) setEdgeSimdLevel(SIMD_AVX2);
+        else if (!strcmp(argv[i], "--simd=avx512")) setEdgeSimdLevel(SIMD_AVX512);
+        else if (!strncmp(argv[i], "--perspective=", 14)) setPerspectiveSpan(atoi(argv[i] + 14));
+        else if (!strcmp(argv[i], "--texture-format=rgb32")) textureFormat = TEXTURE_RGB32;
+        else if (!strcmp(argv[i], "--texture-format=indexed8")) textureFormat = TEXTURE_INDEXED8;
+        else if (!strcmp(argv[i], "--texture-format=rgb565")) textureFormat = TEXTURE_RGB565;
+        else if (!strcmp(argv[i], "--texture-format=rgb555")) textureFormat = TEXTURE_RGB555;
+        else if (!strcmp(argv[i], "--texture-format=bc1")) textureFormat = TEXTURE_BC1;
+        else {
+            fprintf(stderr, "usage: batch [--width=N] [--height=N] [--first=STEP] [--frames=N] [--step=N] "
+                            "[--jobs=N] [--threads=N] [--output=FILE|-] [--format=y4m|ppm|rgba|bgra] [--fps=N] "
+                            "[--mesh=FILE] [--textures=DIR] [--rasterizer=edge|scanline] "
+                            "[--shading=forward|visibility] [--simd=scalar|sse2|avx2|avx512] "
+                            "[--perspective=0|8|16|32|64] [--texture-format=rgb32|indexed8|rgb565|rgb555|bc1]\n");
+            return 2;
+        }
+    }
+    if (width <= 0 || height <= 0 || frames <= 0 || jobCount <= 0) {
+        fprintf(stderr, "the size, the number of frames and of jobs have to be positive\n");
+        return 2;
+    }
+#if defined(TEXTURING_SOURCE_DIR)
+    BMPLoader::addSearchPath(TEXTURING_SOURCE_DIR);
+#endif
+
+    // Every job gets an equal share of the cores unless told otherwise
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency() / jobCount);
+
+    TextureManager textureManager;
+    textureManager.setTextureFormat(textureFormat);
+    std::vector<TBatchJob> jobs(jobCount);
+    for (TBatchJob &job : jobs) {
+        job.pool.reset(new ThreadPool(threads));
+        job.context.reset(new RenderContext(width, height, &textureManager, job.pool.get()));
+        job.context->renderer().setRasterizerMode(mode);
+        job.context->renderer().setShadingMode(shading);
+        job.scene.reset(new CubeScene(&textureManager, width, height));
+        if (meshFile && !job.scene->loadMesh(meshFile, job.pool.get())) {
+            fprintf(stderr, "can not load %s\n", meshFile);
+            return 1;
+        }
+    }
+    textureManager.waitForLoads();                                              // no frame may show a placeholder
+
+    FrameWriter writer;
+    if (!writer.open(outputFile, format, width, height, frameRate)) {
+        fprintf(stderr, "can not write %s\n", outputFile);
+        return 1;
+    }
+
+    int slotCount = jobCount * BATCH_SLOTS;
+    std::vector<TBatchSlot> slots(slotCount);
+    for (i=0; i<slotCount; i++) {
+        slots[i].frame.resize(width, height);
+        slots[i].turn = i;
+        slots[i].ready = false;
+    }
+    std::mutex lock;
+    std::condition_variable changed;
+    std::atomic<int> nextFrame(0);
+    bool stopping = false;
+
+    auto render = [&](TBatchJob &job) {
+        for (;;) {
+            int frame = nextFrame++;
+            if (frame >= frames) return;
+            TBatchSlot &slot = slots[frame % slotCount];
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return stopping || slot.turn == frame; });
+                if (stopping) return;
+            }
+            job.context->beginFrame(qRgb(0, 0, 0), &slot.frame);
+            job.scene->submit(&job.context->renderer(), first + frame * step);
+            job.context->endFrame();
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                slot.ready = true;
+            }
+            changed.notify_all();
+        }
+    };
+
+    double start = now();
+    std::vector<std::thread> workers;
+    for (TBatchJob &job : jobs) {
+        workers.push_back(std::thread(render, std::ref(job)));
+    }
+
+    bool ok = true;
+    for (i=0; i<frames && ok; i++) {                                            // in order, while the next ones are drawn
+        TBatchSlot &slot = slots[i % slotCount];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return slot.turn == i && slot.ready; });
+        }
+        ok = writer.writeFrame(slot.frame);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            slot.ready = false;
+            slot.turn = i + slotCount;
+            if (!ok) stopping = true;
+        }
+        changed.notify_all();
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    if (!writer.close()) ok = false;
+    double elapsed = now() - start;
+
+    if (!ok) {
+        fprintf(stderr, "can not write %s\n", outputFile);
+        return 1;
+    }
+    fprintf(stderr, "%d frames of %dx%d in %.2f s, %.1f frames/s, %.1f MB/s written\n", frames, width, height, elapsed,
+            frames / elapsed, writer.bytesWritten() / elapsed * 1e-6);
+    return 0;
+}
@@ -0,0 +1,15 @@
+QT += gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = batch
+
+# Offline rendering: frames of the animation streamed to a file or a pipe as fast as they can be drawn
+
+DEFINES += TEXTURING_SOURCE_DIR=\\\"$$PWD/..\\\"
+
+include(../library/library.pri)
+
+SOURCES += \
+        batch.cpp
@@ -0,0 +1,776 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bmploader.h"
+#include "commandbuffer.h"
+#include "cubescene.h"
+#include "depthbuffer.h"
+#include "dynamicresolution.h"
+#include "edgerasterizer.h"
+#include "framebuffer.h"
+#include "instancebatch.h"
+#include "mesh.h"
+#include "meshloader.h"
+#include "primitiveassembler.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "rendercontext.h"
+#include "scenegraph.h"
+#include "texturemanager.h"
+#include "threadpool.h"
+#include "tilerenderer.h"
+
+#define BENCH_WIDTH     800
+#define BENCH_HEIGHT    600
+#define BENCH_FRAMES    120
+#define BENCH_WARMUP    4                                                       // frames that may still allocate, see runScene()
+#define GRID_SIZE       24                                                      // cubes along a side of the "commands" scene
+
+#if defined(TEXTURING_SOURCE_DIR)
+#define GOLDEN_FILE     TEXTURING_SOURCE_DIR "/bench/golden.txt"
+#else
+#define GOLDEN_FILE     "golden.txt"
+#endif
+
+struct TBenchScene {
+    const char *name;
+    std::function<void(TileRenderer *renderer, int frame)> submit;
+};
+
+struct TBenchResult {
+    std::string name;
+    int frames;
+    double seconds;
+    double triangles;
+    double fragments;
+    std::vector<double> frameTimes;                                             // milliseconds
+    uint64_t checksum;
+    int allocatingFrames;                                                       // after the warm-up, profiling builds only
+};
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Deterministic pseudo random numbers, the scenes must not depend on the C library
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+static float randomFloat(float lo, float hi)
+{
+    return lo + (hi - lo) * (float)nextRandom() / (float)(1 << 24);
+}
+
+static uint64_t hashFrame(FrameBuffer &frameBuffer)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int x, y;
+
+    for (y=0; y<frameBuffer.height; y++) {
+        const uint32_t *row = frameBuffer.scanLine(y);
+        for (x=0; x<frameBuffer.width; x++) {
+            hash = (hash ^ row[x]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+// Area of a triangle inside the screen, in pixels: the fragments the rasterizer has to visit
+static double coveredArea(const TTriangle &t, int width, int height)
+{
+    std::vector<std::pair<double, double>> polygon, clipped;
+    int edge;
+    size_t i;
+
+    polygon.push_back(std::make_pair((double)t.V1.x, (double)t.V1.y));
+    polygon.push_back(std::make_pair((double)t.V2.x, (double)t.V2.y));
+    polygon.push_back(std::make_pair((double)t.V3.x, (double)t.V3.y));
+
+    for (edge=0; edge<4 && !polygon.empty(); edge++) {                          // Sutherland-Hodgman against the four screen edges
+        auto inside = [&](const std::pair<double, double> &p) {
+            switch (edge) {
+            case 0:  return p.first >= 0.0;
+            case 1:  return p.first <= (double)width;
+            case 2:  return p.second >= 0.0;
+            default: return p.second <= (double)height;
+            }
+        };
+        auto cross = [&](const std::pair<double, double> &a, const std::pair<double, double> &b) {
+            double s;
+            switch (edge) {
+            case 0:  s = (0.0 - a.first) / (b.first - a.first); break;
+            case 1:  s = ((double)width - a.first) / (b.first - a.first); break;
+            case 2:  s = (0.0 - a.second) / (b.second - a.second); break;
+            default: s = ((double)height - a.second) / (b.second - a.second); break;
+            }
+            return std::make_pair(a.first + s * (b.first - a.first), a.second + s * (b.second - a.second));
+        };
+        clipped.clear();
+        for (i=0; i<polygon.size(); i++) {
+            const std::pair<double, double> &a = polygon[i];
+            const std::pair<double, double> &b = polygon[(i + 1) % polygon.size()];
+            if (inside(a)) {
+                clipped.push_back(a);
+                if (!inside(b)) clipped.push_back(cross(a, b));
+            }
+            else if (inside(b)) {
+                clipped.push_back(cross(a, b));
+            }
+        }
+        polygon.swap(clipped);
+    }
+
+    double area = 0.0;
+    for (i=0; i<polygon.size(); i++) {
+        const std::pair<double, double> &a = polygon[i];
+        const std::pair<double, double> &b = polygon[(i + 1) % polygon.size()];
+        area += a.first * b.second - b.first * a.second;
+    }
+    return fabs(area) * 0.5;
+}
+
+static TTriangle makeTriangle(float x0, float y0, float x1, float y1, float x2, float y2, float z, float uvScale,
+                              Texture *texture)
+{
+    TTriangle t;
+
+    t.V1 = { x0, y0, z, 0.0f, 0.0f, 0.0f };
+    t.V2 = { x1, y1, z, uvScale, 0.0f, 0.0f };
+    t.V3 = { x2, y2, z, 0.0f, uvScale, 0.0f };
+    t.texture = texture;
+    t.color = 0;
+    t.flags = 0;
+    return t;
+}
+
+// The "commands" scene: a grid of cubes recorded from the back row to the front one, each with one of the six
+// textures, so sorting reverses the order and regroups the textures
+static void recordGrid(CommandBuffer &commands, const TMesh &cube, const TTextureHandle *textures)
+{
+    TBounds bounds = computeBounds(cube);
+    int i;
+
+    for (i=GRID_SIZE*GRID_SIZE-1; i>=0; i--) {
+        int column = i % GRID_SIZE, row = i / GRID_SIZE;
+        TMat4x4 world = makeTranslation(-GRID_SIZE + 2.0f * column, 0.0f, 2.0f + 2.0f * row);
+        commands.drawMesh(cube, world, textures[(column + row) % 6], 0, &bounds);
+    }
+}
+
+// Looking down at the grid while the camera swings from side to side
+static TMat4x4 gridViewProjection(int frame)
+{
+    TMat4x4 view = multiplyMatrices(makeTranslation(0.0f, -4.0f, 0.0f), makeRotationY(0.5f * sinf(frame * 0.05f)));
+    view = multiplyMatrices(view, makeRotationX(-0.4f));
+    return multiplyMatrices(view, makeProjection(90.0f, (float)BENCH_HEIGHT / BENCH_WIDTH, 0.1f, 1000.0f, 1.0f));
+}
+
+static TBenchResult runScene(const TBenchScene &scene, int frames, TileRenderer &renderer, TextureManager &textureManager,
+                             FrameBuffer &frameBuffer, DepthBuffer &depthBuffer)
+{
+    TBenchResult result;
+    int frame;
+
+    result.name = scene.name;
+    result.frames = frames;
+    result.seconds = 0.0;
+    result.triangles = 0.0;
+    result.fragments = 0.0;
+    result.checksum = 0xcbf29ce484222325ULL;
+    result.allocatingFrames = 0;
+    result.frameTimes.reserve(frames);
+
+    // Once the frame arena and the bins have grown to the size of the scene and its textures are loaded, drawing a
+    // frame must not allocate anything
+    for (frame=0; frame<frames; frame++) {
+        uint64_t allocations = Profiler::allocations();
+        double start = now();
+        textureManager.beginFrame();
+        renderer.beginFrame(&frameBuffer, &depthBuffer, qRgb(0, 0, 0));
+        if (frame == 0) renderer.invalidate();                                  // the buffer holds a frame of another scene
+        scene.submit(&renderer, frame);
+        renderer.endFrame();
+        double elapsed = now() - start;
+        if (frame >= BENCH_WARMUP && Profiler::allocations() != allocations) result.allocatingFrames++;
+
+        result.seconds += elapsed;
+        result.frameTimes.push_back(elapsed * 1000.0);
+        result.triangles += (double)renderer.triangles().size();
+        for (const TTriangle &t : renderer.triangles()) {
+            result.fragments += coveredArea(t, frameBuffer.width, frameBuffer.height);
+        }
+        result.checksum = (result.checksum ^ hashFrame(frameBuffer)) * 0x100000001b3ULL;
+        PROFILE_FRAME();
+    }
+    return result;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)ceil(p * (double)values.size()) - 1;
+    return values[std::min(index, values.size() - 1)];
+}
+
+static std::map<std::string, uint64_t> readGolden(const char *fileName)
+{
+    std::map<std::string, uint64_t> golden;
+    char line[256], key[128];
+    unsigned long long checksum;
+
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) return golden;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%127s %llx", key, &checksum) == 2) golden[key] = checksum;
+    }
+    fclose(file);
+    return golden;
+}
+
+static bool writeGolden(const char *fileName, const std::map<std::string, uint64_t> &golden)
+{
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) return false;
+    fprintf(file, "# scene/rasterizer/frames checksum, written by bench --update-golden\n");
+    for (auto &entry : golden) {
+        fprintf(file, "%s %016llx\n", entry.first.c_str(), (unsigned long long)entry.second);
+    }
+    fclose(file);
+    return true;
+}
+
+static void runMicrobenchmarks(TextureManager &textureManager, ThreadPool &threadPool)
+{
+    FrameBuffer frameBuffer(BENCH_WIDTH, BENCH_HEIGHT);
+    DepthBuffer depthBuffer(BENCH_WIDTH, BENCH_HEIGHT);
+    TRect screen = { 0, 0, BENCH_WIDTH, BENCH_HEIGHT };
+    int i, iterations;
+    double start, elapsed;
+
+    printf("\nmicrobenchmarks\n");
+
+    // drawTriangle and drawTriangleEdge: a 128 pixel triangle, every copy a bit closer so none is rejected, in the
+    // span variants of a textured and of a flat triangle, with and without the depth buffer
+    TTextureHandle handle = textureManager.load("negx.bmp");
+    textureManager.waitForLoads();
+    Texture *texture = textureManager.texture(handle);
+    const char *names[2] = { "drawTriangle", "drawTriangleEdge" };
+    const char *variants[4] = { "", "  no depth", "  flat", "  flat, no depth" };
+    for (int engine=0; engine<2; engine++) {
+        for (int variant=0; variant<4; variant++) {
+            iterations = 20000;
+            depthBuffer.clear();
+            TTriangle t = makeTriangle(300.0f, 200.0f, 428.0f, 210.0f, 320.0f, 330.0f, 900.0f, 256.0f,
+                                       variant < 2 ? texture : NULL);
+            t.color = qRgb(200, 120, 40);
+            t.flags = (variant & 1) ? DRAW_NO_DEPTH_TEST | DRAW_NO_DEPTH_WRITE : 0;
+            double area = coveredArea(t, BENCH_WIDTH, BENCH_HEIGHT);
+            start = now();
+            for (i=0; i<iterations; i++) {
+                t.V1.z = t.V2.z = t.V3.z = 900.0f - i * 0.04f;
+                if (engine == 0) drawTriangle(t, &frameBuffer, &depthBuffer, screen);
+                else drawTriangleEdge(t, &frameBuffer, &depthBuffer, screen);
+            }
+            elapsed = now() - start;
+            printf("  %-22s %10.1f ns/triangle %10.1f Mpixels/s\n",
+                   variant ? variants[variant] : names[engine], elapsed * 1e9 / iterations,
+                   area * iterations / elapsed * 1e-6);
+        }
+    }
+
+    // the textured triangle again with the texture in every storage format, through both engines
+    const char *formats[TEXTURE_FORMATS] = { "rgb32", "indexed8", "rgb565", "rgb555", "bc1" };
+    for (int format=0; format<TEXTURE_FORMATS; format++) {
+        Texture compact;
+        double nsPerTriangle[2];
+        compact.format = (TTextureFormat)format;
+        if (!compact.loadFromBitmap("negx.bmp")) break;
+        TTriangle t = makeTriangle(300.0f, 200.0f, 428.0f, 210.0f, 320.0f, 330.0f, 900.0f, 256.0f, &compact);
+        for (int engine=0; engine<2; engine++) {
+            iterations = 20000;
+            depthBuffer.clear();
+            start = now();
+            for (i=0; i<iterations; i++) {
+                t.V1.z = t.V2.z = t.V3.z = 900.0f - i * 0.04f;
+                if (engine == 0) drawTriangle(t, &frameBuffer, &depthBuffer, screen);
+                else drawTriangleEdge(t, &frameBuffer, &depthBuffer, screen);
+            }
+            nsPerTriangle[engine] = (now() - start) * 1e9 / iterations;
+        }
+        printf("  %-22s %10.1f ns/triangle %10.1f ns/triangle edge %8zu KB\n", formats[format],
+               nsPerTriangle[0], nsPerTriangle[1], compact.memorySize() / 1024);
+    }
+
+    // multiplyMatrixVector over a batch of vertices
+    TMat4x4 m;
+    std::vector<TVertex> in(1024), out(1024);
+    for (i=0; i<4; i++) m.m[i][i] = 1.0f + i * 0.25f;
+    m.m[2][3] = 1.0f;
+    m.m[3][2] = 0.5f;
+    for (i=0; i<(int)in.size(); i++) {
+        in[i] = { randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(1.0f, 5.0f), 0.0f, 0.0f, 0.0f };
+    }
+    iterations = 2000;
+    volatile float sink = 0.0f;                                                 // keeps the results alive
+    start = now();
+    for (int pass=0; pass<iterations; pass++) {
+        for (i=0; i<(int)in.size(); i++) {
+            multiplyMatrixVector(in[i], out[i], m);
+        }
+        sink += out[pass & 1023].x;
+    }
+    elapsed = now() - start;
+    printf("  %-22s %10.2f ns/vertex\n", "multiplyMatrixVector", elapsed * 1e9 / ((double)iterations * in.size()));
+
+    // the same vertices as one SoA batch through the fused transform and the perspective divide
+    TMesh mesh;
+    TVertexCache cache;
+    for (i=0; i<(int)in.size(); i++) {
+        mesh.x.push_back(in[i].x);
+        mesh.y.push_back(in[i].y);
+        mesh.z.push_back(in[i].z);
+    }
+    start = now();
+    for (int pass=0; pass<iterations; pass++) {
+        transformVertices(m, mesh, cache);
+        projectVertices(cache, BENCH_WIDTH, BENCH_HEIGHT, 1000.0f);
+        sink += cache.screenX[pass & 1023];
+    }
+    elapsed = now() - start;
+    printf("  %-22s %10.2f ns/vertex\n", "transformVertices", elapsed * 1e9 / ((double)iterations * in.size()));
+
+    // FrameScaler: a frame drawn at 3/4 of the size stretched back to it, on the thread pool
+    FrameBuffer small(BENCH_WIDTH * 3 / 4, BENCH_HEIGHT * 3 / 4);
+    FrameScaler scaler;
+    small.clear(qRgb(40, 80, 120));
+    const char *filters[2] = { "FrameScaler nearest", "  bilinear" };
+    for (int filter=0; filter<2; filter++) {
+        scaler.setFilter(filter ? SCALE_BILINEAR : SCALE_NEAREST);
+        iterations = 200;
+        start = now();
+        for (i=0; i<iterations; i++) {
+            scaler.scale(small, frameBuffer, &threadPool);
+        }
+        elapsed = now() - start;
+        printf("  %-22s %10.3f ms/frame  %10.1f Mpixels/s\n", filters[filter], elapsed * 1e3 / iterations,
+               (double)BENCH_WIDTH * BENCH_HEIGHT * iterations / elapsed * 1e-6);
+    }
+
+    // BMPLoader::loadTexture, single threaded
+    int width = 0, height = 0;
+    iterations = 50;
+    start = now();
+    for (i=0; i<iterations; i++) {
+        TextureStorage texels;                                                  // back to the pool after every load
+        BMPLoader::loadTexture("negx.bmp", width, height, texels);
+    }
+    elapsed = now() - start;
+    printf("  %-22s %10.3f ms/load   %10.1f Mtexels/s\n", "BMPLoader::loadTexture", elapsed * 1e3 / iterations,
+           (double)width * height * iterations / elapsed * 1e-6);
+
+    // MeshLoader: a grid of 512x512 quads written as OBJ text, parsed on one thread and on the pool, then read back
+    // from its binary cache
+    const char *objFile = "bench_grid.obj", *cacheFile = "bench_grid.obj.mesh";
+    const int grid = 512;
+    FILE *file = fopen(objFile, "w");
+    if (file == NULL) return;
+    for (i=0; i<(grid + 1) * (grid + 1); i++) {
+        fprintf(file, "v %.6f %.6f 0.0\nvt %.6f %.6f\n", (float)(i % (grid + 1)) / grid, (float)(i / (grid + 1)) / grid,
+                (float)(i % (grid + 1)) / grid, (float)(i / (grid + 1)) / grid);
+    }
+    for (i=0; i<grid * grid; i++) {
+        int a = i % grid + (i / grid) * (grid + 1) + 1;
+        fprintf(file, "f %d/%d %d/%d %d/%d %d/%d\n", a, a, a + 1, a + 1, a + grid + 2, a + grid + 2, a + grid + 1, a + grid + 1);
+    }
+    fclose(file);
+
+    TMeshImport import;
+    double triangles = 2.0 * grid * grid;
+    const char *methods[3] = { "MeshLoader::loadOBJ", "  on the thread pool", "MeshLoader::loadCache" };
+    for (int method=0; method<3; method++) {
+        iterations = 5;
+        start = now();
+        for (i=0; i<iterations; i++) {
+            if (method == 0) MeshLoader::loadOBJ(objFile, import);
+            else if (method == 1) MeshLoader::loadOBJ(objFile, import, &threadPool);
+            else MeshLoader::loadCache(cacheFile, import);
+        }
+        elapsed = now() - start;
+        printf("  %-22s %10.3f ms/load   %10.1f Mtriangles/s\n", methods[method], elapsed * 1e3 / iterations,
+               triangles * iterations / elapsed * 1e-6);
+        if (method == 1) MeshLoader::saveCache(cacheFile, import);
+    }
+    remove(objFile);
+    remove(cacheFile);
+}
+
+// The "commands" scene drawn by render contexts of their own: first by one, then by two at once on two threads. Every
+// frame has to come out the same in all three. Returns false when any does not.
+static bool runContexts(TextureManager &textureManager, const TMesh &cube, const TTextureHandle *textures)
+{
+    const int frames = 16;
+    RenderContext first(BENCH_WIDTH, BENCH_HEIGHT, &textureManager), second(BENCH_WIDTH, BENCH_HEIGHT, &textureManager);
+    std::vector<uint64_t> expected(frames), hashes[2];
+    int frame;
+
+    auto drawFrames = [&](RenderContext &context, uint64_t *hashes) {
+        for (int i=0; i<frames; i++) {
+            context.setViewProjection(gridViewProjection(i));
+            context.beginFrame(qRgb(0, 0, 0));
+            recordGrid(context.commands(), cube, textures);
+            context.endFrame();
+            hashes[i] = hashFrame(*context.frameBuffer());
+        }
+    };
+
+    drawFrames(first, expected.data());                                         // allocates the buffers, timed from here on
+    double start = now();
+    drawFrames(first, expected.data());
+    double alone = now() - start;
+
+    hashes[0].resize(frames);
+    hashes[1].resize(frames);
+    start = now();
+    std::thread other([&]() { drawFrames(second, hashes[1].data()); });
+    drawFrames(first, hashes[0].data());
+    other.join();
+    double together = now() - start;
+
+    printf("  %-22s %10.2f ms/frame alone %7.2f ms/frame, two contexts at once\n", "RenderContext",
+           alone * 1e3 / frames, together * 1e3 / frames / 2);
+    for (frame=0; frame<frames; frame++) {
+        if (hashes[0][frame] != expected[frame] || hashes[1][frame] != expected[frame]) {
+            printf("  frame %d differs between the contexts\n", frame);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = BENCH_FRAMES;
+    int threads = 0;
+    bool updateGolden = false;
+    bool micro = true;
+    bool stats = false;
+    const char *traceFile = NULL;
+    const char *goldenFile = GOLDEN_FILE;
+    const char *onlyScene = NULL;
+    bool incremental = false;                                                   // must give the same checksums
+    bool sortCommands = true;                                                   // edge rasterizer: the same checksums
+    std::vector<TRasterizerMode> modes = { RASTERIZER_SCANLINE, RASTERIZER_EDGE };
+    std::vector<TShadingMode> shadings = { SHADING_FORWARD };
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (!strncmp(argv[i], "--frames=", 9)) frames = atoi(argv[i] + 9);
+        else if (!strncmp(argv[i], "--threads=", 10)) threads = atoi(argv[i] + 10);
+        else if (!strncmp(argv[i], "--scene=", 8)) onlyScene = argv[i] + 8;
+        else if (!strncmp(argv[i], "--golden=", 9)) goldenFile = argv[i] + 9;
+        else if (!strcmp(argv[i], "--update-golden")) updateGolden = true;
+        else if (!strcmp(argv[i], "--no-micro")) micro = false;
+        else if (!strcmp(argv[i], "--rasterizer=edge")) modes = { RASTERIZER_EDGE };
+        else if (!strcmp(argv[i], "--rasterizer=scanline")) modes = { RASTERIZER_SCANLINE };
+        else if (!strcmp(argv[i], "--shading=forward")) shadings = { SHADING_FORWARD };
+        else if (!strcmp(argv[i], "--shading=visibility")) shadings = { SHADING_VISIBILITY };
+        else if (!strcmp(argv[i], "--shading=both")) shadings = { SHADING_FORWARD, SHADING_VISIBILITY };
+        else if (!strcmp(argv[i], "--incremental")) incremental = true;
+        else if (!strcmp(argv[i], "--order=recorded")) sortCommands = false;
+        else if (!strcmp(argv[i], "--order=sorted")) sortCommands = true;
+        else if (!strcmp(argv[i], "--simd=scalar")) setEdgeSimdLevel(SIMD_SCALAR);
+        else if (!strcmp(argv[i], "--simd=sse2")) setEdgeSimdLevel(SIMD_SSE2);
+        else if (!strcmp(argv[i], "--simd=avx2")) setEdgeSimdLevel(SIMD_AVX2);
+        else if (!strcmp(argv[i], "--simd=avx512")) setEdgeSimdLevel(SIMD_AVX512);
+        else if (!strncmp(argv[i], "--perspective=", 14)) setPerspectiveSpan(atoi(argv[i] + 14));
+        else if (!strncmp(argv[i], "--textures=", 11)) BMPLoader::addSearchPath(argv[i] + 11);
+#if defined(TEXTURING_PROFILE)
+        else if (!strcmp(argv[i], "--stats")) stats = true;
+        else if (!strncmp(argv[i], "--trace=", 8)) traceFile = argv[i] + 8;
+#endif
+        else {
+            fprintf(stderr, "usage: bench [--frames=N] [--threads=N] [--scene=cube|small|huge|overdraw|floor|city|crates|static|commands] "
+                            "[--rasterizer=edge|scanline] [--shading=forward|visibility|both] [--incremental] "
+                            "[--order=recorded|sorted] "
+                            "[--simd=scalar|sse2|avx2|avx512] [--perspective=0|8|16|32|64] "
+                            "[--textures=DIR] "
+                            "[--golden=FILE] [--update-golden] [--no-micro]"
+#if defined(TEXTURING_PROFILE)
+                            " [--stats] [--trace=FILE]"
+#endif
+                            "\n");
+            return 2;
+        }
+    }
+#if defined(TEXTURING_SOURCE_DIR)
+    BMPLoader::addSearchPath(TEXTURING_SOURCE_DIR);
+#endif
+
+    FrameBuffer frameBuffer(BENCH_WIDTH, BENCH_HEIGHT);
+    DepthBuffer depthBuffer(BENCH_WIDTH, BENCH_HEIGHT);
+    ThreadPool threadPool(threads);
+    TileRenderer renderer(&threadPool);
+    TextureManager textureManager;
+    renderer.setIncremental(incremental);
+
+    CubeScene cubeScene(&textureManager, BENCH_WIDTH, BENCH_HEIGHT);
+    const char *files[6] = { "negx.bmp", "posy.bmp", "posx.bmp", "negy.bmp", "negz.bmp", "posz.bmp" };
+    TTextureHandle textures[6];
+    for (i=0; i<6; i++) {
+        textures[i] = textureManager.load(files[i], WRAP_REPEAT);
+    }
+    textureManager.waitForLoads();                                              // every frame has to show the real textures
+
+    // Many small triangles: 20000 triangles of a few pixels each
+    std::vector<TTriangle> smallTriangles;
+    randomState = 1;
+    for (i=0; i<20000; i++) {
+        float x = randomFloat(0.0f, BENCH_WIDTH), y = randomFloat(0.0f, BENCH_HEIGHT), size = randomFloat(2.0f, 8.0f);
+        smallTriangles.push_back(makeTriangle(x, y, x + size, y + randomFloat(-1.0f, 1.0f), x + randomFloat(-1.0f, 1.0f),
+                                              y + size, randomFloat(10.0f, 990.0f), 8.0f,
+                                              textureManager.texture(textures[i % 6])));
+    }
+
+    // A few huge triangles, each a wedge from a corner on the screen to two corners 5000 pixels away, with repeating
+    // texture coordinates. Their edges cross the screen, so the edge rasterizer has to set up and walk edges several
+    // thousand pixels long in every tile they pass.
+    std::vector<TTriangle> hugeTriangles;
+    for (i=0; i<6; i++) {
+        float angle = i * 1.047f;
+        float cx = BENCH_WIDTH * 0.5f + 200.0f * cosf(angle), cy = BENCH_HEIGHT * 0.5f + 150.0f * sinf(angle);
+        hugeTriangles.push_back(makeTriangle(cx, cy,
+                                             cx + 5000.0f * cosf(angle + 0.2f), cy + 5000.0f * sinf(angle + 0.2f),
+                                             cx + 5000.0f * cosf(angle + 1.4f), cy + 5000.0f * sinf(angle + 1.4f),
+                                             100.0f + i * 50.0f, 4096.0f, textureManager.texture(textures[i])));
+    }
+
+    // Heavy overdraw: 32 screen sized quads drawn back to front, so every layer passes the depth test
+    std::vector<TTriangle> overdrawTriangles;
+    for (i=0; i<32; i++) {
+        float z = 900.0f - i * 25.0f, o = (float)(i % 8) * 4.0f;
+        Texture *texture = textureManager.texture(textures[i % 6]);
+        overdrawTriangles.push_back(makeTriangle(o, o, BENCH_WIDTH - o, o, o, BENCH_HEIGHT - o, z, 256.0f, texture));
+        TTriangle t = makeTriangle(BENCH_WIDTH - o, o, BENCH_WIDTH - o, BENCH_HEIGHT - o, o, BENCH_HEIGHT - o, z, 256.0f,
+                                   texture);
+        t.V1.u = 256.0f;
+        t.V2.u = 256.0f;
+        t.V2.v = 256.0f;
+        t.V3.v = 256.0f;
+        overdrawTriangles.push_back(t);
+    }
+
+    // A floor reaching from behind the camera to the horizon while the camera turns, so triangles are clipped
+    // against the near plane and the guard band every frame
+    TMesh floorMesh;
+    TVertexCache floorCache;
+    PrimitiveAssembler floorAssembler;
+    for (i=0; i<16; i++) {
+        float x0 = -400.0f + (i % 4) * 200.0f, z0 = -400.0f + (i / 4) * 200.0f, x1 = x0 + 200.0f, z1 = z0 + 200.0f;
+        TVertex a = { x0, -1.0f, z0, 0.0f, 0.0f, 0.0f }, b = { x0, -1.0f, z1, 0.0f, 64.0f, 0.0f };
+        TVertex c = { x1, -1.0f, z1, 64.0f, 64.0f, 0.0f }, d = { x1, -1.0f, z0, 64.0f, 0.0f, 0.0f };
+        floorMesh.addTriangle({ a, b, c, NULL, 0, 0 }, textures[i % 6]);
+        floorMesh.addTriangle({ a, c, d, NULL, 0, 0 }, textures[i % 6]);
+    }
+    TMat4x4 floorProjection = makeProjection(90.0f, (float)BENCH_HEIGHT / BENCH_WIDTH, 0.1f, 1000.0f, 1.0f);
+    floorAssembler.setViewport(BENCH_WIDTH, BENCH_HEIGHT, 1000.0f);
+    floorAssembler.setDepthPlanes(0.1f, 1000.0f);
+
+    // A city of 64x64 cubes around a turning camera, most of them behind it or beside the view. The cubes hang off
+    // one node per row and a quarter of the rows bob up and down in every frame, so world transforms and the BVH
+    // change all the time.
+    SceneGraph city;
+    std::vector<TNodeHandle> cityRows;
+    PrimitiveAssembler cityAssembler;
+    for (i=0; i<64; i++) {
+        cityRows.push_back(city.addNode());
+        city.setTransform(cityRows[i], makeTranslation(0.0f, 0.0f, -64.0f + 2.0f * i));
+        for (int j=0; j<64; j++) {
+            TNodeHandle cube = city.addNode(cityRows[i], &cubeScene.mesh);
+            city.setTransform(cube, makeTranslation(-64.0f + 2.0f * j, 0.0f, 0.0f));
+        }
+    }
+    cityAssembler.setViewport(BENCH_WIDTH, BENCH_HEIGHT, 1000.0f);
+    cityAssembler.setDepthPlanes(0.1f, 1000.0f);
+
+    // A field of 128x128 crates, every one an instance of the cube with a texture of its own, seen from above while
+    // the camera turns
+    std::vector<TMat4x4> crateTransforms;
+    std::vector<TTextureHandle> crateTextures;
+    InstanceBatch crateBatch;
+    for (i=0; i<128 * 128; i++) {
+        TMat4x4 m = multiplyMatrices(makeRotationY((float)(i % 7) * 0.2f), makeTranslation(-128.0f + 2.0f * (i % 128),
+                                     0.0f, -128.0f + 2.0f * (i / 128)));
+        crateTransforms.push_back(m);
+        crateTextures.push_back(textures[i % 6]);
+    }
+
+    // A yard of 16x16 cubes seen by a camera that stands still, with one cube in the middle spinning: a frame that
+    // hardly changes, for --incremental
+    SceneGraph yard;
+    TNodeHandle spinner = NO_NODE;
+    PrimitiveAssembler yardAssembler;
+    for (i=0; i<16 * 16; i++) {
+        TNodeHandle cube = yard.addNode(NO_NODE, &cubeScene.mesh);
+        yard.setTransform(cube, makeTranslation(-16.0f + 2.0f * (i % 16), 0.0f, 4.0f + 2.0f * (i / 16)));
+    }
+    spinner = yard.addNode(NO_NODE, &cubeScene.mesh);
+    yardAssembler.setViewport(BENCH_WIDTH, BENCH_HEIGHT, 1000.0f);
+    yardAssembler.setDepthPlanes(0.1f, 1000.0f);
+    TMat4x4 yardView = multiplyMatrices(makeTranslation(0.0f, -4.0f, 0.0f), makeRotationX(-0.4f));
+
+    // The grid of cubes recorded as draw commands, see recordGrid()
+    CommandBuffer commandBuffer;
+    PrimitiveAssembler commandAssembler;
+    commandBuffer.setSorted(sortCommands);
+    commandAssembler.setViewport(BENCH_WIDTH, BENCH_HEIGHT, 1000.0f);
+    commandAssembler.setDepthPlanes(0.1f, 1000.0f);
+
+    auto submitMoved = [](TileRenderer *renderer, const std::vector<TTriangle> &triangles, float dx, float dy) {
+        if (renderer->isIncremental()) renderer->invalidate();                  // every triangle moves
+        for (TTriangle t : triangles) {
+            t.V1.x += dx; t.V2.x += dx; t.V3.x += dx;
+            t.V1.y += dy; t.V2.y += dy; t.V3.y += dy;
+            renderer->submit(t);
+        }
+    };
+
+    std::vector<TBenchScene> scenes = {
+        { "cube", [&](TileRenderer *renderer, int frame) { cubeScene.submit(renderer, frame); } },
+        { "small", [&](TileRenderer *renderer, int frame) {
+            submitMoved(renderer, smallTriangles, (float)(frame % 32) - 16.0f, (float)(frame % 24) - 12.0f); } },
+        { "huge", [&](TileRenderer *renderer, int frame) {
+            submitMoved(renderer, hugeTriangles, 8.0f * sinf(frame * 0.1f), 8.0f * cosf(frame * 0.1f)); } },
+        { "overdraw", [&](TileRenderer *renderer, int frame) {
+            submitMoved(renderer, overdrawTriangles, (float)(frame % 16), 0.0f); } },
+        { "floor", [&](TileRenderer *renderer, int frame) {
+            if (renderer->isIncremental()) renderer->invalidate();              // the camera turns
+            TMat4x4 view = multiplyMatrices(makeTranslation(0.0f, 0.0f, -(float)frame), makeRotationY(frame * 0.05f));
+            transformVertices(multiplyMatrices(view, floorProjection), floorMesh, floorCache);
+            projectVertices(floorCache, BENCH_WIDTH, BENCH_HEIGHT, 1000.0f);
+            floorAssembler.submit(floorMesh, floorCache, &textureManager, renderer); } },
+        { "city", [&](TileRenderer *renderer, int frame) {
+            for (int row=0; row<(int)cityRows.size(); row++) {
+                if (frame > 0 && row % 4 != frame % 4) continue;                // the first frame places every row
+                float bob = sinf(frame * 0.2f + row) * 0.5f;
+                city.setTransform(cityRows[row], makeTranslation(0.0f, bob, -64.0f + 2.0f * row));
+            }
+            TMat4x4 view = multiplyMatrices(makeTranslation(-0.5f, -3.0f, 0.5f), makeRotationY(frame * 0.05f));
+            city.submit(multiplyMatrices(view, floorProjection), cityAssembler, &textureManager, renderer); } },
+        { "crates", [&](TileRenderer *renderer, int frame) {
+            TMat4x4 view = multiplyMatrices(makeTranslation(0.0f, -8.0f, 0.0f), makeRotationY(frame * 0.03f));
+            view = multiplyMatrices(view, makeRotationX(-0.35f));
+            crateBatch.submit(cubeScene.mesh, crateTransforms.data(), crateTextures.data(), (int)crateTransforms.size(),
+                              multiplyMatrices(view, floorProjection), cityAssembler, &textureManager, renderer); } },
+        { "static", [&](TileRenderer *renderer, int frame) {
+            TMat4x4 spin = multiplyMatrices(makeTranslation(-0.5f, -0.5f, -0.5f), makeRotationY(frame * 0.1f));
+            yard.setTransform(spinner, multiplyMatrices(spin, makeTranslation(0.0f, 2.0f, 8.0f)));
+            yard.submit(multiplyMatrices(yardView, floorProjection), yardAssembler, &textureManager, renderer); } },
+        { "commands", [&](TileRenderer *renderer, int frame) {
+            commandBuffer.clear();
+            recordGrid(commandBuffer, cubeScene.mesh, textures);
+            commandBuffer.execute(gridViewProjection(frame), commandAssembler, &textureManager, renderer); } },
+    };
+
+    std::map<std::string, uint64_t> golden = readGolden(goldenFile);
+    if (traceFile) Profiler::beginCapture();
+    int mismatches = 0;
+    int allocating = 0;
+
+    printf("%d frames of %dx%d, %d threads, edge SIMD level %d%s\n\n", frames, BENCH_WIDTH, BENCH_HEIGHT,
+           threadPool.threadCount(), (int)edgeSimdLevel(), incremental ? ", incremental" : "");
+    printf("%-28s %8s %9s %9s %9s %7s %7s %7s %7s  %-16s %s\n", "scene", "frames", "fps", "Mtris/s", "Mfrags/s",
+           "p50 ms", "p90 ms", "p99 ms", "max ms", "checksum", "golden");
+
+    for (TShadingMode shading : shadings) {
+        renderer.setShadingMode(shading);
+        for (TRasterizerMode mode : modes) {
+            renderer.setRasterizerMode(mode);
+            std::string variant = std::string(mode == RASTERIZER_EDGE ? "edge" : "scanline") +
+                                  (shading == SHADING_VISIBILITY ? "-vis" : "");
+            if (perspectiveSpan() == 0) variant += "-affine";                   // other images, checksums of their own
+            else if (perspectiveSpan() != PERSPECTIVE_SPAN_DEFAULT) variant += "-p" + std::to_string(perspectiveSpan());
+            for (const TBenchScene &scene : scenes) {
+                if (onlyScene && strcmp(onlyScene, scene.name)) continue;
+
+                PROFILE_ONLY(Profiler::reset();)
+                TBenchResult result = runScene(scene, frames, renderer, textureManager, frameBuffer, depthBuffer);
+                std::string key = std::string(scene.name) + "/" + variant + "/" + std::to_string(frames);
+                const char *status;
+                if (updateGolden) {
+                    golden[key] = result.checksum;
+                    status = "updated";
+                }
+                else if (golden.find(key) == golden.end()) {
+                    status = "none";
+                }
+                else if (golden[key] == result.checksum) {
+                    status = "ok";
+                }
+                else {
+                    status = "MISMATCH";
+                    mismatches++;
+                }
+
+                printf("%-28s %8d %9.1f %9.3f %9.1f %7.2f %7.2f %7.2f %7.2f  %016llx %s\n",
+                       (std::string(scene.name) + "/" + variant).c_str(), frames,
+                       frames / result.seconds, result.triangles / result.seconds * 1e-6,
+                       result.fragments / result.seconds * 1e-6, percentile(result.frameTimes, 0.50),
+                       percentile(result.frameTimes, 0.90), percentile(result.frameTimes, 0.99),
+                       percentile(result.frameTimes, 1.0), (unsigned long long)result.checksum, status);
+                if (result.allocatingFrames) {
+                    printf("  %d of the frames after the first %d allocated\n", result.allocatingFrames, BENCH_WARMUP);
+                    allocating++;
+                }
+                if (stats) printf("\n%s\n", Profiler::summary().c_str());
+            }
+        }
+    }
+
+    if (traceFile && !Profiler::writeTrace(traceFile)) {
+        fprintf(stderr, "can not write %s\n", traceFile);
+        return 1;
+    }
+
+    if (updateGolden && !writeGolden(goldenFile, golden)) {
+        fprintf(stderr, "can not write %s\n", goldenFile);
+        return 1;
+    }
+
+    bool contextsMatch = true;
+    if (micro) {
+        runMicrobenchmarks(textureManager, threadPool);
+        contextsMatch = runContexts(textureManager, cubeScene.mesh, textures);
+    }
+
+    if (mismatches) {
+        printf("\n%d scene(s) no longer match the golden checksums\n", mismatches);
+        return 1;
+    }
+    if (allocating) {
+        printf("\n%d scene(s) allocated memory while drawing\n", allocating);
+        return 1;
+    }
+    if (!contextsMatch) {
+        printf("\nrender contexts drawing at once did not draw the same frames\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+QT += gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench
+
+# Headless benchmark: renders fixed frames offscreen and checks them against bench/golden.txt
+
+DEFINES += TEXTURING_SOURCE_DIR=\\\"$$PWD/..\\\"
+
+include(../library/library.pri)
+
+SOURCES += \
+        bench.cpp
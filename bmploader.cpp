@@ -1,194 +1,283 @@
-#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <QDebug>
 #include "bmploader.h"
 
-size_t strlcpy(char *dst, const char *src, size_t n) {
-    char *p = dst;
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BMP_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
 
-    if (n != 0) {
-        for (; --n != 0; p++, src++) {
-            if ((*p = *src) == '\0')
-                return p - dst;
-        }
-        *p = '\0';
+#if defined(BMP_X86) && defined(__GNUC__)
+#define TARGET_SSSE3    __attribute__((target("ssse3")))
+#else
+#define TARGET_SSSE3
+#endif
+
+#define BITMAP_FILEHEADER_SIZE  14
+#define BMP_SIGNATURE           19778                                           // "BM"
+#define BMP_MAX_SIZE            65536                                           // larger sizes are treated as a broken header
+#define BMP_PARALLEL_TEXELS     (256 * 256)                                     // smaller images are not worth splitting up
+
+#pragma pack(push,1)
+
+typedef struct _BITMAP_FILEHEADER {
+    uint16_t Signature;
+    uint32_t Size;
+    uint32_t Reserved;
+    uint32_t BitsOffset;
+} BITMAP_FILEHEADER;
+
+typedef struct _BITMAP_HEADER {                                                 // BITMAPINFOHEADER, the later versions only append to it
+    uint32_t HeaderSize;
+    int32_t Width;
+    int32_t Height;                                                             // negative for top-down images
+    uint16_t Planes;
+    uint16_t BitCount;
+    uint32_t Compression;
+    uint32_t SizeImage;
+    int32_t PelsPerMeterX;
+    int32_t PelsPerMeterY;
+    uint32_t ClrUsed;
+    uint32_t ClrImportant;
+} BITMAP_HEADER;
+
+#pragma pack(pop)
+
+// Converts one row of width pixels of the file into texels
+typedef void (*TRowDecoder)(const unsigned char *src, QRgb *dst, int width, const QRgb *palette);
+
+static std::mutex searchPathLock;
+static std::vector<std::string> searchPaths = { "../Texturing/" };            // the sources seen from a shadow build directory
+
+BMPLoader::BMPLoader()
+{
+}
+
+void BMPLoader::addSearchPath(const char *path)
+{
+    std::string dir(path);
+
+    if (!dir.empty() && dir.back() != '/' && dir.back() != '\\') dir += '/';
+    std::lock_guard<std::mutex> guard(searchPathLock);
+    searchPaths.push_back(dir);
+}
+
+void BMPLoader::clearSearchPaths()
+{
+    std::lock_guard<std::mutex> guard(searchPathLock);
+    searchPaths.clear();
+}
+
+static bool openBitmap(const char *fileName, MappedFile &file)
+{
+    if (file.open(fileName)) return true;
+
+    std::lock_guard<std::mutex> guard(searchPathLock);
+    for (const std::string &dir : searchPaths) {
+        if (file.open((dir + fileName).c_str())) return true;
     }
-    return (p - dst) + strlen(src);
+    return false;
 }
 
-size_t strlcat(char *dst, const char *src, size_t n) {
-    char *p = dst;
+static bool hasSSSE3()
+{
+#if defined(BMP_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#elif defined(BMP_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return false;
+#endif
+}
+
+static void decodeRow8(const unsigned char *src, QRgb *dst, int width, const QRgb *palette)
+{
+    int x;
 
-    while (n != 0 && *p != '\0') {
-        p++;
-        n--;
+    for (x=0; x<width; x++) {
+        dst[x] = palette[src[x]];
     }
-    if (n != 0) {
-        for (; --n != 0; p++, src++) {
-            if ((*p = *src) == '\0')
-                return p - dst;
-        }
-        *p = '\0';
+}
+
+static void decodeRow16(const unsigned char *src, QRgb *dst, int width, const QRgb *)
+{
+    int x = 0;
+
+#if defined(BMP_X86)
+    // Eight 5-5-5 pixels at a time, every channel ends up in the upper bits of its byte
+    const __m128i channel = _mm_set1_epi16(0xF8);
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+    for (; x + 8 <= width; x+=8) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_and_si128(_mm_slli_epi16(p, 3), channel);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 2), channel);
+        __m128i r = _mm_and_si128(_mm_srli_epi16(p, 7), channel);
+        __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        __m128i ra = _mm_or_si128(r, alpha);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(dst + x + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+#endif
+
+    for (; x<width; x++) {
+        unsigned int col16bit = src[2 * x] | ((unsigned int)src[2 * x + 1] << 8);
+        dst[x] = qRgb(((col16bit >> 10) & 0x1f) << 3, ((col16bit >> 5) & 0x1f) << 3, (col16bit & 0x1f) << 3);
     }
-    return (p - dst) + strlen(src);
 }
 
-BMPLoader::BMPLoader()
+static void decodeRow24(const unsigned char *src, QRgb *dst, int width, const QRgb *)
+{
+    int x;
+
+    for (x=0; x<width; x++) {
+        dst[x] = qRgb(src[3 * x + 2], src[3 * x + 1], src[3 * x]);
+    }
+}
+
+#if defined(BMP_X86)
+TARGET_SSSE3 static void decodeRow24SSSE3(const unsigned char *src, QRgb *dst, int width, const QRgb *)
 {
+    int x = 0;
+
+    // Four BGR pixels are spread out to BGRA with one shuffle, the 16 byte load must stay inside the row
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    for (; 3 * x + 16 <= 3 * width; x+=4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + 3 * x));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(_mm_shuffle_epi8(p, spread), alpha));
+    }
+
+    for (; x<width; x++) {
+        dst[x] = qRgb(src[3 * x + 2], src[3 * x + 1], src[3 * x]);
+    }
 }
+#endif
 
-QRgb *BMPLoader::loadTexture(const char *fileName, int &width, int &height)
+static void decodeRow32(const unsigned char *src, QRgb *dst, int width, const QRgb *)
 {
-    #pragma pack(push,1)
-
-    typedef struct _BITMAP_FILEHEADER {
-        uint16_t Signature;
-        uint32_t Size;
-        uint32_t Reserved;
-        uint32_t BitsOffset;
-    } BITMAP_FILEHEADER;
-
-    #define BITMAP_FILEHEADER_SIZE 14
-
-    typedef struct _BITMAP_HEADER {
-        uint32_t HeaderSize;
-        int32_t Width;
-        int32_t Height;
-        uint16_t Planes;
-        uint16_t BitCount;
-        uint32_t Compression;
-        uint32_t SizeImage;
-        int32_t PelsPerMeterX;
-        int32_t PelsPerMeterY;
-        uint32_t ClrUsed;
-        uint32_t ClrImportant;
-        uint32_t RedMask;
-        uint32_t GreenMask;
-        uint32_t BlueMask;
-        uint32_t AlphaMask;
-        uint32_t CsType;
-        uint32_t Endpoints[9];                                                  // see http://msdn2.microsoft.com/en-us/library/ms536569.aspx
-        uint32_t GammaRed;
-        uint32_t GammaGreen;
-        uint32_t GammaBlue;
-    } BITMAP_HEADER;
-
-    #pragma pack(pop)
-
-    int  i;
-    char palette[256][4];                                                       // needed for the color palette
-    int  offset;
-    int  lines;
-    int  paddedWidth;
-    int  color;
-
-    FILE *BMPFile;                                                              // file handle
-    BITMAP_FILEHEADER m_BitmapFileHeader;
-    BITMAP_HEADER m_BitmapHeader;
-
-    if ((BMPFile = fopen(fileName,"rb")) == NULL) {
-        char fileName2[strlen(fileName) + 14];
-        strlcpy(fileName2, "..\\Texturing\\", sizeof(fileName2));
-        strlcat(fileName2, fileName, sizeof(fileName2));
-        if ((BMPFile = fopen(fileName2,"rb")) == NULL) {
-            qDebug() << "Error opening file " << fileName;
-            return NULL;
-        }
+    memcpy(dst, src, width * sizeof(QRgb));                                     // BGRA in the file is QRgb in memory
+}
+
+QRgb *BMPLoader::loadTexture(const char *fileName, int &width, int &height, TextureStorage &storage, ThreadPool *pool,
+                             MappedFile *mapping)
+{
+    MappedFile localFile;
+    MappedFile &file = mapping ? *mapping : localFile;
+    BITMAP_FILEHEADER fileHeader;
+    BITMAP_HEADER header;
+    QRgb palette[256];
+    TRowDecoder decodeRow;
+    int i;
+
+    if (!openBitmap(fileName, file)) {
+        qDebug() << "Error opening file " << fileName;
+        return NULL;
     }
-    fread(&m_BitmapFileHeader, BITMAP_FILEHEADER_SIZE, 1, BMPFile);             // we read the file header
 
-    // We check whether the appropriate bitmap file can be displayed
-    if (m_BitmapFileHeader.Signature != 19778 || m_BitmapFileHeader.Reserved != 0) {    // Not a valid bitmap file - don't display
-        fclose(BMPFile);
+    // Validate the headers in place, everything the decoder touches has to lie inside the file
+    if (file.size < BITMAP_FILEHEADER_SIZE + sizeof(BITMAP_HEADER)) {
+        file.close();
         qDebug() << "Not a valid bitmap file - don't display";
         return NULL;
     }
+    memcpy(&fileHeader, file.data, sizeof(fileHeader));
+    memcpy(&header, file.data + BITMAP_FILEHEADER_SIZE, sizeof(header));
 
-    fread(&m_BitmapHeader, sizeof(BITMAP_HEADER), 1, BMPFile);
+    if (fileHeader.Signature != BMP_SIGNATURE || header.HeaderSize < sizeof(BITMAP_HEADER) ||
+        header.Width <= 0 || header.Width > BMP_MAX_SIZE || header.Height == 0 ||
+        header.Height > BMP_MAX_SIZE || header.Height < -BMP_MAX_SIZE) {
+        file.close();
+        qDebug() << "Not a valid bitmap file - don't display";
+        return NULL;
+    }
 
-    if (m_BitmapHeader.Compression != 0) {                                      // Compressed file - don't display
-        fclose(BMPFile);
+    if (header.Compression != 0) {                                              // Compressed file - don't display
+        file.close();
         qDebug() << "Compressed file - don't display";
         return NULL;
     }
 
-    fseek(BMPFile, BITMAP_FILEHEADER_SIZE + m_BitmapHeader.HeaderSize, SEEK_SET);
+    bool topDown = header.Height < 0;
+    int imageWidth = header.Width;
+    int imageHeight = topDown ? -header.Height : header.Height;
+    size_t rowBytes = (((size_t)imageWidth * header.BitCount + 31) / 32) * 4;   // rows are padded to 4 bytes
 
-    offset = m_BitmapHeader.Width * (m_BitmapHeader.Height-1);                  // Set appropriate position to display graphics data
-    paddedWidth = m_BitmapHeader.Width & 0xFFFC;                                // Pad line length to 4bytes
-    if (m_BitmapHeader.Width != paddedWidth)
-        paddedWidth += 4;
-
-    TRGBColor * texture = new TRGBColor[m_BitmapHeader.Width * m_BitmapHeader.Height];
-    width = m_BitmapHeader.Width;
-    height = m_BitmapHeader.Height;
-    lines = 0;                                                                  // We've read no lines so far
-
-    if (m_BitmapHeader.BitCount == 8) {
-        fread (&palette, 1024, 1, BMPFile);                                     // we read the color palette
+    switch (header.BitCount) {
+    case 8:  decodeRow = decodeRow8; break;
+    case 16: decodeRow = decodeRow16; break;
+#if defined(BMP_X86)
+    case 24: decodeRow = hasSSSE3() ? decodeRow24SSSE3 : decodeRow24; break;
+#else
+    case 24: decodeRow = decodeRow24; break;
+#endif
+    case 32: decodeRow = decodeRow32; break;
+    default:
+        file.close();
+        qDebug() << "Unsupported bit depth - don't display";
+        return NULL;
+    }
 
-        while (lines < m_BitmapHeader.Height)	{                               // Decode and display graphics
-            for (i=0; i < paddedWidth; i++) {                                   // Read next line
-                color =  getc(BMPFile);
-                texture[offset + i].R = palette[color & 0xFF][2];
-                texture[offset + i].G = palette[color & 0xFF][1];
-                texture[offset + i].B = palette[color & 0xFF][0];
-                texture[offset + i].alpha = palette[color & 0xFF][3];
-            }
-            offset -= m_BitmapHeader.Width;                                     // Move up one line on the screen
-            lines++;                                                            // increase amount of lines read
-        }
+    if (fileHeader.BitsOffset > file.size || rowBytes > (file.size - fileHeader.BitsOffset) / imageHeight) {
+        file.close();
+        qDebug() << "Truncated bitmap file - don't display";
+        return NULL;
+    }
 
-        fclose(BMPFile);
-        return (QRgb *)texture;
-    }
-    else {                                                                      // Other than 8-bit colour - don't display
-        fseek(BMPFile, m_BitmapFileHeader.BitsOffset, SEEK_SET);
-
-        if (m_BitmapHeader.BitCount == 16) {
-            unsigned short col16bit;
-            while (lines < m_BitmapHeader.Height)	{                           // Decode and display graphics
-                for (i=0; i < paddedWidth; i++) {                               // Read next line
-                    col16bit  = getc(BMPFile);
-                    col16bit |= (unsigned short)getc(BMPFile) << 8;
-                    texture[offset + i].B = (col16bit & 0x1f) << 3;
-                    texture[offset + i].G = ((col16bit >> 5) & 0x1f) << 3;
-                    texture[offset + i].R = ((col16bit >> 10) & 0x1f) << 3;
-                    texture[offset + i].alpha = 255;
-                }
-                offset -= m_BitmapHeader.Width;                                 // Move up one line on the screen
-                lines++;                                                        // increase amount of lines read
-            }
+    if (header.BitCount == 8) {
+        size_t paletteOffset = BITMAP_FILEHEADER_SIZE + (size_t)header.HeaderSize;
+        size_t colors = (header.ClrUsed > 0 && header.ClrUsed < 256) ? header.ClrUsed : 256;
+        if (paletteOffset + colors * 4 > fileHeader.BitsOffset) {
+            file.close();
+            qDebug() << "Not a valid bitmap file - don't display";
+            return NULL;
         }
-        if (m_BitmapHeader.BitCount == 24) {
-            while (lines < m_BitmapHeader.Height)	{                           // Decode and display graphics
-                for (i=0; i < paddedWidth; i++) {                               // Read next line
-                    texture[offset + i].B = getc(BMPFile);
-                    texture[offset + i].G = getc(BMPFile);
-                    texture[offset + i].R = getc(BMPFile);
-                    texture[offset + i].alpha = 255;
-                }
-                offset -= m_BitmapHeader.Width;                                 // Move up one line on the screen
-                lines++;                                                        // increase amount of lines read
-            }
+        const unsigned char *entry = file.data + paletteOffset;
+        for (i=0; i<256; i++) {                                                 // unused entries stay black
+            palette[i] = (i < (int)colors) ? qRgb(entry[4 * i + 2], entry[4 * i + 1], entry[4 * i]) : qRgb(0, 0, 0);
         }
-        else if (m_BitmapHeader.BitCount == 32) {
-            while (lines < m_BitmapHeader.Height)	{                           // Decode and display graphics
-                for (i=0; i < paddedWidth; i++) {                               // Read next line
-                    texture[offset + i].B = getc(BMPFile);
-                    texture[offset + i].G = getc(BMPFile);
-                    texture[offset + i].R = getc(BMPFile);
-                    texture[offset + i].alpha = getc(BMPFile);
-                }
-                offset -= m_BitmapHeader.Width;                                 // Move up one line on the screen
-                lines++;                                                        // increase amount of lines read
-            }
+    }
+
+    width = imageWidth;
+    height = imageHeight;
+    const unsigned char *bits = file.data + fileHeader.BitsOffset;
+
+    if (mapping && header.BitCount == 32 && topDown && fileHeader.BitsOffset % sizeof(QRgb) == 0) {
+        return (QRgb *)bits;                                                    // the file already holds the texels as they are needed
+    }
+
+    if (!storage.allocate((size_t)imageWidth * imageHeight * sizeof(QRgb))) {
+        file.close();
+        qDebug() << "Out of memory for " << fileName;
+        return NULL;
+    }
+    QRgb *texture = storage.as<QRgb>();
+    auto decodeRows = [&](int y0, int y1) {
+        for (int y=y0; y<y1; y++) {
+            int fileRow = topDown ? y : imageHeight - 1 - y;                    // bottom-up files store the last row first
+            decodeRow(bits + fileRow * rowBytes, texture + (size_t)y * imageWidth, imageWidth, palette);
         }
+    };
 
-        fclose(BMPFile);
-        return (QRgb *)texture;
+    if (pool && pool->threadCount() > 1 && (size_t)imageWidth * imageHeight >= BMP_PARALLEL_TEXELS) {
+        int bands = pool->threadCount() * 4;                                    // a few bands per thread to balance the load
+        pool->parallelFor(bands, [&](int band) {
+            decodeRows(band * imageHeight / bands, (band + 1) * imageHeight / bands);
+        });
+    }
+    else {
+        decodeRows(0, imageHeight);
     }
 
-    fclose(BMPFile);
-    return NULL;
-};
+    file.close();
+    return texture;
+}
@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 #include <QPainter>
+#include "mappedfile.h"
+#include "texturestorage.h"
+#include "threadpool.h"
 
 union TRGBColor {
     struct {
@@ -18,7 +21,16 @@ class BMPLoader
 {
 public:
     BMPLoader();
-     static QRgb *loadTexture(const char *fileName, int &width, int &height);
+
+    // Decodes an uncompressed 8-bit (palette), 16-bit (5-5-5), 24-bit or 32-bit bitmap, bottom-up or top-down, into
+    // width * height texels in storage, top row first, and returns them. With a mapping given, a top-down 32-bit file
+    // is not copied at all: the returned texels point into the file, which is left open in *mapping (and closed for
+    // every other format), and storage is left alone.
+    static QRgb *loadTexture(const char *fileName, int &width, int &height, TextureStorage &storage,
+                             ThreadPool *pool = NULL, MappedFile *mapping = NULL);
+
+    static void addSearchPath(const char *path);                                // directories tried when fileName can not be opened
+    static void clearSearchPaths();
 };
 
 #endif // BMPLOADER_H
@@ -0,0 +1,92 @@
+#include <string.h>
+#include <algorithm>
+#include "commandbuffer.h"
+#include "profiler.h"
+
+CommandBuffer::CommandBuffer()
+{
+    sorted = true;
+}
+
+void CommandBuffer::drawMesh(const TMesh &mesh, const TMat4x4 &world, TTextureHandle texture, uint32_t flags,
+                             const TBounds *bounds)
+{
+    TDrawCommand command;
+
+    if (mesh.vertexCount() == 0) return;
+    command.mesh = &mesh;
+    command.world = world;
+    command.bounds = bounds ? *bounds : computeBounds(mesh);
+    command.texture = texture;
+    command.flags = flags;
+    commands.push_back(command);
+}
+
+void CommandBuffer::clear()
+{
+    commands.clear();
+    order.clear();
+}
+
+uint64_t CommandBuffer::sortKey(const TDrawCommand &command, const TBounds &worldBounds,
+                                const TMat4x4 &viewProjection) const
+{
+    const TBounds &b = worldBounds;
+    const TMat4x4 &m = viewProjection;
+    uint32_t bits;
+
+    if (command.flags & (DRAW_NO_DEPTH_TEST | DRAW_NO_DEPTH_WRITE)) return COMMAND_ORDERED;
+
+    // w of the corner of the box closest to the camera, the distance the projection puts into w
+    float w = m.m[3][3] + m.m[0][3] * (m.m[0][3] > 0.0f ? b.minX : b.maxX)
+                        + m.m[1][3] * (m.m[1][3] > 0.0f ? b.minY : b.maxY)
+                        + m.m[2][3] * (m.m[2][3] > 0.0f ? b.minZ : b.maxZ);
+    if (!(w > 0.0f)) w = 0.0f;                                                  // reaches behind the camera
+    memcpy(&bits, &w, sizeof(bits));                                            // positive floats sort as integers
+
+    TTextureHandle texture = command.texture;
+    if (texture == NO_TEXTURE && command.mesh->triangleCount() > 0) texture = command.mesh->textures[0];
+
+    return ((uint64_t)(bits >> 20) << 52) | ((uint64_t)(uint32_t)(texture + 1) << 20) | (bits & 0xfffff);
+}
+
+void CommandBuffer::execute(const TMat4x4 &viewProjection, PrimitiveAssembler &assembler,
+                            TextureManager *textureManager, TileRenderer *renderer)
+{
+    int i;
+
+    if (commands.empty()) return;
+    if (renderer->isIncremental()) renderer->invalidate();                      // nothing is known about what moved
+
+    {
+        PROFILE_STAGE(STAGE_CULLING);
+        TFrustum frustum = makeFrustum(viewProjection, assembler.nearPlane(), assembler.farPlane());
+        order.clear();
+        for (i=0; i<(int)commands.size(); i++) {
+            TBounds bounds = transformBounds(commands[i].bounds, commands[i].world);
+            unsigned planeMask = ALL_PLANES;
+            if (!clipBounds(bounds, frustum, planeMask)) continue;
+            order.push_back({ sorted ? sortKey(commands[i], bounds, viewProjection) : 0, i });
+        }
+        PROFILE_COUNT(COUNTER_OBJECTS_VISIBLE, order.size());
+        PROFILE_COUNT(COUNTER_OBJECTS_CULLED, commands.size() - order.size());
+        if (sorted) {
+            std::sort(order.begin(), order.end(), [](const TSortEntry &a, const TSortEntry &b) {
+                return a.key < b.key || (a.key == b.key && a.command < b.command);
+            });
+        }
+    }
+
+    for (const TSortEntry &entry : order) {
+        const TDrawCommand &command = commands[entry.command];
+        {
+            PROFILE_STAGE(STAGE_TRANSFORM);
+            transformVertices(multiplyMatrices(command.world, viewProjection), *command.mesh, cache);
+            PROFILE_NEXT_STAGE(STAGE_PROJECTION);
+            assembler.project(cache);
+        }
+        assembler.setDrawFlags(command.flags);
+        assembler.submit(*command.mesh, cache, textureManager, renderer, 0, command.texture);
+    }
+    assembler.setDrawFlags(0);
+}
@@ -0,0 +1,65 @@
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <stdint.h>
+#include <vector>
+#include "mesh.h"
+#include "primitiveassembler.h"
+#include "texturemanager.h"
+#include "tilerenderer.h"
+
+#define COMMAND_ORDERED     (1ull << 63)                                        // sort key bit of draws kept in record order
+
+// Draws recorded during a frame and executed together at its end. Recording only copies the arguments; execute()
+// moves the box of every mesh into the world, drops the draws outside the view frustum, sorts the rest and transforms,
+// projects and assembles them one by one.
+//
+// Draws that test and write depth are sorted front to back by the nearest point of their box, so the depth pyramid
+// of the tile renderer rejects more of what lies behind them, and draws at about the same distance are grouped by
+// texture. The key is a 64-bit number: the exponent and the top of the mantissa of the distance, then the texture
+// (the one replacing the mesh's, or else the texture of its first triangle), then the rest of the mantissa. Draws
+// without a depth test or depth write depend on the order they are drawn in; they come after all others, as
+// recorded. setSorted(false) executes everything as recorded.
+//
+// The commands and the sort order are kept from frame to frame, so a frame with no more draws than the ones before
+// it records and sorts them without allocating. The meshes are not copied and have to live until execute().
+class CommandBuffer
+{
+public:
+    CommandBuffer();
+
+    bool isSorted() const { return sorted; }
+    void setSorted(bool sorted) { this->sorted = sorted; }
+    int size() const { return (int)commands.size(); }
+
+    // world places the mesh; a texture other than NO_TEXTURE replaces the mesh's own; flags are TDrawFlags; bounds
+    // is the box of the mesh in its own space, computed from the mesh when NULL
+    void drawMesh(const TMesh &mesh, const TMat4x4 &world, TTextureHandle texture = NO_TEXTURE, uint32_t flags = 0,
+                  const TBounds *bounds = NULL);
+    void clear();                                                               // forgets the draws, keeps the memory
+    void execute(const TMat4x4 &viewProjection, PrimitiveAssembler &assembler, TextureManager *textureManager,
+                 TileRenderer *renderer);
+
+private:
+    struct TDrawCommand {
+        const TMesh *mesh;
+        TMat4x4 world;
+        TBounds bounds;
+        TTextureHandle texture;
+        uint32_t flags;
+    };
+
+    struct TSortEntry {
+        uint64_t key;
+        int command;                                                            // index into commands, breaks ties
+    };
+
+    bool sorted;
+    std::vector<TDrawCommand> commands;
+    std::vector<TSortEntry> order;
+    TVertexCache cache;
+
+    uint64_t sortKey(const TDrawCommand &command, const TBounds &worldBounds, const TMat4x4 &viewProjection) const;
+};
+
+#endif // COMMANDBUFFER_H
@@ -0,0 +1,103 @@
+#include <QtMath>
+#include <algorithm>
+#include "cubescene.h"
+#include "meshloader.h"
+#include "profiler.h"
+
+CubeScene::CubeScene(TextureManager *textureManager, int width, int height)
+{
+    this->textureManager = textureManager;
+
+    TTextureHandle leftTexture = textureManager->load("negx.bmp");
+    TTextureHandle topTexture = textureManager->load("posy.bmp");
+    TTextureHandle rightTexture = textureManager->load("posx.bmp");
+    TTextureHandle bottomTexture = textureManager->load("negy.bmp");
+    TTextureHandle frontTexture = textureManager->load("negz.bmp");
+    TTextureHandle backTexture = textureManager->load("posz.bmp");
+
+    const TVertex faces[][3] = {                                                // the corners, textured below
+
+        // FRONT
+        { { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },    { 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },    { 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f },    { 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f } },
+
+        // RIGHT
+        { { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },    { 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },    { 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f } },
+        { { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },    { 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },    { 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f } },
+
+        // BACK
+        { { 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },    { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f },    { 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f } },
+        { { 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },    { 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f } },
+
+        // LEFT
+        { { 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f },    { 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f },    { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f } },
+
+        // TOP
+        { { 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f },    { 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },    { 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },    { 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f } },
+
+        // BOTTOM
+        { { 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f },    { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f } },
+        { { 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },    { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },    { 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f } },
+    };
+    const TTextureHandle faceTextures[] = {
+        frontTexture, frontTexture, rightTexture, rightTexture, backTexture, backTexture,
+        leftTexture, leftTexture, topTexture, topTexture, bottomTexture, bottomTexture
+    };
+    for (size_t i=0; i<sizeof(faces)/sizeof(faces[0]); i++) {                  // 8 shared corners, 36 textured ones
+        mesh.addTriangle(faces[i], faceTextures[i]);
+    }
+
+    // Projection matrix
+    float fScale = 2.0f;
+    float fNear = 0.1f;
+    float fFar = 1000.0f;
+    float fFov = 90.0f;
+    float fAspectRatio = (float)height/(float)width;
+    matProj = makeProjection(fFov, fAspectRatio, fNear, fFar, fScale);
+
+    assembler.setViewport(width, height, fFar);
+    assembler.setDepthPlanes(fNear, fFar);
+    cubeNode = scene.addNode(NO_NODE, &mesh);
+}
+
+bool CubeScene::loadMesh(const char *fileName, ThreadPool *pool)
+{
+    TMesh loaded;
+    int i;
+
+    if (!MeshLoader::load(fileName, loaded, textureManager, pool) || loaded.vertexCount() == 0) return false;
+
+    TBounds b = computeBounds(loaded);
+    float size = std::max(b.maxX - b.minX, std::max(b.maxY - b.minY, b.maxZ - b.minZ));
+    float scale = size > 0.0f ? 1.0f / size : 1.0f;
+    for (i=0; i<loaded.vertexCount(); i++) {                                    // centred in the unit cube the scene spins
+        loaded.x[i] = (loaded.x[i] - (b.minX + b.maxX) * 0.5f) * scale + 0.5f;
+        loaded.y[i] = (loaded.y[i] - (b.minY + b.maxY) * 0.5f) * scale + 0.5f;
+        loaded.z[i] = (loaded.z[i] - (b.minZ + b.maxZ) * 0.5f) * scale + 0.5f;
+    }
+    mesh = std::move(loaded);
+    scene.setMesh(cubeNode, &mesh);
+    return true;
+}
+
+// A frame drawn smaller to be stretched to the full size, so the projection keeps the aspect given at construction
+void CubeScene::setViewport(int width, int height)
+{
+    assembler.setViewport(width, height, assembler.farPlane());
+}
+
+void CubeScene::submit(TileRenderer *renderer, int step)
+{
+    PROFILE_STAGE(STAGE_SCENE);
+
+    float fTheta = step * M_PI / 100.0;
+
+    // Rotation around Z, then around X, then 3 units away from the camera
+    TMat4x4 matWorld = multiplyMatrices(makeRotationZ(fTheta), makeRotationX(fTheta * 0.5f));
+    matWorld = multiplyMatrices(matWorld, makeTranslation(0.0f, 0.0f, 3.0f));
+    scene.setTransform(cubeNode, matWorld);
+
+    scene.submit(matProj, assembler, textureManager, renderer);                 // the camera sits at the origin
+}
@@ -0,0 +1,30 @@
+#ifndef CUBESCENE_H
+#define CUBESCENE_H
+
+#include "mesh.h"
+#include "primitiveassembler.h"
+#include "scenegraph.h"
+#include "texturemanager.h"
+#include "tilerenderer.h"
+
+// The textured cube spinning around the Z and X axes, shared by the application and the benchmark
+class CubeScene
+{
+public:
+    TMesh mesh;
+
+    CubeScene(TextureManager *textureManager, int width, int height);
+
+    bool loadMesh(const char *fileName, ThreadPool *pool = NULL);               // an imported mesh, fitted into the cube
+    void submit(TileRenderer *renderer, int step);                              // the cube as seen at animation step
+    void setViewport(int width, int height);                                    // the size drawn at, the aspect stays
+
+private:
+    TextureManager *textureManager;
+    TMat4x4 matProj;
+    SceneGraph scene;
+    TNodeHandle cubeNode;
+    PrimitiveAssembler assembler;
+};
+
+#endif // CUBESCENE_H
@@ -0,0 +1,23 @@
+QT -= gui
+QT += widgets
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = Texturing
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+DEFINES += TEXTURING_SOURCE_DIR=\\\"$$PWD/..\\\"
+
+include(../library/library.pri)
+
+SOURCES += \
+        main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,154 @@
+#include <QApplication>
+#include <QLabel>
+#include <QPainter>
+#include <QPixmap>
+#include <QTimer>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "QDebug"
+
+#include "bmploader.h"
+#include "cubescene.h"
+#include "depthbuffer.h"
+#include "dynamicresolution.h"
+#include "edgerasterizer.h"
+#include "framebuffer.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "rendercontext.h"
+#include "renderthread.h"
+#include "texture.h"
+#include "texturemanager.h"
+#include "threadpool.h"
+
+#define WND_WIDTH   800                                                         // unless given on the command line
+#define WND_HEIGHT  600
+#define PRESENT_INTERVAL    16                                                  // milliseconds, about 60 Hz
+
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    ThreadPool threadPool;
+    TextureManager textureManager;                                              // loads in the background, placeholders until then
+    RenderContext context(WND_WIDTH, WND_HEIGHT, &textureManager, &threadPool);
+    TileRenderer &renderer = context.renderer();
+    QLabel windowLabel;
+    int width = WND_WIDTH, height = WND_HEIGHT;
+    double frameBudget = 0.0;                                                   // milliseconds, 0 draws at the full size
+    float minScale = RESOLUTION_MIN_SCALE;
+    FrameScaler scaler;
+    const char *traceFile = NULL;                                               // Chrome trace written on exit
+    const char *meshFile = NULL;
+    TFramePacing pacing = PACING_FIXED;                                         // one frame every 10 ms, as the old timer
+    int bufferCount = RENDER_MAX_BUFFERS;
+    TTextureFormat textureFormat = TEXTURE_RGB32;
+    bool overlay = false;
+
+    for (int i=1; i<argc; i++) {                                                // A/B switches for the rasterization engines
+        if (!strcmp(argv[i], "--rasterizer=edge")) renderer.setRasterizerMode(RASTERIZER_EDGE);
+        else if (!strcmp(argv[i], "--rasterizer=scanline")) renderer.setRasterizerMode(RASTERIZER_SCANLINE);
+        else if (!strcmp(argv[i], "--shading=forward")) renderer.setShadingMode(SHADING_FORWARD);
+        else if (!strcmp(argv[i], "--shading=visibility")) renderer.setShadingMode(SHADING_VISIBILITY);
+        else if (!strcmp(argv[i], "--incremental")) renderer.setIncremental(true);
+        else if (!strcmp(argv[i], "--simd=scalar")) setEdgeSimdLevel(SIMD_SCALAR);
+        else if (!strcmp(argv[i], "--simd=sse2")) setEdgeSimdLevel(SIMD_SSE2);
+        else if (!strcmp(argv[i], "--simd=avx2")) setEdgeSimdLevel(SIMD_AVX2);
+        else if (!strcmp(argv[i], "--simd=avx512")) setEdgeSimdLevel(SIMD_AVX512);
+        else if (!strncmp(argv[i], "--perspective=", 14)) setPerspectiveSpan(atoi(argv[i] + 14));
+        else if (!strncmp(argv[i], "--textures=", 11)) BMPLoader::addSearchPath(argv[i] + 11);
+        else if (!strncmp(argv[i], "--mesh=", 7)) meshFile = argv[i] + 7;
+        else if (!strcmp(argv[i], "--pacing=fixed")) pacing = PACING_FIXED;
+        else if (!strcmp(argv[i], "--pacing=unlimited")) pacing = PACING_UNLIMITED;
+        else if (!strcmp(argv[i], "--pacing=vsync")) pacing = PACING_VSYNC;
+        else if (!strncmp(argv[i], "--buffers=", 10)) bufferCount = atoi(argv[i] + 10);
+        else if (!strcmp(argv[i], "--texture-format=rgb32")) textureFormat = TEXTURE_RGB32;
+        else if (!strcmp(argv[i], "--texture-format=indexed8")) textureFormat = TEXTURE_INDEXED8;
+        else if (!strcmp(argv[i], "--texture-format=rgb565")) textureFormat = TEXTURE_RGB565;
+        else if (!strcmp(argv[i], "--texture-format=rgb555")) textureFormat = TEXTURE_RGB555;
+        else if (!strcmp(argv[i], "--texture-format=bc1")) textureFormat = TEXTURE_BC1;
+        else if (!strncmp(argv[i], "--width=", 8)) width = atoi(argv[i] + 8);
+        else if (!strncmp(argv[i], "--height=", 9)) height = atoi(argv[i] + 9);
+        else if (!strncmp(argv[i], "--dynamic-resolution=", 21)) frameBudget = atof(argv[i] + 21);
+        else if (!strncmp(argv[i], "--min-scale=", 12)) minScale = (float)atof(argv[i] + 12);
+        else if (!strcmp(argv[i], "--upscale=nearest")) scaler.setFilter(SCALE_NEAREST);
+        else if (!strcmp(argv[i], "--upscale=bilinear")) scaler.setFilter(SCALE_BILINEAR);
+#if defined(TEXTURING_PROFILE)
+        else if (!strcmp(argv[i], "--stats")) Profiler::setOverlay(overlay = true);
+        else if (!strncmp(argv[i], "--trace=", 8)) traceFile = argv[i] + 8;
+#endif
+    }
+#if defined(TEXTURING_SOURCE_DIR)
+    BMPLoader::addSearchPath(TEXTURING_SOURCE_DIR);
+#endif
+    if (traceFile) Profiler::beginCapture();
+    if (width <= 0 || height <= 0) {
+        qDebug() << "Bad window size" << width << "x" << height;
+        return 2;
+    }
+    context.resize(width, height);
+    DynamicResolution resolution(width, height, frameBudget);
+    resolution.setScaleRange(minScale);
+
+    textureManager.setTextureFormat(textureFormat);
+    CubeScene cubeScene(&textureManager, width, height);
+    if (meshFile && !cubeScene.loadMesh(meshFile, &threadPool)) qDebug() << "Can not load" << meshFile;
+
+    // The frames are drawn on a thread of their own, the GUI thread only shows the newest finished one
+    RenderThread renderThread(width, height, bufferCount);
+    renderThread.setPacing(pacing);
+    renderThread.start([&](FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, int step) {
+        textureManager.beginFrame();
+        if (frameBudget <= 0.0) {
+            context.beginFrame(qRgb(0, 0, 0), frameBuffer, depthBuffer);
+            if (overlay) renderer.invalidate();                                 // it is drawn over the frame
+            cubeScene.submit(&renderer, step);
+            context.endFrame();                                                 // rasterize all tiles in parallel
+            PROFILE_ONLY(QImage frame = frameBuffer->image(); Profiler::drawOverlay(frame);)
+            return renderer.damagedRect();
+        }
+
+        // Drawn into the buffers of the context at the size picked from the frames before, then stretched
+        auto start = std::chrono::steady_clock::now();
+        if (resolution.width() != context.width() || resolution.height() != context.height()) {
+            context.resize(resolution.width(), resolution.height());
+            cubeScene.setViewport(resolution.width(), resolution.height());
+        }
+        context.beginFrame(qRgb(0, 0, 0));
+        cubeScene.submit(&renderer, step);
+        context.endFrame();
+        scaler.scale(*context.frameBuffer(), *frameBuffer, &threadPool);
+        resolution.addFrame(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        PROFILE_ONLY(QImage frame = frameBuffer->image(); Profiler::drawOverlay(frame);)
+        TRect screen = { 0, 0, width, height };
+        return screen;
+    });
+
+    QImage blank(width, height, QImage::Format_RGB32);
+    blank.fill(qRgb(0, 0, 0));
+    QPixmap screen = QPixmap::fromImage(blank);                                 // the frame shown, updated where it changed
+
+    QTimer t;
+    QObject::connect(&t, &QTimer::timeout, [&]() {
+        TRect damage;
+        FrameBuffer *frameBuffer = renderThread.acquire(&damage);
+        if (frameBuffer == NULL) return;                                        // nothing new, keep the last frame
+
+        if (!isEmptyRect(damage)) {                                             // a copy, the buffer goes back at once
+            QPainter painter(&screen);
+            painter.drawImage(QPoint(damage.x0, damage.y0), frameBuffer->image(),
+                              QRect(damage.x0, damage.y0, damage.x1 - damage.x0, damage.y1 - damage.y0));
+        }
+        renderThread.release();
+        if (!isEmptyRect(damage)) windowLabel.setPixmap(screen);
+    });
+    t.start(PRESENT_INTERVAL);
+
+    windowLabel.setPixmap(screen);
+    windowLabel.show();
+
+    int ret = a.exec();
+    renderThread.stop();                                                        // before the scene and the renderer go
+    if (traceFile && !Profiler::writeTrace(traceFile)) qDebug() << "Can not write" << traceFile;
+    return ret;
+}
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include "depthbuffer.h"
+#include "alignedmemory.h"
+
+DepthBuffer::DepthBuffer()
+{
+    data = NULL;
+    width = 0;
+    height = 0;
+    stride = 0;
+    blocksX = blocksY = 0;
+    cellsX = cellsY = 0;
+    generation = 1;
+    blockGeneration = cellGeneration = NULL;
+    blockMin = blockMax = cellMin = cellMax = NULL;
+    dataCapacity = 0;
+    blockCapacity = 0;
+    cellCapacity = 0;
+}
+
+DepthBuffer::DepthBuffer(int width, int height) : DepthBuffer()
+{
+    resize(width, height);
+}
+
+DepthBuffer::~DepthBuffer()
+{
+    release();
+}
+
+void DepthBuffer::release()
+{
+    if (data) alignedFree(data);
+    if (blockGeneration) alignedFree(blockGeneration);
+    if (blockMin) alignedFree(blockMin);
+    if (blockMax) alignedFree(blockMax);
+    if (cellGeneration) alignedFree(cellGeneration);
+    if (cellMin) alignedFree(cellMin);
+    if (cellMax) alignedFree(cellMax);
+    data = NULL;
+    blockGeneration = cellGeneration = NULL;
+    blockMin = blockMax = cellMin = cellMax = NULL;
+    dataCapacity = 0;
+    blockCapacity = 0;
+    cellCapacity = 0;
+}
+
+// The memory is kept when the buffer gets no larger than it has been, so a renderer changing its resolution from frame
+// to frame does not allocate once it has drawn at the largest one
+void DepthBuffer::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    stride = (width + 15) & ~15;                                                // a whole number of cache lines and of blocks
+    blocksX = (width + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+    blocksY = (height + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+    cellsX = (blocksX + DEPTH_CELL_BLOCKS - 1) / DEPTH_CELL_BLOCKS;
+    cellsY = (blocksY + DEPTH_CELL_BLOCKS - 1) / DEPTH_CELL_BLOCKS;
+    if (width <= 0 || height <= 0) return;
+
+    // Rows are allocated up to a whole number of blocks, so filling a block never needs clipping
+    size_t size = (size_t)stride * blocksY * DEPTH_BLOCK_SIZE;
+    if (size > dataCapacity || blocksX * blocksY > blockCapacity || cellsX * cellsY > cellCapacity) {
+        release();
+        dataCapacity = size;
+        blockCapacity = blocksX * blocksY;
+        cellCapacity = cellsX * cellsY;
+        data = (float *)alignedAlloc(dataCapacity * sizeof(float));
+        blockGeneration = (uint32_t *)alignedAlloc(blockCapacity * sizeof(uint32_t));
+        blockMin = (float *)alignedAlloc(blockCapacity * sizeof(float));
+        blockMax = (float *)alignedAlloc(blockCapacity * sizeof(float));
+        cellGeneration = (uint32_t *)alignedAlloc(cellCapacity * sizeof(uint32_t));
+        cellMin = (float *)alignedAlloc(cellCapacity * sizeof(float));
+        cellMax = (float *)alignedAlloc(cellCapacity * sizeof(float));
+    }
+    std::fill(data, data + size, DEPTH_CLEAR_VALUE);
+    resetGenerations();
+}
+
+void DepthBuffer::resetGenerations()
+{
+    std::fill(blockGeneration, blockGeneration + blocksX * blocksY, 0);
+    std::fill(cellGeneration, cellGeneration + cellsX * cellsY, 0);
+    generation = 1;
+}
+
+void DepthBuffer::clear()
+{
+    if (++generation == 0) {                                                    // the counter wrapped around
+        resetGenerations();
+    }
+}
+
+bool DepthBuffer::isOccluded(const TRect &rect, float minZ) const
+{
+    int bx, by, cx, cy;
+
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) return true;
+
+    int bx0 = rect.x0 / DEPTH_BLOCK_SIZE, bx1 = (rect.x1 - 1) / DEPTH_BLOCK_SIZE;
+    int by0 = rect.y0 / DEPTH_BLOCK_SIZE, by1 = (rect.y1 - 1) / DEPTH_BLOCK_SIZE;
+
+    for (cy=by0/DEPTH_CELL_BLOCKS; cy<=by1/DEPTH_CELL_BLOCKS; cy++) {
+        for (cx=bx0/DEPTH_CELL_BLOCKS; cx<=bx1/DEPTH_CELL_BLOCKS; cx++) {
+            int cell = cx + cy * cellsX;
+            float farthest = (cellGeneration[cell] == generation) ? cellMax[cell] : DEPTH_CLEAR_VALUE;
+            if (minZ >= farthest) continue;                                     // the whole cell hides the triangle
+
+            // Some pixel of the cell may be behind the triangle - look at the blocks of the cell inside the rectangle
+            for (by=std::max(by0, cy*DEPTH_CELL_BLOCKS); by<=std::min(by1, cy*DEPTH_CELL_BLOCKS+DEPTH_CELL_BLOCKS-1); by++) {
+                for (bx=std::max(bx0, cx*DEPTH_CELL_BLOCKS); bx<=std::min(bx1, cx*DEPTH_CELL_BLOCKS+DEPTH_CELL_BLOCKS-1); bx++) {
+                    int block = bx + by * blocksX;
+                    farthest = (blockGeneration[block] == generation) ? blockMax[block] : DEPTH_CLEAR_VALUE;
+                    if (minZ < farthest) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool DepthBuffer::isInFront(const TRect &rect, float maxZ) const
+{
+    int bx, by, cx, cy;
+
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) return true;
+
+    int bx0 = rect.x0 / DEPTH_BLOCK_SIZE, bx1 = (rect.x1 - 1) / DEPTH_BLOCK_SIZE;
+    int by0 = rect.y0 / DEPTH_BLOCK_SIZE, by1 = (rect.y1 - 1) / DEPTH_BLOCK_SIZE;
+
+    for (cy=by0/DEPTH_CELL_BLOCKS; cy<=by1/DEPTH_CELL_BLOCKS; cy++) {
+        for (cx=bx0/DEPTH_CELL_BLOCKS; cx<=bx1/DEPTH_CELL_BLOCKS; cx++) {
+            int cell = cx + cy * cellsX;
+            float nearest = (cellGeneration[cell] == generation) ? cellMin[cell] : DEPTH_CLEAR_VALUE;
+            if (maxZ < nearest) continue;                                       // the triangle is in front of the whole cell
+
+            for (by=std::max(by0, cy*DEPTH_CELL_BLOCKS); by<=std::min(by1, cy*DEPTH_CELL_BLOCKS+DEPTH_CELL_BLOCKS-1); by++) {
+                for (bx=std::max(bx0, cx*DEPTH_CELL_BLOCKS); bx<=std::min(bx1, cx*DEPTH_CELL_BLOCKS+DEPTH_CELL_BLOCKS-1); bx++) {
+                    int block = bx + by * blocksX;
+                    nearest = (blockGeneration[block] == generation) ? blockMin[block] : DEPTH_CLEAR_VALUE;
+                    if (!(maxZ < nearest)) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void DepthBuffer::prepare(const TRect &rect)
+{
+    int bx, by, cx, cy, y;
+
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) return;
+
+    int bx0 = rect.x0 / DEPTH_BLOCK_SIZE, bx1 = (rect.x1 - 1) / DEPTH_BLOCK_SIZE;
+    int by0 = rect.y0 / DEPTH_BLOCK_SIZE, by1 = (rect.y1 - 1) / DEPTH_BLOCK_SIZE;
+
+    for (by=by0; by<=by1; by++) {
+        for (bx=bx0; bx<=bx1; bx++) {
+            int block = bx + by * blocksX;
+            if (blockGeneration[block] == generation) continue;
+
+            float *p = data + by * DEPTH_BLOCK_SIZE * stride + bx * DEPTH_BLOCK_SIZE;
+            for (y=0; y<DEPTH_BLOCK_SIZE; y++, p+=stride) {                     // lazy clear of the block
+                std::fill(p, p + DEPTH_BLOCK_SIZE, DEPTH_CLEAR_VALUE);
+            }
+            blockMin[block] = DEPTH_CLEAR_VALUE;
+            blockMax[block] = DEPTH_CLEAR_VALUE;
+            blockGeneration[block] = generation;
+        }
+    }
+
+    for (cy=by0/DEPTH_CELL_BLOCKS; cy<=by1/DEPTH_CELL_BLOCKS; cy++) {
+        for (cx=bx0/DEPTH_CELL_BLOCKS; cx<=bx1/DEPTH_CELL_BLOCKS; cx++) {
+            int cell = cx + cy * cellsX;
+            if (cellGeneration[cell] == generation) continue;
+            cellMin[cell] = DEPTH_CLEAR_VALUE;
+            cellMax[cell] = DEPTH_CLEAR_VALUE;
+            cellGeneration[cell] = generation;
+        }
+    }
+}
+
+void DepthBuffer::update(const TRect &rect)
+{
+    int bx, by, cx, cy, x, y;
+
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) return;
+
+    int bx0 = rect.x0 / DEPTH_BLOCK_SIZE, bx1 = (rect.x1 - 1) / DEPTH_BLOCK_SIZE;
+    int by0 = rect.y0 / DEPTH_BLOCK_SIZE, by1 = (rect.y1 - 1) / DEPTH_BLOCK_SIZE;
+
+    for (by=by0; by<=by1; by++) {
+        for (bx=bx0; bx<=bx1; bx++) {
+            const float *p = data + by * DEPTH_BLOCK_SIZE * stride + bx * DEPTH_BLOCK_SIZE;
+            float nearest = p[0];
+            float farthest = p[0];
+            for (y=0; y<DEPTH_BLOCK_SIZE; y++, p+=stride) {
+                for (x=0; x<DEPTH_BLOCK_SIZE; x++) {
+                    nearest = std::min(nearest, p[x]);
+                    farthest = std::max(farthest, p[x]);
+                }
+            }
+            blockMin[bx + by * blocksX] = nearest;
+            blockMax[bx + by * blocksX] = farthest;
+        }
+    }
+
+    for (cy=by0/DEPTH_CELL_BLOCKS; cy<=by1/DEPTH_CELL_BLOCKS; cy++) {
+        for (cx=bx0/DEPTH_CELL_BLOCKS; cx<=bx1/DEPTH_CELL_BLOCKS; cx++) {
+            float nearest = DEPTH_CLEAR_VALUE;
+            float farthest = -DEPTH_CLEAR_VALUE;
+            bool stale = false;
+            for (by=cy*DEPTH_CELL_BLOCKS; by<std::min((cy+1)*DEPTH_CELL_BLOCKS, blocksY); by++) {
+                for (bx=cx*DEPTH_CELL_BLOCKS; bx<std::min((cx+1)*DEPTH_CELL_BLOCKS, blocksX); bx++) {
+                    int block = bx + by * blocksX;
+                    if (blockGeneration[block] != generation) {                 // still cleared
+                        stale = true;
+                        continue;
+                    }
+                    nearest = std::min(nearest, blockMin[block]);
+                    farthest = std::max(farthest, blockMax[block]);
+                }
+            }
+            if (stale) farthest = DEPTH_CLEAR_VALUE;
+            cellMin[cx + cy * cellsX] = nearest;
+            cellMax[cx + cy * cellsX] = farthest;
+        }
+    }
+}
+
+int DepthBuffer::coveredPixels(const TRect &rect) const
+{
+    int x, y;
+    int covered = 0;
+
+    for (y=rect.y0; y<rect.y1; y++) {
+        const float *p = data + y * stride;
+        for (x=rect.x0; x<rect.x1; x++) {
+            int block = x / DEPTH_BLOCK_SIZE + (y / DEPTH_BLOCK_SIZE) * blocksX;
+            if (blockGeneration[block] == generation && p[x] != DEPTH_CLEAR_VALUE) covered++;
+        }
+    }
+    return covered;
+}
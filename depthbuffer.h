@@ -0,0 +1,64 @@
+#ifndef DEPTHBUFFER_H
+#define DEPTHBUFFER_H
+
+#include <limits.h>
+#include <stdint.h>
+#include "framebuffer.h"
+
+#define DEPTH_CLEAR_VALUE   ((float)INT_MAX)
+#define DEPTH_BLOCK_SIZE    8                                                   // level 1 of the pyramid - 8x8 pixels
+#define DEPTH_CELL_BLOCKS   8                                                   // level 2 - 8x8 blocks (64x64 pixels)
+
+// Row-major depth plane (smaller values are closer) with a coarse two-level min/max pyramid on top of it.
+//
+// Clearing is O(1): clear() only advances a generation counter, and a block whose generation is out of date is
+// treated as cleared by the pyramid and filled with DEPTH_CLEAR_VALUE the first time a triangle touches it.
+// Rasterizers therefore have to call prepare() before and update() after writing into a rectangle; both work on
+// whole blocks, so several threads may use the buffer at once as long as their rectangles do not share a block.
+class DepthBuffer
+{
+public:
+    float *data;
+    int width;
+    int height;
+    int stride;                                                                 // distance between rows in floats
+
+    DepthBuffer();
+    DepthBuffer(int width, int height);
+    ~DepthBuffer();
+
+    DepthBuffer(const DepthBuffer &) = delete;
+    DepthBuffer &operator=(const DepthBuffer &) = delete;
+
+    void resize(int width, int height);                                         // keeps the memory when not growing
+    void clear();
+
+    bool isOccluded(const TRect &rect, float minZ) const;                       // every pixel in rect is closer than minZ
+    bool isInFront(const TRect &rect, float maxZ) const;                        // every pixel in rect is farther than maxZ
+    void prepare(const TRect &rect);
+    void update(const TRect &rect);
+    int coveredPixels(const TRect &rect) const;                                 // pixels written since clear(), for statistics
+
+    inline float *line(int y) { return data + y * stride; }
+
+private:
+    int blocksX;
+    int blocksY;
+    int cellsX;
+    int cellsY;
+    uint32_t generation;
+    uint32_t *blockGeneration;
+    float *blockMin;
+    float *blockMax;
+    uint32_t *cellGeneration;
+    float *cellMin;
+    float *cellMax;
+    size_t dataCapacity;                                                        // floats allocated
+    int blockCapacity;                                                          // entries of the block arrays allocated
+    int cellCapacity;
+
+    void release();
+    void resetGenerations();
+};
+
+#endif // DEPTHBUFFER_H
@@ -0,0 +1,170 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "dynamicresolution.h"
+#include "profiler.h"
+
+// a and b mixed with weight 0 to 256 on b; red and blue share one multiplication, green takes another
+static inline uint32_t blend(uint32_t a, uint32_t b, int weight)
+{
+    uint32_t rb = ((a & 0xff00ff) * (256 - weight) + (b & 0xff00ff) * weight) >> 8;
+    uint32_t g = ((a & 0xff00) * (256 - weight) + (b & 0xff00) * weight) >> 8;
+    return (rb & 0xff00ff) | (g & 0xff00);
+}
+
+// The source pixel under the centre of target pixel i, in 1/256 of a pixel, from the centre of pixel 0
+static inline int sourcePosition(int i, int sourceSize, int targetSize)
+{
+    return (int)(((2 * (int64_t)i + 1) * sourceSize * 256) / (2 * (int64_t)targetSize)) - 128;
+}
+
+FrameScaler::FrameScaler()
+{
+    mode = SCALE_BILINEAR;
+    source = NULL;
+    target = NULL;
+    sourceWidth = 0;
+    targetWidth = 0;
+}
+
+void FrameScaler::scale(const FrameBuffer &source, FrameBuffer &target, ThreadPool *pool)
+{
+    int x;
+    PROFILE_STAGE(STAGE_PRESENT);
+
+    if (source.width <= 0 || source.height <= 0 || target.width <= 0 || target.height <= 0) return;
+
+    if (source.width != sourceWidth || target.width != targetWidth) {
+        sourceWidth = source.width;
+        targetWidth = target.width;
+        columns.resize(targetWidth);
+        weights.resize(targetWidth);
+        for (x=0; x<targetWidth; x++) {
+            int position = std::max(0, sourcePosition(x, sourceWidth, targetWidth));
+            columns[x] = position >> 8;
+            weights[x] = position & 255;
+            if (columns[x] >= sourceWidth - 1 && sourceWidth > 1) {             // blend towards the last column in full
+                columns[x] = sourceWidth - 2;
+                weights[x] = 256;
+            }
+            else if (columns[x] >= sourceWidth - 1) {                           // one column, its right one weighs nothing
+                columns[x] = 0;
+                weights[x] = 0;
+            }
+        }
+    }
+
+    this->source = &source;
+    this->target = &target;
+    int bands = (target.height + SCALE_BAND - 1) / SCALE_BAND;
+    if (pool) {
+        pool->parallelFor(bands, [this](int band) {
+            scaleRows(band * SCALE_BAND, std::min((band + 1) * SCALE_BAND, this->target->height));
+        });
+    }
+    else {
+        scaleRows(0, target.height);
+    }
+}
+
+// Rows y0 to y1 of the target. A source column has padding up to a cache line behind it, so reading one pixel past
+// the last column, with no weight, stays within the row.
+void FrameScaler::scaleRows(int y0, int y1)
+{
+    const int *column = columns.data();
+    const int *weight = weights.data();
+    int x, y;
+
+    for (y=y0; y<y1; y++) {
+        uint32_t *out = target->color + y * target->stride;
+
+        if (source->width == target->width && source->height == target->height) {
+            memcpy(out, source->color + y * source->stride, target->width * sizeof(uint32_t));
+            continue;
+        }
+
+        int position = std::max(0, sourcePosition(y, source->height, target->height));
+        int row = std::min(position >> 8, source->height - 1);
+        int rowWeight = position & 255;
+        const uint32_t *top = source->color + row * source->stride;
+
+        if (mode == SCALE_NEAREST) {
+            if (rowWeight >= 128 && row + 1 < source->height) top += source->stride;
+            for (x=0; x<target->width; x++) {
+                out[x] = top[column[x] + (weight[x] >= 128)];
+            }
+            continue;
+        }
+
+        const uint32_t *bottom = row + 1 < source->height ? top + source->stride : top;
+        for (x=0; x<target->width; x++) {
+            int c = column[x];
+            uint32_t upper = blend(top[c], top[c + 1], weight[x]);
+            uint32_t lower = blend(bottom[c], bottom[c + 1], weight[x]);
+            out[x] = blend(upper, lower, rowWeight) | 0xff000000;
+        }
+    }
+}
+
+DynamicResolution::DynamicResolution(int width, int height, double budget)
+{
+    fullWidth = width;
+    fullHeight = height;
+    frameBudget = budget;
+    minScale = RESOLUTION_MIN_SCALE;
+    maxScale = 1.0f;
+    currentScale = 1.0f;
+    average = 0.0;
+    underBudget = 0;
+}
+
+void DynamicResolution::setScaleRange(float minScale, float maxScale)
+{
+    this->minScale = std::max(RESOLUTION_STEP, std::min(minScale, maxScale));
+    this->maxScale = std::max(this->minScale, maxScale);
+    currentScale = std::max(this->minScale, std::min(currentScale, this->maxScale));
+}
+
+void DynamicResolution::addFrame(double milliseconds)
+{
+    float next = currentScale;
+
+    if (milliseconds <= 0.0 || frameBudget <= 0.0) return;
+    average = average > 0.0 ? average + (milliseconds - average) * 0.25 : milliseconds;
+
+    if (milliseconds > frameBudget * RESOLUTION_SPIKE) {                        // do not wait for the average
+        next = currentScale * (float)sqrt(frameBudget / milliseconds);
+        average = std::max(average, milliseconds);
+        underBudget = 0;
+    }
+    else if (average > frameBudget) {
+        next = currentScale * (float)sqrt(frameBudget / average);
+        underBudget = 0;
+    }
+    else if (average < frameBudget * RESOLUTION_HEADROOM) {
+        if (++underBudget >= RESOLUTION_SETTLE) {                               // aim at the headroom, not the budget
+            next = currentScale * (float)sqrt(frameBudget * RESOLUTION_HEADROOM / average);
+        }
+    }
+    else {
+        underBudget = 0;
+    }
+
+    next = floorf(next / RESOLUTION_STEP) * RESOLUTION_STEP;                    // rounded down either way
+    next = std::max(minScale, std::min(next, maxScale));
+    if (next != currentScale) {
+        average *= (double)(next * next) / (currentScale * currentScale);       // what the new size should take
+        currentScale = next;
+        underBudget = 0;
+    }
+}
+
+int DynamicResolution::width() const
+{
+    return std::max(1, (int)(fullWidth * currentScale + 0.5f));
+}
+
+int DynamicResolution::height() const
+{
+    return std::max(1, (int)(fullHeight * currentScale + 0.5f));
+}
@@ -0,0 +1,76 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <stdint.h>
+#include <vector>
+#include "framebuffer.h"
+#include "threadpool.h"
+
+#define RESOLUTION_MIN_SCALE    0.5f                                            // of the width and the height, by default
+#define RESOLUTION_STEP         (1.0f / 32)                                     // the scales chosen are multiples of this
+#define RESOLUTION_SPIKE        1.25                                            // a frame this far over budget cuts at once
+#define RESOLUTION_HEADROOM     0.85                                            // under this share of the budget ...
+#define RESOLUTION_SETTLE       15                                              // ... for this many frames goes up again
+#define SCALE_BAND              16                                              // rows scaled by one task
+
+enum TScaleFilter {
+    SCALE_NEAREST,
+    SCALE_BILINEAR
+};
+
+// Stretches a frame over another of any size. The source column and weight of every target column are worked out
+// once for a pair of widths and kept, bands of rows are scaled on the thread pool when given one. Bilinear filtering
+// blends the four nearest pixels with 8-bit weights, two channels at a time in one 32-bit word.
+class FrameScaler
+{
+public:
+    FrameScaler();
+
+    TScaleFilter filter() const { return mode; }
+    void setFilter(TScaleFilter filter) { mode = filter; }
+    void scale(const FrameBuffer &source, FrameBuffer &target, ThreadPool *pool = NULL);
+
+private:
+    TScaleFilter mode;
+    const FrameBuffer *source;                                                  // of the current scale()
+    FrameBuffer *target;
+    int sourceWidth;                                                            // the tables below are for these widths
+    int targetWidth;
+    std::vector<int> columns;                                                   // left source column of a target column
+    std::vector<int> weights;                                                   // of the column right of it, 0 to 256
+
+    void scaleRows(int y0, int y1);
+};
+
+// Picks the resolution to render at from the time the frames take, to keep them within a budget. Time is taken to
+// follow the number of pixels, so the scale of the width and height moves with the square root of the ratio between
+// the budget and the time measured. A frame more than RESOLUTION_SPIKE over the budget lowers the resolution for the
+// next frame straight away; otherwise the resolution follows a running average, going down as soon as that is over
+// the budget and up only once it has stayed under RESOLUTION_HEADROOM of it for RESOLUTION_SETTLE frames, so it does
+// not swing back and forth. The frames are drawn at width() x height() and stretched to the full size when presented.
+class DynamicResolution
+{
+public:
+    DynamicResolution(int width, int height, double budget);                    // the full size, milliseconds per frame
+
+    double budget() const { return frameBudget; }
+    void setBudget(double milliseconds) { frameBudget = milliseconds; }
+    void setScaleRange(float minScale, float maxScale = 1.0f);
+
+    void addFrame(double milliseconds);                                         // the last frame, sets the next scale
+    float scale() const { return currentScale; }
+    int width() const;
+    int height() const;
+
+private:
+    int fullWidth;
+    int fullHeight;
+    double frameBudget;
+    float minScale;
+    float maxScale;
+    float currentScale;
+    double average;                                                             // milliseconds, at the current scale
+    int underBudget;                                                            // frames in a row under the headroom
+};
+
+#endif // DYNAMICRESOLUTION_H
@@ -0,0 +1,968 @@
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include "alignedmemory.h"
+#include "edgerasterizer.h"
+#include "profiler.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define EDGE_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(EDGE_X86) && defined(__GNUC__)
+#define TARGET_AVX2     __attribute__((target("avx2")))
+#define TARGET_AVX512   __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// For the helpers of the kernels: inlined, they are compiled for the instruction set of the kernel. A call into SSE
+// code while the upper halves of the AVX registers are in use would cost a state transition every time.
+#if defined(__GNUC__)
+#define KERNEL_INLINE   inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define KERNEL_INLINE   __forceinline
+#else
+#define KERNEL_INLINE   inline
+#endif
+
+#define SUBPIXEL_BITS   4                                                       // 28.4 fixed point
+#define SUBPIXEL_ONE    (1 << SUBPIXEL_BITS)
+
+struct TEdgeSetup {
+    int x0;                                                                     // first column, aligned down to 16 pixels
+    int x1;                                                                     // last column + 1
+    int y0;
+    int y1;
+    int clipX0;                                                                 // first column that may be written
+    int e[3];                                                                   // edge values at (x0, y0), >= 0 inside
+    int stepX[3];                                                               // edge value change per column
+    int stepY[3];                                                               // edge value change per row
+    float z, u, v, q;                                                           // attributes at (x0, y0)
+    float dZdX, dZdY;
+    float dUdX, dUdY;                                                           // u and v are in texels (times q in perspective)
+    float dVdX, dVdY;
+    float dQdX, dQdY;                                                           // q = 1/w, in perspective only
+    int span;                                                                   // perspectiveSpan(), 0 - affine
+    const TMipLevel *level;                                                     // the mipmap level picked, NULL - untextured
+    QRgb color;                                                                 // of an untextured triangle
+};
+
+template <TWrapMode Mode, bool Pow2, TTextureFormat Format>
+inline QRgb fetchTexel(const TEdgeSetup &s, int u, int v)
+{
+    const TMipLevel &l = *s.level;
+    return readTexel<Format>(l, l.xOffset[wrapCoord<Mode, Pow2>(u, l.width)] + l.yOffset[wrapCoord<Mode, Pow2>(v, l.height)]);
+}
+
+static std::atomic<int> selectedLevel(-1);
+
+#define EDGE_VALUE_LIMIT    (1 << 30)                                           // leaves the kernels a step of headroom
+#define EDGE_MARGIN         (PERSPECTIVE_SPAN_MAX + 16)                         // columns around the clipped area looked at
+
+enum TSetupResult {
+    SETUP_EMPTY,                                                                // nothing to draw
+    SETUP_READY,
+    SETUP_OVERFLOW                                                              // the planes are right, the edge values are not
+};
+
+// Builds the edge equations and the attribute planes of a triangle within clip.
+//
+// The edge values are worked out in 64 bits at the first column and row drawn. The kernels only step them over the
+// clipped area (a tile in the renderer), so they only have to fit in 32 bits there: at the corners of the area, with
+// EDGE_MARGIN columns around it for the last SIMD step and the perspective spans. An edge the whole area is inside of
+// is made constant, so a triangle much larger than the area - a piece in the guard band of a 4K viewport - still
+// gets exact values. SETUP_OVERFLOW is only left for an edge crossing the area whose steps are too large.
+static TSetupResult setupTriangle(const TTriangle &t, const TRect &clip, TEdgeSetup &s)
+{
+    int i;
+    const TVertex *v[3] = { &t.V1, &t.V2, &t.V3 };
+    bool overflow = false;
+
+    float minX = std::min(t.V1.x, std::min(t.V2.x, t.V3.x));
+    float maxX = std::max(t.V1.x, std::max(t.V2.x, t.V3.x));
+    float minY = std::min(t.V1.y, std::min(t.V2.y, t.V3.y));
+    float maxY = std::max(t.V1.y, std::max(t.V2.y, t.V3.y));
+
+    // Positions are made relative to the corner of the bounding box, so the edge values only depend on the size of
+    // the triangle and not on where it is on the screen
+    int ox = (int)floorf(minX);
+    int oy = (int)floorf(minY);
+    int X[3], Y[3];
+    for (i=0; i<3; i++) {
+        X[i] = (int)lroundf((v[i]->x - ox) * SUBPIXEL_ONE);
+        Y[i] = (int)lroundf((v[i]->y - oy) * SUBPIXEL_ONE);
+    }
+
+    int64_t area = (int64_t)(X[1] - X[0]) * (Y[2] - Y[0]) - (int64_t)(Y[1] - Y[0]) * (X[2] - X[0]);
+    if (area == 0) return SETUP_EMPTY;                                          // degenerated to a line or a point
+    if (area < 0) {                                                             // make the inside of all edges positive
+        std::swap(v[1], v[2]);
+        std::swap(X[1], X[2]);
+        std::swap(Y[1], Y[2]);
+    }
+
+    int px0 = std::max((int)ceilf(minX), clip.x0);                              // samples sit at integer pixel positions
+    int px1 = std::min((int)floorf(maxX) + 1, clip.x1);
+    int py0 = std::max((int)ceilf(minY), clip.y0);
+    int py1 = std::min((int)floorf(maxY) + 1, clip.y1);
+    if (px0 >= px1 || py0 >= py1) return SETUP_EMPTY;
+
+    s.x0 = px0 & ~15;
+    s.x1 = px1;
+    s.y0 = py0;
+    s.y1 = py1;
+    s.clipX0 = px0;
+
+    int64_t e[3], low[3], high[3];
+    int64_t left = -EDGE_MARGIN, right = ((s.x1 - s.x0 + 15) & ~15) + EDGE_MARGIN, bottom = s.y1 - s.y0;
+    int64_t sx = (int64_t)(s.x0 - ox) * SUBPIXEL_ONE;
+    int64_t sy = (int64_t)(s.y0 - oy) * SUBPIXEL_ONE;
+    for (i=0; i<3; i++) {
+        int j = (i + 1) % 3;
+        int64_t dx = X[j] - X[i];
+        int64_t dy = Y[j] - Y[i];
+        bool topLeft = (dy < 0) || (dy == 0 && dx > 0);                         // top and left edges own their pixels
+        e[i] = (dx * (sy - Y[i]) - dy * (sx - X[i]) + (topLeft ? 0 : -1));
+        e[i] >>= SUBPIXEL_BITS;                                                 // floor, the sign test stays exact
+        int64_t corners[4] = { e[i] - dy * left, e[i] - dy * right, e[i] - dy * left + dx * bottom,
+                               e[i] - dy * right + dx * bottom };
+        low[i] = *std::min_element(corners, corners + 4);
+        high[i] = *std::max_element(corners, corners + 4);
+        if (low[i] < -EDGE_VALUE_LIMIT || high[i] > EDGE_VALUE_LIMIT) overflow = true;
+        s.e[i] = (int)e[i];
+        s.stepX[i] = (int)-dy;
+        s.stepY[i] = (int)dx;
+    }
+    if (overflow) {                                                             // only for triangles far larger than clip
+        overflow = false;
+        for (i=0; i<3; i++) {
+            if (high[i] < 0) return SETUP_EMPTY;                                // the area is outside of this edge
+            if (low[i] >= 0) {
+                s.e[i] = EDGE_VALUE_LIMIT;                                      // and inside of this one
+                s.stepX[i] = 0;
+                s.stepY[i] = 0;
+            }
+            else if (low[i] < -EDGE_VALUE_LIMIT || high[i] > EDGE_VALUE_LIMIT) {
+                s.e[i] = EDGE_VALUE_LIMIT;                                      // a crossing edge with huge steps
+                s.stepX[i] = 0;
+                s.stepY[i] = 0;
+                overflow = true;
+            }
+        }
+    }
+
+    // Attribute planes a(x, y) = a + dAdX * x + dAdY * y, computed from the unsnapped positions
+    float x21 = v[1]->x - v[0]->x, y21 = v[1]->y - v[0]->y;
+    float x31 = v[2]->x - v[0]->x, y31 = v[2]->y - v[0]->y;
+    float det = x21 * y31 - x31 * y21;
+    if (det == 0.0f) return SETUP_EMPTY;
+    float invDet = 1.0f / det;
+    float fx = s.x0 - v[0]->x;
+    float fy = s.y0 - v[0]->y;
+
+    float uScale = t.texture ? t.texture->width - 1 : 0;
+    float vScale = t.texture ? t.texture->height - 1 : 0;
+    float a21, a31;
+
+    a21 = v[1]->z - v[0]->z;  a31 = v[2]->z - v[0]->z;
+    s.dZdX = (a21 * y31 - a31 * y21) * invDet;
+    s.dZdY = (a31 * x21 - a21 * x31) * invDet;
+    s.z = v[0]->z + s.dZdX * fx + s.dZdY * fy;
+
+    a21 = (v[1]->u - v[0]->u) * uScale;  a31 = (v[2]->u - v[0]->u) * uScale;
+    s.dUdX = (a21 * y31 - a31 * y21) * invDet;
+    s.dUdY = (a31 * x21 - a21 * x31) * invDet;
+    s.u = v[0]->u * uScale + s.dUdX * fx + s.dUdY * fy;
+
+    a21 = (v[1]->v - v[0]->v) * vScale;  a31 = (v[2]->v - v[0]->v) * vScale;
+    s.dVdX = (a21 * y31 - a31 * y21) * invDet;
+    s.dVdY = (a31 * x21 - a21 * x31) * invDet;
+    s.v = v[0]->v * vScale + s.dVdX * fx + s.dVdY * fy;
+
+    s.color = t.color;
+    s.level = NULL;
+    s.span = 0;
+    if (t.texture == NULL) return overflow ? SETUP_OVERFLOW : SETUP_READY;
+
+    // Pick the mipmap level from the affine planes, then make them planes of u*q and v*q in perspective - those and
+    // q = 1/w change linearly on the screen
+    int level = t.texture->selectLevel(s.dUdX, s.dVdX, s.dUdY, s.dVdY);
+    if (isPerspective(t)) {
+        s.span = perspectiveSpan();
+
+        a21 = v[1]->w - v[0]->w;  a31 = v[2]->w - v[0]->w;
+        s.dQdX = (a21 * y31 - a31 * y21) * invDet;
+        s.dQdY = (a31 * x21 - a21 * x31) * invDet;
+        s.q = v[0]->w + s.dQdX * fx + s.dQdY * fy;
+
+        a21 = (v[1]->u * v[1]->w - v[0]->u * v[0]->w) * uScale;  a31 = (v[2]->u * v[2]->w - v[0]->u * v[0]->w) * uScale;
+        s.dUdX = (a21 * y31 - a31 * y21) * invDet;
+        s.dUdY = (a31 * x21 - a21 * x31) * invDet;
+        s.u = v[0]->u * v[0]->w * uScale + s.dUdX * fx + s.dUdY * fy;
+
+        a21 = (v[1]->v * v[1]->w - v[0]->v * v[0]->w) * vScale;  a31 = (v[2]->v * v[2]->w - v[0]->v * v[0]->w) * vScale;
+        s.dVdX = (a21 * y31 - a31 * y21) * invDet;
+        s.dVdY = (a31 * x21 - a21 * x31) * invDet;
+        s.v = v[0]->v * v[0]->w * vScale + s.dVdX * fx + s.dVdY * fy;
+    }
+
+    // Rescale the u and v planes to the texels of the level
+    float levelScale = 1.0f / (1 << level);
+    s.u *= levelScale;  s.dUdX *= levelScale;  s.dUdY *= levelScale;
+    s.v *= levelScale;  s.dVdX *= levelScale;  s.dVdY *= levelScale;
+    s.level = &t.texture->levels[level];
+    return overflow ? SETUP_OVERFLOW : SETUP_READY;
+}
+
+// u and v along one row of a triangle drawn in perspective: divided by q at the ends of every span of s.span columns,
+// aligned to the screen and kept to the columns of the row inside the triangle, and linear in between. Every kernel
+// and resolveVisibility() take them from here, so all of them fetch the same texels.
+struct TPerspectiveRow {
+    int row;
+    int first;                                                                  // the columns inside the triangle
+    int last;
+    float u, v, q;                                                              // u*q, v*q and q at column x0
+    int start;                                                                  // the span held
+    int from;                                                                   // column su and sv are at
+    float su, sv, dU, dV;
+    int end;                                                                    // column eu and ev are at
+    float eu, ev;
+};
+
+static KERNEL_INLINE int floorDiv(int a, int b)                                        // b > 0
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static KERNEL_INLINE void beginPerspectiveRow(const TEdgeSetup &s, int row, TPerspectiveRow &p)
+{
+    int i;
+    int first = -EDGE_VALUE_LIMIT, last = EDGE_VALUE_LIMIT;                     // an edge made constant bounds nothing
+
+    for (i=0; i<3; i++) {                                                       // columns k with e + k * stepX >= 0
+        int e = s.e[i] + row * s.stepY[i];
+        if (s.stepX[i] > 0) first = std::max(first, -floorDiv(e, s.stepX[i]));
+        else if (s.stepX[i] < 0) last = std::min(last, floorDiv(e, -s.stepX[i]));
+        else if (e < 0) last = INT32_MIN;
+    }
+    if (last < first) last = first - 1;                                         // no column, nothing drawn in the row
+    p.row = row;
+    p.first = s.x0 + first;                                                     // a triangle has edges going either way
+    p.last = s.x0 + last;
+    p.u = s.u + row * s.dUdY;
+    p.v = s.v + row * s.dVdY;
+    p.q = s.q + row * s.dQdY;
+    p.start = s.x0 - 1;                                                         // not a multiple of the span
+    p.end = p.first - 1;
+}
+
+static KERNEL_INLINE void perspectiveAt(const TEdgeSetup &s, const TPerspectiveRow &p, int x, float &u, float &v)
+{
+    float fx = (float)(x - s.x0);
+    float w = 1.0f / (p.q + s.dQdX * fx);
+    u = (p.u + s.dUdX * fx) * w;
+    v = (p.v + s.dVdX * fx) * w;
+}
+
+// Makes p hold the span of column x
+static KERNEL_INLINE void loadPerspectiveSpan(const TEdgeSetup &s, TPerspectiveRow &p, int x)
+{
+    int start = x & -s.span;
+    if (start == p.start) return;
+
+    int a = std::max(start, p.first);
+    int b = std::min(start + s.span, p.last);
+    if (a == p.end) {                                                           // where the previous span ended
+        p.su = p.eu;
+        p.sv = p.ev;
+    }
+    else {
+        perspectiveAt(s, p, a, p.su, p.sv);
+    }
+    perspectiveAt(s, p, b, p.eu, p.ev);
+    float scale = (b > a) ? 1.0f / (b - a) : 0.0f;
+    p.dU = (p.eu - p.su) * scale;
+    p.dV = (p.ev - p.sv) * scale;
+    p.start = start;
+    p.from = a;
+    p.end = b;
+}
+
+template <unsigned Features, TWrapMode Mode, bool Pow2, TTextureFormat Format>
+static void rasterizeScalar(const TEdgeSetup &s, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer)
+{
+    int x, y;
+    TPerspectiveRow p = {};                                                     // set up row by row
+    PROFILE_ONLY(int tested = 0; int passed = 0;)
+
+    for (y=s.y0; y<s.y1; y++) {
+        int row = y - s.y0;
+        int e0 = s.e[0] + row * s.stepY[0];
+        int e1 = s.e[1] + row * s.stepY[1];
+        int e2 = s.e[2] + row * s.stepY[2];
+        float zRow = s.z + row * s.dZdY;
+        float uRow = s.u + row * s.dUdY;
+        float vRow = s.v + row * s.dVdY;
+        uint32_t *colorLine = frameBuffer->scanLine(y);
+        float *depthLine = depthBuffer->line(y);
+        bool wasInside = false;
+        if (Features & SPAN_PERSPECTIVE) beginPerspectiveRow(s, row, p);
+
+        for (x=s.x0; x<s.x1; x++, e0 += s.stepX[0], e1 += s.stepX[1], e2 += s.stepX[2]) {
+            if ((e0 | e1 | e2) < 0) {                                           // outside of at least one edge
+                if (wasInside) break;                                           // the triangle is convex - the row is done
+                continue;
+            }
+            wasInside = true;
+            if (x < s.clipX0) continue;
+            PROFILE_ONLY(tested++;)
+
+            float fx = (float)(x - s.x0);
+            float z = zRow + s.dZdX * fx;
+            if ((Features & SPAN_DEPTH_TEST) && !(depthLine[x] > z)) continue;
+            if (Features & SPAN_DEPTH_WRITE) depthLine[x] = z;
+            if (Features & SPAN_PERSPECTIVE) {
+                loadPerspectiveSpan(s, p, x);
+                float steps = (float)(x - p.from);
+                colorLine[x] = fetchTexel<Mode, Pow2, Format>(s, (int)(p.su + p.dU * steps), (int)(p.sv + p.dV * steps));
+            }
+            else if (Features & SPAN_TEXTURED) {
+                colorLine[x] = fetchTexel<Mode, Pow2, Format>(s, (int)(uRow + s.dUdX * fx), (int)(vRow + s.dVdX * fx));
+            }
+            else {
+                colorLine[x] = s.color;
+            }
+            PROFILE_ONLY(passed++;)
+        }
+    }
+
+    PROFILE_FRAGMENTS(tested, passed, Features & SPAN_TEXTURED);
+}
+
+#if defined(EDGE_X86)
+
+template <unsigned Features, TWrapMode Mode, bool Pow2, TTextureFormat Format>
+static void rasterizeSSE2(const TEdgeSetup &s, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer)
+{
+    int x, y, lane;
+    const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128i stepE0 = _mm_set1_epi32(s.stepX[0] * 4);
+    const __m128i stepE1 = _mm_set1_epi32(s.stepX[1] * 4);
+    const __m128i stepE2 = _mm_set1_epi32(s.stepX[2] * 4);
+    const __m128 dZdX = _mm_set1_ps(s.dZdX);
+    const __m128 dUdX = _mm_set1_ps(s.dUdX);
+    const __m128 dVdX = _mm_set1_ps(s.dVdX);
+    float zLanes[4];
+    int uLanes[4], vLanes[4];
+    TPerspectiveRow p = {};                                                     // set up row by row
+    PROFILE_ONLY(int tested = 0; int passed = 0;)
+
+    for (y=s.y0; y<s.y1; y++) {
+        int row = y - s.y0;
+        int e0 = s.e[0] + row * s.stepY[0];
+        int e1 = s.e[1] + row * s.stepY[1];
+        int e2 = s.e[2] + row * s.stepY[2];
+        __m128i E0 = _mm_add_epi32(_mm_set1_epi32(e0), _mm_setr_epi32(0, s.stepX[0], s.stepX[0] * 2, s.stepX[0] * 3));
+        __m128i E1 = _mm_add_epi32(_mm_set1_epi32(e1), _mm_setr_epi32(0, s.stepX[1], s.stepX[1] * 2, s.stepX[1] * 3));
+        __m128i E2 = _mm_add_epi32(_mm_set1_epi32(e2), _mm_setr_epi32(0, s.stepX[2], s.stepX[2] * 2, s.stepX[2] * 3));
+        __m128 zRow = _mm_set1_ps(s.z + row * s.dZdY);
+        __m128 uRow = _mm_set1_ps(s.u + row * s.dUdY);
+        __m128 vRow = _mm_set1_ps(s.v + row * s.dVdY);
+        uint32_t *colorLine = frameBuffer->scanLine(y);
+        float *depthLine = depthBuffer->line(y);
+        bool wasInside = false;
+        if (Features & SPAN_PERSPECTIVE) beginPerspectiveRow(s, row, p);
+
+        for (x=s.x0; x<s.x1; x+=4) {
+            // a lane is inside when none of its edge values has the sign bit set
+            int mask = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(_mm_or_si128(E0, E1), E2))) & 0xF;
+            E0 = _mm_add_epi32(E0, stepE0);
+            E1 = _mm_add_epi32(E1, stepE1);
+            E2 = _mm_add_epi32(E2, stepE2);
+            if (mask == 0) {
+                if (wasInside) break;
+                continue;
+            }
+            wasInside = true;
+            if (x < s.clipX0) mask &= 0xF << (s.clipX0 - x);
+            if (x + 4 > s.x1) mask &= 0xF >> (x + 4 - s.x1);
+            if (mask == 0) continue;
+            PROFILE_ONLY(tested += profilePopcount(mask);)
+
+            __m128 fx = _mm_add_ps(_mm_set1_ps((float)(x - s.x0)), laneOffsets);
+            __m128 z = _mm_add_ps(zRow, _mm_mul_ps(dZdX, fx));
+            if ((Features & SPAN_DEPTH_TEST) && mask == 0xF) {                  // the whole group is ours - test it at once
+                mask &= _mm_movemask_ps(_mm_cmplt_ps(z, _mm_load_ps(depthLine + x)));
+                if (mask == 0) continue;
+            }
+            _mm_storeu_ps(zLanes, z);
+            if (Features & SPAN_PERSPECTIVE) {                                  // the group is inside one span
+                loadPerspectiveSpan(s, p, x);
+                __m128 steps = _mm_add_ps(_mm_set1_ps((float)(x - p.from)), laneOffsets);
+                _mm_storeu_si128((__m128i *)uLanes, _mm_cvttps_epi32(_mm_add_ps(_mm_set1_ps(p.su), _mm_mul_ps(_mm_set1_ps(p.dU), steps))));
+                _mm_storeu_si128((__m128i *)vLanes, _mm_cvttps_epi32(_mm_add_ps(_mm_set1_ps(p.sv), _mm_mul_ps(_mm_set1_ps(p.dV), steps))));
+            }
+            else if (Features & SPAN_TEXTURED) {
+                _mm_storeu_si128((__m128i *)uLanes, _mm_cvttps_epi32(_mm_add_ps(uRow, _mm_mul_ps(dUdX, fx))));
+                _mm_storeu_si128((__m128i *)vLanes, _mm_cvttps_epi32(_mm_add_ps(vRow, _mm_mul_ps(dVdX, fx))));
+            }
+
+            for (lane=0; lane<4; lane++) {                                      // no gathers or masked stores in SSE2
+                if (!(mask & (1 << lane))) continue;
+                float *depth = depthLine + x + lane;
+                if ((Features & SPAN_DEPTH_TEST) && !(*depth > zLanes[lane])) continue;
+                if (Features & SPAN_DEPTH_WRITE) *depth = zLanes[lane];
+                QRgb texel = s.color;
+                if (Features & SPAN_TEXTURED) texel = fetchTexel<Mode, Pow2, Format>(s, uLanes[lane], vLanes[lane]);
+                colorLine[x + lane] = texel;
+                PROFILE_ONLY(passed++;)
+            }
+        }
+    }
+
+    PROFILE_FRAGMENTS(tested, passed, Features & SPAN_TEXTURED);
+}
+
+// Vector versions of wrapCoord(). Sizes that are not powers of two take the remainder through a float division,
+// which is exact for texel coordinates well below 2^24 once the quotient has been corrected by one.
+template <TWrapMode Mode, bool Pow2>
+TARGET_AVX2 static inline __m256i wrapAVX2(__m256i c, int size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi32(size - 1);
+
+    if (Mode == WRAP_CLAMP) {
+        return _mm256_min_epi32(_mm256_max_epi32(c, zero), limit);
+    }
+    if (Pow2) {
+        __m256i r = _mm256_and_si256(c, limit);
+        if (Mode == WRAP_REPEAT) return r;
+        __m256i even = _mm256_cmpeq_epi32(_mm256_and_si256(c, _mm256_set1_epi32(size)), zero);
+        return _mm256_xor_si256(r, _mm256_andnot_si256(even, limit));
+    }
+
+    int period = (Mode == WRAP_REPEAT) ? size : 2 * size;
+    const __m256i periodV = _mm256_set1_epi32(period);
+    __m256 q = _mm256_floor_ps(_mm256_div_ps(_mm256_cvtepi32_ps(c), _mm256_set1_ps((float)period)));
+    __m256i r = _mm256_sub_epi32(c, _mm256_mullo_epi32(_mm256_cvtps_epi32(q), periodV));
+    r = _mm256_add_epi32(r, _mm256_and_si256(_mm256_cmpgt_epi32(zero, r), periodV));
+    r = _mm256_sub_epi32(r, _mm256_andnot_si256(_mm256_cmpgt_epi32(periodV, r), periodV));
+    if (Mode == WRAP_REPEAT) return r;
+    return _mm256_min_epi32(r, _mm256_sub_epi32(_mm256_set1_epi32(period - 1), r));
+}
+
+// GCC 12 warns about the self-initialized __Y in avx512fintrin.h once its intrinsics are inlined (GCC bug 105593)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+
+template <TWrapMode Mode, bool Pow2>
+TARGET_AVX512 static inline __m512i wrapAVX512(__m512i c, int size)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i limit = _mm512_set1_epi32(size - 1);
+
+    if (Mode == WRAP_CLAMP) {
+        return _mm512_min_epi32(_mm512_max_epi32(c, zero), limit);
+    }
+    if (Pow2) {
+        __m512i r = _mm512_and_si512(c, limit);
+        if (Mode == WRAP_REPEAT) return r;
+        __mmask16 odd = _mm512_test_epi32_mask(c, _mm512_set1_epi32(size));
+        return _mm512_mask_xor_epi32(r, odd, r, limit);
+    }
+
+    int period = (Mode == WRAP_REPEAT) ? size : 2 * size;
+    const __m512i periodV = _mm512_set1_epi32(period);
+    __m512 q = _mm512_roundscale_ps(_mm512_div_ps(_mm512_cvtepi32_ps(c), _mm512_set1_ps((float)period)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __m512i r = _mm512_sub_epi32(c, _mm512_mullo_epi32(_mm512_cvtps_epi32(q), periodV));
+    r = _mm512_mask_add_epi32(r, _mm512_cmplt_epi32_mask(r, zero), r, periodV);
+    r = _mm512_mask_sub_epi32(r, _mm512_cmpge_epi32_mask(r, periodV), r, periodV);
+    if (Mode == WRAP_REPEAT) return r;
+    return _mm512_min_epi32(r, _mm512_sub_epi32(_mm512_set1_epi32(period - 1), r));
+}
+
+// Vector versions of readTexel(). The 8 and 16-bit formats gather 32 bits at the byte or halfword of every texel (the
+// levels are followed by some slack for that) and keep the low bits; BC1 blocks are decoded lane by lane.
+template <TTextureFormat Format>
+TARGET_AVX2 static inline __m256i readTexelsAVX2(const TMipLevel *level, __m256i offset, __m256i mask)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int lane;
+
+    if (Format == TEXTURE_RGB32) {
+        return _mm256_mask_i32gather_epi32(zero, (const int *)level->data, offset, mask, 4);
+    }
+    if (Format == TEXTURE_INDEXED8) {
+        __m256i index = _mm256_and_si256(_mm256_mask_i32gather_epi32(zero, (const int *)level->packed, offset, mask, 1),
+                                         _mm256_set1_epi32(0xff));
+        return _mm256_mask_i32gather_epi32(zero, (const int *)level->palette, index, mask, 4);
+    }
+    if (Format == TEXTURE_RGB565 || Format == TEXTURE_RGB555) {
+        __m256i c = _mm256_mask_i32gather_epi32(zero, (const int *)level->packed, offset, mask, 2);
+        __m256i five = _mm256_set1_epi32(31);
+        __m256i r, g, b = _mm256_and_si256(c, five);
+        if (Format == TEXTURE_RGB565) {
+            r = _mm256_and_si256(_mm256_srli_epi32(c, 11), five);
+            g = _mm256_and_si256(_mm256_srli_epi32(c, 5), _mm256_set1_epi32(63));
+            g = _mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4));
+        }
+        else {
+            r = _mm256_and_si256(_mm256_srli_epi32(c, 10), five);
+            g = _mm256_and_si256(_mm256_srli_epi32(c, 5), five);
+            g = _mm256_or_si256(_mm256_slli_epi32(g, 3), _mm256_srli_epi32(g, 2));
+        }
+        r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+        b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+        return _mm256_or_si256(_mm256_set1_epi32((int)0xff000000),
+                               _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_or_si256(_mm256_slli_epi32(g, 8), b)));
+    }
+
+    uint32_t offsets[8], texels[8];
+    int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+    _mm256_storeu_si256((__m256i *)offsets, offset);
+    for (lane=0; lane<8; lane++) {
+        texels[lane] = (lanes & (1 << lane)) ? readTexel<Format>(*level, offsets[lane]) : 0;
+    }
+    return _mm256_loadu_si256((const __m256i *)texels);
+}
+
+template <TTextureFormat Format>
+TARGET_AVX512 static inline __m512i readTexelsAVX512(const TMipLevel *level, __m512i offset, __mmask16 mask)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    int lane;
+
+    if (Format == TEXTURE_RGB32) {
+        return _mm512_mask_i32gather_epi32(zero, mask, offset, level->data, 4);
+    }
+    if (Format == TEXTURE_INDEXED8) {
+        __m512i index = _mm512_and_si512(_mm512_mask_i32gather_epi32(zero, mask, offset, level->packed, 1),
+                                         _mm512_set1_epi32(0xff));
+        return _mm512_mask_i32gather_epi32(zero, mask, index, level->palette, 4);
+    }
+    if (Format == TEXTURE_RGB565 || Format == TEXTURE_RGB555) {
+        __m512i c = _mm512_mask_i32gather_epi32(zero, mask, offset, level->packed, 2);
+        __m512i five = _mm512_set1_epi32(31);
+        __m512i r, g, b = _mm512_and_si512(c, five);
+        if (Format == TEXTURE_RGB565) {
+            r = _mm512_and_si512(_mm512_srli_epi32(c, 11), five);
+            g = _mm512_and_si512(_mm512_srli_epi32(c, 5), _mm512_set1_epi32(63));
+            g = _mm512_or_si512(_mm512_slli_epi32(g, 2), _mm512_srli_epi32(g, 4));
+        }
+        else {
+            r = _mm512_and_si512(_mm512_srli_epi32(c, 10), five);
+            g = _mm512_and_si512(_mm512_srli_epi32(c, 5), five);
+            g = _mm512_or_si512(_mm512_slli_epi32(g, 3), _mm512_srli_epi32(g, 2));
+        }
+        r = _mm512_or_si512(_mm512_slli_epi32(r, 3), _mm512_srli_epi32(r, 2));
+        b = _mm512_or_si512(_mm512_slli_epi32(b, 3), _mm512_srli_epi32(b, 2));
+        return _mm512_or_si512(_mm512_set1_epi32((int)0xff000000),
+                               _mm512_or_si512(_mm512_slli_epi32(r, 16), _mm512_or_si512(_mm512_slli_epi32(g, 8), b)));
+    }
+
+    uint32_t offsets[16], texels[16];
+    _mm512_storeu_si512(offsets, offset);
+    for (lane=0; lane<16; lane++) {
+        texels[lane] = (mask & (1 << lane)) ? readTexel<Format>(*level, offsets[lane]) : 0;
+    }
+    return _mm512_loadu_si512(texels);
+}
+
+template <unsigned Features, TWrapMode Mode, bool Pow2, TTextureFormat Format>
+TARGET_AVX2 static void rasterizeAVX2(const TEdgeSetup &s, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer)
+{
+    int x, y;
+    const __m256i laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 laneOffsets = _mm256_cvtepi32_ps(laneIndices);
+    const __m256i stepE0 = _mm256_set1_epi32(s.stepX[0] * 8);
+    const __m256i stepE1 = _mm256_set1_epi32(s.stepX[1] * 8);
+    const __m256i stepE2 = _mm256_set1_epi32(s.stepX[2] * 8);
+    const __m256 dZdX = _mm256_set1_ps(s.dZdX);
+    const __m256 dUdX = _mm256_set1_ps(s.dUdX);
+    const __m256 dVdX = _mm256_set1_ps(s.dVdX);
+    const __m256i clipX0 = _mm256_set1_epi32(s.clipX0 - 1);
+    const __m256i clipX1 = _mm256_set1_epi32(s.x1);
+    const __m256i zero = _mm256_setzero_si256();
+    const TMipLevel *level = s.level;
+    TPerspectiveRow p = {};                                                     // set up row by row
+    PROFILE_ONLY(int tested = 0; int passed = 0;)
+
+    for (y=s.y0; y<s.y1; y++) {
+        int row = y - s.y0;
+        __m256i E0 = _mm256_add_epi32(_mm256_set1_epi32(s.e[0] + row * s.stepY[0]), _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(s.stepX[0])));
+        __m256i E1 = _mm256_add_epi32(_mm256_set1_epi32(s.e[1] + row * s.stepY[1]), _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(s.stepX[1])));
+        __m256i E2 = _mm256_add_epi32(_mm256_set1_epi32(s.e[2] + row * s.stepY[2]), _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(s.stepX[2])));
+        __m256 zRow = _mm256_set1_ps(s.z + row * s.dZdY);
+        __m256 uRow = _mm256_set1_ps(s.u + row * s.dUdY);
+        __m256 vRow = _mm256_set1_ps(s.v + row * s.dVdY);
+        uint32_t *colorLine = frameBuffer->scanLine(y);
+        float *depthLine = depthBuffer->line(y);
+        bool wasInside = false;
+        if (Features & SPAN_PERSPECTIVE) beginPerspectiveRow(s, row, p);
+
+        for (x=s.x0; x<s.x1; x+=8) {
+            __m256i outside = _mm256_srai_epi32(_mm256_or_si256(_mm256_or_si256(E0, E1), E2), 31);
+            E0 = _mm256_add_epi32(E0, stepE0);
+            E1 = _mm256_add_epi32(E1, stepE1);
+            E2 = _mm256_add_epi32(E2, stepE2);
+            if (_mm256_movemask_epi8(outside) == -1) {
+                if (wasInside) break;
+                continue;
+            }
+            wasInside = true;
+
+            __m256i columns = _mm256_add_epi32(_mm256_set1_epi32(x), laneIndices);
+            __m256i mask = _mm256_andnot_si256(outside, _mm256_and_si256(_mm256_cmpgt_epi32(columns, clipX0),
+                                                                          _mm256_cmpgt_epi32(clipX1, columns)));
+            PROFILE_ONLY(tested += profilePopcount(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));)
+            __m256 fx = _mm256_add_ps(_mm256_set1_ps((float)(x - s.x0)), laneOffsets);
+            __m256 z = _mm256_add_ps(zRow, _mm256_mul_ps(dZdX, fx));
+            if (Features & SPAN_DEPTH_TEST) {
+                __m256 depth = _mm256_maskload_ps(depthLine + x, mask);
+                mask = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(z, depth, _CMP_LT_OQ)));
+            }
+            if (_mm256_testz_si256(mask, mask)) continue;
+            PROFILE_ONLY(passed += profilePopcount(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));)
+
+            __m256i texel = _mm256_set1_epi32((int)s.color);
+            if (Features & SPAN_TEXTURED) {
+                __m256i u, v;
+                if (Features & SPAN_PERSPECTIVE) {                              // the group is inside one span
+                    loadPerspectiveSpan(s, p, x);
+                    __m256 steps = _mm256_add_ps(_mm256_set1_ps((float)(x - p.from)), laneOffsets);
+                    u = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_set1_ps(p.su), _mm256_mul_ps(_mm256_set1_ps(p.dU), steps)));
+                    v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_set1_ps(p.sv), _mm256_mul_ps(_mm256_set1_ps(p.dV), steps)));
+                }
+                else {
+                    u = _mm256_cvttps_epi32(_mm256_add_ps(uRow, _mm256_mul_ps(dUdX, fx)));
+                    v = _mm256_cvttps_epi32(_mm256_add_ps(vRow, _mm256_mul_ps(dVdX, fx)));
+                }
+                u = wrapAVX2<Mode, Pow2>(u, level->width);
+                v = wrapAVX2<Mode, Pow2>(v, level->height);
+                __m256i offset = _mm256_add_epi32(_mm256_mask_i32gather_epi32(zero, (const int *)level->xOffset, u, mask, 4),
+                                                  _mm256_mask_i32gather_epi32(zero, (const int *)level->yOffset, v, mask, 4));
+                texel = readTexelsAVX2<Format>(level, offset, mask);
+            }
+
+            if (Features & SPAN_DEPTH_WRITE) _mm256_maskstore_ps(depthLine + x, mask, z);
+            _mm256_maskstore_epi32((int *)colorLine + x, mask, texel);
+        }
+    }
+
+    PROFILE_FRAGMENTS(tested, passed, Features & SPAN_TEXTURED);
+}
+
+template <unsigned Features, TWrapMode Mode, bool Pow2, TTextureFormat Format>
+TARGET_AVX512 static void rasterizeAVX512(const TEdgeSetup &s, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer)
+{
+    int x, y;
+    const __m512i laneIndices = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 laneOffsets = _mm512_cvtepi32_ps(laneIndices);
+    const __m512i stepE0 = _mm512_set1_epi32(s.stepX[0] * 16);
+    const __m512i stepE1 = _mm512_set1_epi32(s.stepX[1] * 16);
+    const __m512i stepE2 = _mm512_set1_epi32(s.stepX[2] * 16);
+    const __m512 dZdX = _mm512_set1_ps(s.dZdX);
+    const __m512 dUdX = _mm512_set1_ps(s.dUdX);
+    const __m512 dVdX = _mm512_set1_ps(s.dVdX);
+    const __m512i clipX0 = _mm512_set1_epi32(s.clipX0);
+    const __m512i clipX1 = _mm512_set1_epi32(s.x1);
+    const __m512i zero = _mm512_setzero_si512();
+    const TMipLevel *level = s.level;
+    TPerspectiveRow p = {};                                                     // set up row by row
+    PROFILE_ONLY(int tested = 0; int passed = 0;)
+
+    for (y=s.y0; y<s.y1; y++) {
+        int row = y - s.y0;
+        __m512i E0 = _mm512_add_epi32(_mm512_set1_epi32(s.e[0] + row * s.stepY[0]), _mm512_mullo_epi32(laneIndices, _mm512_set1_epi32(s.stepX[0])));
+        __m512i E1 = _mm512_add_epi32(_mm512_set1_epi32(s.e[1] + row * s.stepY[1]), _mm512_mullo_epi32(laneIndices, _mm512_set1_epi32(s.stepX[1])));
+        __m512i E2 = _mm512_add_epi32(_mm512_set1_epi32(s.e[2] + row * s.stepY[2]), _mm512_mullo_epi32(laneIndices, _mm512_set1_epi32(s.stepX[2])));
+        __m512 zRow = _mm512_set1_ps(s.z + row * s.dZdY);
+        __m512 uRow = _mm512_set1_ps(s.u + row * s.dUdY);
+        __m512 vRow = _mm512_set1_ps(s.v + row * s.dVdY);
+        uint32_t *colorLine = frameBuffer->scanLine(y);
+        float *depthLine = depthBuffer->line(y);
+        bool wasInside = false;
+        if (Features & SPAN_PERSPECTIVE) beginPerspectiveRow(s, row, p);
+
+        for (x=s.x0; x<s.x1; x+=16) {
+            __mmask16 inside = _mm512_cmpge_epi32_mask(_mm512_or_si512(_mm512_or_si512(E0, E1), E2), zero);
+            E0 = _mm512_add_epi32(E0, stepE0);
+            E1 = _mm512_add_epi32(E1, stepE1);
+            E2 = _mm512_add_epi32(E2, stepE2);
+            if (inside == 0) {
+                if (wasInside) break;
+                continue;
+            }
+            wasInside = true;
+
+            __m512i columns = _mm512_add_epi32(_mm512_set1_epi32(x), laneIndices);
+            __mmask16 mask = inside & _mm512_cmpge_epi32_mask(columns, clipX0) & _mm512_cmplt_epi32_mask(columns, clipX1);
+            PROFILE_ONLY(tested += profilePopcount(mask);)
+            __m512 fx = _mm512_add_ps(_mm512_set1_ps((float)(x - s.x0)), laneOffsets);
+            __m512 z = _mm512_add_ps(zRow, _mm512_mul_ps(dZdX, fx));
+            if (Features & SPAN_DEPTH_TEST) {
+                __m512 depth = _mm512_mask_loadu_ps(z, mask, depthLine + x);
+                mask = _mm512_mask_cmp_ps_mask(mask, z, depth, _CMP_LT_OQ);
+            }
+            if (mask == 0) continue;
+            PROFILE_ONLY(passed += profilePopcount(mask);)
+
+            __m512i texel = _mm512_set1_epi32((int)s.color);
+            if (Features & SPAN_TEXTURED) {
+                __m512i u, v;
+                if (Features & SPAN_PERSPECTIVE) {
+                    loadPerspectiveSpan(s, p, x);
+                    __m512 steps = _mm512_add_ps(_mm512_set1_ps((float)(x - p.from)), laneOffsets);
+                    __m512 su = _mm512_set1_ps(p.su), sv = _mm512_set1_ps(p.sv);
+                    __m512 dU = _mm512_set1_ps(p.dU), dV = _mm512_set1_ps(p.dV);
+                    if (s.span < 16) {                                          // the upper half is in the next span
+                        loadPerspectiveSpan(s, p, x + 8);
+                        steps = _mm512_mask_add_ps(steps, 0xFF00, _mm512_set1_ps((float)(x - p.from)), laneOffsets);
+                        su = _mm512_mask_mov_ps(su, 0xFF00, _mm512_set1_ps(p.su));
+                        sv = _mm512_mask_mov_ps(sv, 0xFF00, _mm512_set1_ps(p.sv));
+                        dU = _mm512_mask_mov_ps(dU, 0xFF00, _mm512_set1_ps(p.dU));
+                        dV = _mm512_mask_mov_ps(dV, 0xFF00, _mm512_set1_ps(p.dV));
+                    }
+                    u = _mm512_cvttps_epi32(_mm512_add_ps(su, _mm512_mul_ps(dU, steps)));
+                    v = _mm512_cvttps_epi32(_mm512_add_ps(sv, _mm512_mul_ps(dV, steps)));
+                }
+                else {
+                    u = _mm512_cvttps_epi32(_mm512_add_ps(uRow, _mm512_mul_ps(dUdX, fx)));
+                    v = _mm512_cvttps_epi32(_mm512_add_ps(vRow, _mm512_mul_ps(dVdX, fx)));
+                }
+                u = wrapAVX512<Mode, Pow2>(u, level->width);
+                v = wrapAVX512<Mode, Pow2>(v, level->height);
+                __m512i offset = _mm512_add_epi32(_mm512_mask_i32gather_epi32(zero, mask, u, level->xOffset, 4),
+                                                  _mm512_mask_i32gather_epi32(zero, mask, v, level->yOffset, 4));
+                texel = readTexelsAVX512<Format>(level, offset, mask);
+            }
+
+            if (Features & SPAN_DEPTH_WRITE) _mm512_mask_storeu_ps(depthLine + x, mask, z);
+            _mm512_mask_storeu_epi32(colorLine + x, mask, texel);
+        }
+    }
+
+    PROFILE_FRAGMENTS(tested, passed, Features & SPAN_TEXTURED);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // EDGE_X86
+
+TSimdLevel detectSimdLevel()
+{
+#if defined(EDGE_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    return SIMD_SSE2;
+#elif defined(EDGE_X86) && defined(_MSC_VER)
+    int info[4];
+    bool avx2, avx512;
+
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27))) return SIMD_SSE2;                               // the OS does not save the AVX registers
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;
+    avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6;
+    if (avx512) return SIMD_AVX512;
+    if (avx2) return SIMD_AVX2;
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+TSimdLevel edgeSimdLevel()
+{
+    int level = selectedLevel.load(std::memory_order_relaxed);
+
+    if (level < 0) {
+        level = detectSimdLevel();
+        selectedLevel.store(level, std::memory_order_relaxed);
+    }
+    return (TSimdLevel)level;
+}
+
+void setEdgeSimdLevel(TSimdLevel level)
+{
+    selectedLevel.store(std::min(level, detectSimdLevel()), std::memory_order_relaxed);
+}
+
+typedef void (*TEdgeKernel)(const TEdgeSetup &s, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer);
+
+static const TEdgeKernel scalarKernels[SPAN_VARIANTS][3][2][TEXTURE_FORMATS] = SPAN_TABLE(rasterizeScalar);
+#if defined(EDGE_X86)
+static const TEdgeKernel sse2Kernels[SPAN_VARIANTS][3][2][TEXTURE_FORMATS] = SPAN_TABLE(rasterizeSSE2);
+static const TEdgeKernel avx2Kernels[SPAN_VARIANTS][3][2][TEXTURE_FORMATS] = SPAN_TABLE(rasterizeAVX2);
+static const TEdgeKernel avx512Kernels[SPAN_VARIANTS][3][2][TEXTURE_FORMATS] = SPAN_TABLE(rasterizeAVX512);
+#endif
+
+static TEdgeKernel selectKernel(unsigned features, int wrap, bool pow2, int format)
+{
+    switch (edgeSimdLevel()) {
+#if defined(EDGE_X86)
+    case SIMD_AVX512:
+        return avx512Kernels[features][wrap][pow2][format];
+    case SIMD_AVX2:
+        return avx2Kernels[features][wrap][pow2][format];
+    case SIMD_SSE2:
+        return sse2Kernels[features][wrap][pow2][format];
+#endif
+    default:
+        return scalarKernels[features][wrap][pow2][format];
+    }
+}
+
+typedef QRgb (*TTexelFetch)(const TEdgeSetup &s, int u, int v);
+
+// [wrap mode][power of two][format], the same instantiations as the textured entries of SPAN_TABLE()
+#define FETCH_FORMATS(mode, pow2) { \
+    fetchTexel<mode, pow2, TEXTURE_RGB32>, fetchTexel<mode, pow2, TEXTURE_INDEXED8>, fetchTexel<mode, pow2, TEXTURE_RGB565>, \
+    fetchTexel<mode, pow2, TEXTURE_RGB555>, fetchTexel<mode, pow2, TEXTURE_BC1> }
+
+static const TTexelFetch texelFetches[3][2][TEXTURE_FORMATS] = {
+    { FETCH_FORMATS(WRAP_CLAMP, false), FETCH_FORMATS(WRAP_CLAMP, false) },
+    { FETCH_FORMATS(WRAP_REPEAT, false), FETCH_FORMATS(WRAP_REPEAT, true) },
+    { FETCH_FORMATS(WRAP_MIRROR, false), FETCH_FORMATS(WRAP_MIRROR, true) }
+};
+
+struct TResolveSetup {
+    TEdgeSetup setup;
+    TPerspectiveRow row;                                                        // the last row resolved, in perspective
+    TTexelFetch fetch;                                                          // NULL - untextured
+    bool ready;                                                                 // set up at its first pixel
+};
+
+// The same setup drawTriangleEdge() makes for the triangle in this rectangle, so u and v come out the same
+static void prepareResolve(const TTriangle &t, const TRect &rect, TResolveSetup &r)
+{
+    TRect bounds;
+    float minZ, maxZ;
+
+    r.ready = true;
+    r.fetch = NULL;
+    r.row.row = -1;
+    r.setup.color = t.color;
+    if (t.texture == NULL) return;
+
+    if (!triangleExtent(t, rect, bounds, minZ, maxZ) || setupTriangle(t, bounds, r.setup) == SETUP_EMPTY) {
+        // drawTriangle() covered pixels of a sliver that has no sample or no area here - it gets the texel at V1
+        TEdgeSetup &s = r.setup;
+        s.x0 = rect.x0;
+        s.y0 = rect.y0;
+        s.z = t.V1.z;
+        s.u = t.V1.u * (t.texture->width - 1);
+        s.v = t.V1.v * (t.texture->height - 1);
+        s.dZdX = s.dZdY = s.dUdX = s.dUdY = s.dVdX = s.dVdY = 0.0f;
+        s.span = 0;
+        s.level = &t.texture->levels[0];
+    }
+    r.fetch = texelFetches[t.texture->wrapMode][t.texture->isPow2][t.texture->format];
+}
+
+size_t resolveScratchBytes(int count)
+{
+    return (count * sizeof(TResolveSetup) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
+
+void resolveVisibility(const TTriangle *triangles, const int *indices, int count, FrameBuffer *frameBuffer,
+                       const TRect &rect, QRgb clearColor, void *scratch)
+{
+    TResolveSetup *setups = (TResolveSetup *)scratch;
+    int x, y, i;
+    PROFILE_ONLY(int fetched = 0;)
+
+    for (i=0; i<count; i++) setups[i].ready = false;
+
+    for (y=rect.y0; y<rect.y1; y++) {
+        uint32_t *colorLine = frameBuffer->scanLine(y);
+        for (x=rect.x0; x<rect.x1; x++) {
+            uint32_t id = colorLine[x];
+            if (id == VISIBILITY_EMPTY) {
+                colorLine[x] = clearColor;
+                continue;
+            }
+            TResolveSetup &r = setups[id - 1];
+            if (!r.ready) prepareResolve(triangles[indices[id - 1]], rect, r);
+            if (r.fetch == NULL) {
+                colorLine[x] = r.setup.color;
+                continue;
+            }
+
+            // the order of the operations of rasterizeScalar(), which every kernel matches
+            const TEdgeSetup &s = r.setup;
+            int row = y - s.y0;
+            if (s.span) {
+                TPerspectiveRow &p = r.row;
+                if (p.row != row) beginPerspectiveRow(s, row, p);
+                loadPerspectiveSpan(s, p, x);
+                float steps = (float)(x - p.from);
+                colorLine[x] = r.fetch(s, (int)(p.su + p.dU * steps), (int)(p.sv + p.dV * steps));
+                PROFILE_ONLY(fetched++;)
+                continue;
+            }
+            float fx = (float)(x - s.x0);
+            float uRow = s.u + row * s.dUdY;
+            float vRow = s.v + row * s.dVdY;
+            colorLine[x] = r.fetch(s, (int)(uRow + s.dUdX * fx), (int)(vRow + s.dVdX * fx));
+            PROFILE_ONLY(fetched++;)
+        }
+    }
+
+    PROFILE_COUNT(COUNTER_TEXELS_FETCHED, fetched);
+}
+
+void drawTriangleEdge(const TTriangle &t, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, const TRect &clip)
+{
+    TEdgeSetup setup;
+    TRect bounds;
+    float minZ, maxZ;
+
+    if (std::max(t.V1.x, std::max(t.V2.x, t.V3.x)) - std::min(t.V1.x, std::min(t.V2.x, t.V3.x)) > EDGE_MAX_EXTENT ||
+        std::max(t.V1.y, std::max(t.V2.y, t.V3.y)) - std::min(t.V1.y, std::min(t.V2.y, t.V3.y)) > EDGE_MAX_EXTENT) {
+        PROFILE_COUNT(COUNTER_TRIANGLES_FALLBACK, 1);
+        drawTriangle(t, frameBuffer, depthBuffer, clip);                        // too big for 28.4 positions
+        return;
+    }
+
+    PROFILE_STAGE(STAGE_SETUP);
+    if (!triangleExtent(t, clip, bounds, minZ, maxZ)) return;
+    bool depthTest = !(t.flags & DRAW_NO_DEPTH_TEST);
+    if (depthTest && depthBuffer->isOccluded(bounds, minZ)) {                   // hierarchical-Z rejection
+        PROFILE_COUNT(COUNTER_TRIANGLES_OCCLUDED, 1);
+        return;
+    }
+    TSetupResult result = setupTriangle(t, bounds, setup);
+    if (result == SETUP_EMPTY) return;
+    if (result == SETUP_OVERFLOW) {
+        PROFILE_COUNT(COUNTER_TRIANGLES_FALLBACK, 1);
+        drawTriangle(t, frameBuffer, depthBuffer, clip);
+        return;
+    }
+
+    depthBuffer->prepare(bounds);
+    unsigned features = spanFeatures(t, depthTest && depthBuffer->isInFront(bounds, maxZ));
+    int wrap = t.texture ? t.texture->wrapMode : WRAP_CLAMP;
+    int format = t.texture ? t.texture->format : TEXTURE_RGB32;
+    TEdgeKernel kernel = selectKernel(features, wrap, t.texture && t.texture->isPow2, format);
+
+    PROFILE_NEXT_STAGE(STAGE_SPANS);
+    PROFILE_COUNT(COUNTER_TRIANGLES_RASTERIZED, 1);
+    kernel(setup, frameBuffer, depthBuffer);
+
+    if (features & SPAN_DEPTH_WRITE) depthBuffer->update(bounds);
+}
@@ -0,0 +1,54 @@
+#ifndef EDGERASTERIZER_H
+#define EDGERASTERIZER_H
+
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "rasterizer.h"
+
+enum TRasterizerMode {
+    RASTERIZER_SCANLINE,                                                        // drawTriangle() - the scalar span walker
+    RASTERIZER_EDGE                                                             // drawTriangleEdge() - SIMD half-space rasterizer
+};
+
+enum TSimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,                                                                  //  4 pixels per step
+    SIMD_AVX2,                                                                  //  8 pixels per step
+    SIMD_AVX512                                                                 // 16 pixels per step
+};
+
+// Draws a triangle with fixed-point (28.4) edge functions, evaluated for a whole group of pixels at once.
+// The widest kernel supported by the CPU is picked on the first call (see setEdgeSimdLevel() to force a narrower one).
+//
+// The image matches drawTriangle() within the following tolerance:
+//   - coverage follows the same top-left fill rule with samples at integer pixel positions, but the edges are
+//     snapped to 1/16 of a pixel and drawTriangle() does not prestep its edges to the first row, so pixels along
+//     the edges of a triangle may flip in or out (well under 1% of the covered pixels for the cube),
+//   - depth, u and v are evaluated from plane equations instead of being accumulated along the edges and spans,
+//     so texel coordinates may differ by a texel or two and depth by a fraction of a unit (in perspective both
+//     divide at the same screen-aligned span ends, but the ends of the rows may differ by a pixel),
+//   - triangles whose bounding box is wider or taller than EDGE_MAX_EXTENT pixels are handed over to drawTriangle(),
+//     as are the (far larger still) ones whose edge values would not fit in 32 bits across clip; the profiler
+//     counts them as COUNTER_TRIANGLES_FALLBACK. Anything the primitive assembler lets through is drawn here.
+// All SIMD levels draw the same image to the bit: the kernels use no FMA and the library is built with
+// -ffp-contract=off (see texturing.pri), so every attribute rounds the same way at every width.
+void drawTriangleEdge(const TTriangle &t, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, const TRect &clip);
+
+#define EDGE_MAX_EXTENT (1 << 24)                                               // keeps the 28.4 corner positions within 32 bits
+
+#define VISIBILITY_EMPTY    0                                                   // no triangle drawn there
+
+// Second pass of the visibility buffer (see TileRenderer): every pixel of rect holds VISIBILITY_EMPTY or n + 1 for
+// the triangle triangles[indices[n]] (n < count) drawn there, and is replaced by its color - the texture sampled once per pixel,
+// at u and v taken from the same plane equations and perspective spans drawTriangleEdge() uses, or clearColor for an
+// empty pixel. scratch holds the setups of the triangles while it runs and needs resolveScratchBytes(count) bytes,
+// aligned to a cache line, that no other thread uses meanwhile.
+void resolveVisibility(const TTriangle *triangles, const int *indices, int count, FrameBuffer *frameBuffer,
+                       const TRect &rect, QRgb clearColor, void *scratch);
+size_t resolveScratchBytes(int count);                                          // a multiple of CACHE_LINE_SIZE
+
+TSimdLevel detectSimdLevel();
+TSimdLevel edgeSimdLevel();
+void setEdgeSimdLevel(TSimdLevel level);                                        // clamped to what the CPU supports
+
+#endif // EDGERASTERIZER_H
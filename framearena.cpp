@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <algorithm>
+#include <new>
+#include "alignedmemory.h"
+#include "framearena.h"
+
+#define BLOCK_HEADER    CACHE_LINE_SIZE                                         // keeps the memory of a block aligned
+
+FrameArena::FrameArena()
+{
+    current = NULL;
+    next = NULL;
+    end = NULL;
+    total = 0;
+}
+
+FrameArena::~FrameArena()
+{
+    freeBlocks();
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    char *p = (char *)(((uintptr_t)next + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+    if (current == NULL || p + bytes > end) {
+        addBlock(std::max(bytes + alignment, current ? 2 * current->size : (size_t)FRAME_ARENA_BLOCK));
+        p = (char *)(((uintptr_t)next + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+    next = p + bytes;
+    return p;
+}
+
+void FrameArena::reset()
+{
+    if (current && current->previous) {                                         // the last frame outgrew the first block
+        size_t size = total;
+        freeBlocks();
+        addBlock(size);
+    }
+    if (current) next = (char *)current + BLOCK_HEADER;
+}
+
+void FrameArena::addBlock(size_t size)
+{
+    TBlock *block = (TBlock *)alignedAlloc(BLOCK_HEADER + size);
+
+    if (block == NULL) throw std::bad_alloc();                                  // what the containers on it expect
+    block->previous = current;
+    block->size = size;
+    current = block;
+    next = (char *)block + BLOCK_HEADER;
+    end = next + size;
+    total += size;
+}
+
+void FrameArena::freeBlocks()
+{
+    while (current) {
+        TBlock *previous = current->previous;
+        alignedFree(current);
+        current = previous;
+    }
+    next = NULL;
+    end = NULL;
+    total = 0;
+}
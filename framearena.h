@@ -0,0 +1,75 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+#define FRAME_ARENA_BLOCK   (256 * 1024)                                        // bytes of the first block
+
+// Memory for data that lives for one frame only (the triangles binned by the tile renderer, the bins themselves).
+// allocate() bumps a pointer through a block of memory and reset() takes everything back at once; nothing is freed
+// one by one. A frame that does not fit into the current block gets another, twice as big, and the next reset()
+// replaces all of them with one block large enough for the whole frame, so once the frames stop growing the arena
+// never goes back to the heap.
+//
+// An arena is meant for one thread; the memory it hands out may be used by any number of them until reset().
+class FrameArena
+{
+public:
+    FrameArena();
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(double));          // alignment is a power of two up to 64
+    void reset();
+    size_t capacity() const { return total; }                                   // bytes in all blocks
+    size_t used() const { return total - (end - next); }                        // since the last reset(), with padding
+
+private:
+    struct TBlock {
+        TBlock *previous;
+        size_t size;                                                            // usable bytes following the header
+    };
+
+    TBlock *current;
+    char *next;
+    char *end;
+    size_t total;
+
+    void addBlock(size_t size);
+    void freeBlocks();
+};
+
+// A standard allocator on a frame arena. Memory goes back only with FrameArena::reset(), after which containers
+// using it must not be touched other than to be assigned a new one.
+template <class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    FrameArena *arena;
+
+    ArenaAllocator(FrameArena *arena = NULL) : arena(arena) {}
+    template <class U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return (T *)arena->allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T *, size_t) {}
+};
+
+template <class T, class U>
+inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+
+template <class T, class U>
+inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // FRAMEARENA_H
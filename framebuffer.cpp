@@ -0,0 +1,62 @@
+#include "framebuffer.h"
+#include "alignedmemory.h"
+
+FrameBuffer::FrameBuffer(int width, int height)
+{
+    this->width = 0;
+    this->height = 0;
+    stride = 0;
+    color = NULL;
+    capacity = 0;
+    resize(width, height);
+}
+
+FrameBuffer::~FrameBuffer()
+{
+    if (color) alignedFree(color);
+}
+
+// Like the depth buffer, a frame buffer made smaller keeps its memory for when it grows again
+void FrameBuffer::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    stride = (width + (CACHE_LINE_SIZE / sizeof(uint32_t)) - 1) & ~(int)(CACHE_LINE_SIZE / sizeof(uint32_t) - 1);   // round rows up to a whole cache line
+    if (width <= 0 || height <= 0) return;
+
+    size_t size = (size_t)stride * height;
+    if (size > capacity) {
+        if (color) alignedFree(color);
+        color = (uint32_t *)alignedAlloc(size * sizeof(uint32_t));
+        capacity = color ? size : 0;
+    }
+}
+
+void FrameBuffer::clear(QRgb col)
+{
+    TRect rect = { 0, 0, width, height };
+    clearRect(rect, col);
+}
+
+void FrameBuffer::clearRect(const TRect &rect, QRgb col)
+{
+    fillRect(rect, col | 0xff000000);
+}
+
+void FrameBuffer::fillRect(const TRect &rect, uint32_t value)
+{
+    int x, y;
+
+    for (y=rect.y0; y<rect.y1; y++) {
+        uint32_t *pixels = scanLine(y);
+        for (x=rect.x0; x<rect.x1; x++) {
+            pixels[x] = value;
+        }
+    }
+}
+
+QImage FrameBuffer::image() const
+{
+    // The QImage does not own the pixels - it is only valid as long as the frame buffer is not resized or destroyed
+    return QImage((uchar *)color, width, height, stride * sizeof(uint32_t), QImage::Format_RGB32);
+}
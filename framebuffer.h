@@ -0,0 +1,65 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <QImage>
+
+struct TRect {
+    int x0;
+    int y0;
+    int x1;                                                                     // x1 and y1 are exclusive
+    int y1;
+};
+
+inline bool isEmptyRect(const TRect &r)
+{
+    return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+inline TRect intersectRects(const TRect &a, const TRect &b)
+{
+    TRect r = { std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1) };
+    return r;
+}
+
+inline TRect mergeRects(const TRect &a, const TRect &b)                         // the rectangle around both, empty ones ignored
+{
+    if (isEmptyRect(a)) return b;
+    if (isEmptyRect(b)) return a;
+    TRect r = { std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+    return r;
+}
+
+// A render target made of one contiguous block of 32-bit pixels (0xffRRGGBB, the same layout as QImage::Format_RGB32).
+// Every row starts on a cache line boundary, so the rasterizer can write spans directly into the buffer, and the
+// whole frame is handed over to Qt once per frame by wrapping it in a QImage.
+class FrameBuffer
+{
+public:
+    uint32_t *color;
+    int width;
+    int height;
+    int stride;                                                                 // distance between rows in pixels
+
+    FrameBuffer() { width = 0; height = 0; stride = 0; color = NULL; capacity = 0; }
+    FrameBuffer(int width, int height);
+    ~FrameBuffer();
+
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer &operator=(const FrameBuffer &) = delete;
+
+    void resize(int width, int height);                                         // keeps the memory when not growing
+    void clear(QRgb col);
+    void clearRect(const TRect &rect, QRgb col);
+    void fillRect(const TRect &rect, uint32_t value);                           // raw values, the alpha is not forced
+    QImage image() const;
+
+    inline uint32_t *scanLine(int y) { return color + y * stride; }
+    inline void setPixel(int x, int y, QRgb col) { color[x + y * stride] = col; }
+
+private:
+    size_t capacity;                                                            // pixels allocated
+};
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,235 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "framewriter.h"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#define WRITE_CHUNKS    64                                                      // buffers handed to one writev()
+
+FrameWriter::FrameWriter()
+{
+    file = -1;
+    ownFile = false;
+    failed = false;
+    format = STREAM_BGRA;
+    width = 0;
+    height = 0;
+    written = 0;
+}
+
+FrameWriter::~FrameWriter()
+{
+    close();
+}
+
+size_t FrameWriter::frameSize(TStreamFormat format, int width, int height)
+{
+    size_t pixels = (size_t)width * height;
+    char header[64];
+
+    switch (format) {
+    case STREAM_PPM:
+        return snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height) + pixels * 3;
+    case STREAM_Y4M:                                                            // "FRAME\n", then Y, Cb and Cr
+        return 6 + pixels + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    default:
+        return pixels * 4;
+    }
+}
+
+bool FrameWriter::open(const char *fileName, TStreamFormat format, int width, int height, int frameRate)
+{
+    char text[128];
+    int length = 0;
+
+    close();
+    if (!strcmp(fileName, "-")) {
+#if defined(_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        fflush(stdout);                                                         // what stdio buffered goes out first
+        file = 1;
+        ownFile = false;
+    }
+    else {
+#if defined(_WIN32)
+        file = _open(fileName, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        file = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (file < 0) return false;
+        ownFile = true;
+    }
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    failed = false;
+    written = 0;
+
+    header.clear();
+    if (format == STREAM_PPM) length = snprintf(text, sizeof(text), "P6\n%d %d\n255\n", width, height);
+    else if (format == STREAM_Y4M) length = snprintf(text, sizeof(text), "FRAME\n");
+    header.assign(text, text + length);
+    buffer.resize(frameSize(format, width, height) - length);
+
+    if (format == STREAM_Y4M) {                                                 // the stream header, once
+        length = snprintf(text, sizeof(text), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, frameRate);
+        const unsigned char *data = (const unsigned char *)text;
+        size_t size = length;
+        if (!writeChunks(&data, &size, 1)) return false;
+    }
+    return true;
+}
+
+bool FrameWriter::close()
+{
+    bool ok = !failed;
+
+    if (file >= 0 && ownFile) {
+#if defined(_WIN32)
+        if (_close(file) != 0) ok = false;
+#else
+        if (::close(file) != 0) ok = false;
+#endif
+    }
+    file = -1;
+    ownFile = false;
+    failed = false;
+    return ok;
+}
+
+// Converts the frame into buffer. Y4M uses the BT.601 coefficients in 16.16 fixed point, the chroma of every 2x2 block
+// from the average of its pixels (the last row and column repeat at odd sizes).
+void FrameWriter::convert(const FrameBuffer &frame)
+{
+    unsigned char *out = buffer.data();
+    int x, y;
+
+    if (format == STREAM_RGBA || format == STREAM_PPM) {
+        for (y=0; y<height; y++) {
+            const uint32_t *row = frame.color + y * frame.stride;
+            for (x=0; x<width; x++) {
+                uint32_t c = row[x];
+                *out++ = (unsigned char)(c >> 16);
+                *out++ = (unsigned char)(c >> 8);
+                *out++ = (unsigned char)c;
+                if (format == STREAM_RGBA) *out++ = (unsigned char)(c >> 24);
+            }
+        }
+        return;
+    }
+
+    int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    unsigned char *plane = out;
+    unsigned char *cb = out + (size_t)width * height;
+    unsigned char *cr = cb + (size_t)chromaWidth * chromaHeight;
+    for (y=0; y<height; y++) {
+        const uint32_t *row = frame.color + y * frame.stride;
+        for (x=0; x<width; x++) {
+            uint32_t c = row[x];
+            int r = (c >> 16) & 0xff, g = (c >> 8) & 0xff, b = c & 0xff;
+            plane[x + y * width] = (unsigned char)((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+        }
+    }
+    for (y=0; y<chromaHeight; y++) {
+        const uint32_t *row0 = frame.color + (2 * y) * frame.stride;
+        const uint32_t *row1 = frame.color + std::min(2 * y + 1, height - 1) * frame.stride;
+        for (x=0; x<chromaWidth; x++) {
+            int x1 = std::min(2 * x + 1, width - 1);
+            uint32_t p[4] = { row0[2 * x], row0[x1], row1[2 * x], row1[x1] };
+            int r = 0, g = 0, b = 0;
+            for (int i=0; i<4; i++) {
+                r += (p[i] >> 16) & 0xff;
+                g += (p[i] >> 8) & 0xff;
+                b += p[i] & 0xff;
+            }
+            // the sums of four pixels, so 2 more bits to shift out and 128 moved up as far
+            int u = (-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18;
+            int v = (32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18;
+            cb[x + y * chromaWidth] = (unsigned char)std::min(u, 255);
+            cr[x + y * chromaWidth] = (unsigned char)std::min(v, 255);
+        }
+    }
+}
+
+bool FrameWriter::writeFrame(const FrameBuffer &frame)
+{
+    const unsigned char *data[WRITE_CHUNKS];
+    size_t sizes[WRITE_CHUNKS];
+    int count = 0, y;
+
+    if (file < 0 || failed || frame.width != width || frame.height != height) return false;
+
+    if (!header.empty()) {
+        data[count] = header.data();
+        sizes[count++] = header.size();
+    }
+    if (format != STREAM_BGRA) {
+        convert(frame);
+        data[count] = buffer.data();
+        sizes[count++] = buffer.size();
+        return writeChunks(data, sizes, count);
+    }
+
+    size_t rowBytes = (size_t)width * 4;
+    if (frame.stride == width) {                                                // the rows follow each other
+        data[0] = (const unsigned char *)frame.color;
+        sizes[0] = rowBytes * height;
+        return writeChunks(data, sizes, 1);
+    }
+    for (y=0; y<height; y++) {                                                  // one buffer per row, skipping the padding
+        data[count] = (const unsigned char *)(frame.color + y * frame.stride);
+        sizes[count++] = rowBytes;
+        if (count == WRITE_CHUNKS || y == height - 1) {
+            if (!writeChunks(data, sizes, count)) return false;
+            count = 0;
+        }
+    }
+    return true;
+}
+
+// Writes count buffers in order, all of each; marks the writer failed on an error
+bool FrameWriter::writeChunks(const unsigned char **data, const size_t *sizes, int count)
+{
+    int first = 0;
+    size_t offset = 0;                                                          // already written of data[first]
+
+    while (first < count) {
+#if defined(_WIN32)
+        unsigned size = (unsigned)std::min(sizes[first] - offset, (size_t)1 << 30);
+        long n = _write(file, data[first] + offset, size);
+#else
+        struct iovec vectors[WRITE_CHUNKS];
+        int i, vectorCount = 0;
+        for (i=first; i<count && vectorCount<WRITE_CHUNKS; i++) {
+            vectors[vectorCount].iov_base = (void *)(data[i] + (i == first ? offset : 0));
+            vectors[vectorCount].iov_len = sizes[i] - (i == first ? offset : 0);
+            vectorCount++;
+        }
+        ssize_t n = writev(file, vectors, vectorCount);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            return false;
+        }
+        written += n;
+        size_t left = (size_t)n;                                                // move past what went out
+        while (first < count && left >= sizes[first] - offset) {
+            left -= sizes[first] - offset;
+            offset = 0;
+            first++;
+        }
+        offset += left;
+    }
+    return true;
+}
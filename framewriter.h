@@ -0,0 +1,53 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <stdint.h>
+#include <vector>
+#include "framebuffer.h"
+
+enum TStreamFormat {
+    STREAM_BGRA,                                                                // raw, the bytes of the frame buffer as they are
+    STREAM_RGBA,                                                                // raw, 8 bits per channel in that order
+    STREAM_PPM,                                                                 // a binary PPM image per frame, one after another
+    STREAM_Y4M                                                                  // YUV4MPEG2 stream, 4:2:0 in full range (BT.601)
+};
+
+// Streams frames of one size into a file or to standard output, for an encoder reading from a pipe (ffmpeg takes
+// all four formats: rawvideo with pix_fmt bgra or rgba, image2pipe and yuv4mpegpipe). Every frame goes out with one
+// vectored write: STREAM_BGRA straight from the rows of the frame buffer, the other formats from a buffer the frame
+// is converted into first, which is kept for the next frame. A write that the pipe only takes in part is continued
+// until the whole frame is out.
+class FrameWriter
+{
+public:
+    FrameWriter();
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    // "-" writes to standard output; frameRate only goes into the header of STREAM_Y4M
+    bool open(const char *fileName, TStreamFormat format, int width, int height, int frameRate = 25);
+    bool writeFrame(const FrameBuffer &frame);                                  // of the size given to open()
+    bool close();                                                               // false if anything failed to be written
+    bool isOpen() const { return file >= 0; }
+    uint64_t bytesWritten() const { return written; }
+
+    static size_t frameSize(TStreamFormat format, int width, int height);       // bytes of one frame with its header
+
+private:
+    int file;                                                                   // descriptor, -1 when closed
+    bool ownFile;                                                               // not standard output
+    bool failed;
+    TStreamFormat format;
+    int width;
+    int height;
+    uint64_t written;
+    std::vector<unsigned char> header;                                          // written before every frame
+    std::vector<unsigned char> buffer;                                          // the converted frame
+
+    void convert(const FrameBuffer &frame);
+    bool writeChunks(const unsigned char **data, const size_t *sizes, int count);
+};
+
+#endif // FRAMEWRITER_H
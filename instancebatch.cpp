@@ -0,0 +1,45 @@
+#include <algorithm>
+#include "instancebatch.h"
+#include "profiler.h"
+
+void InstanceBatch::submit(const TMesh &mesh, const TMat4x4 *transforms, const TTextureHandle *textures, int count,
+                           const TMat4x4 &viewProjection, PrimitiveAssembler &assembler, TextureManager *textureManager,
+                           TileRenderer *renderer)
+{
+    int vertices = mesh.vertexCount();
+    int i, j;
+    PROFILE_STAGE(STAGE_CULLING);
+
+    if (vertices == 0) return;
+    if (renderer->isIncremental()) renderer->invalidate();                      // nothing is known about what moved
+
+    TFrustum frustum = makeFrustum(viewProjection, assembler.nearPlane(), assembler.farPlane());
+    TBounds bounds = computeBounds(mesh);
+    visible.clear();
+    for (i=0; i<count; i++) {
+        unsigned planeMask = ALL_PLANES;
+        if (clipBounds(transformBounds(bounds, transforms[i]), frustum, planeMask)) visible.push_back(i);
+    }
+    PROFILE_COUNT(COUNTER_OBJECTS_VISIBLE, visible.size());
+    PROFILE_COUNT(COUNTER_OBJECTS_CULLED, count - (int)visible.size());
+    PROFILE_STOP();
+
+    int perBatch = std::max(1, INSTANCE_BATCH_VERTICES / vertices);
+    for (i=0; i<(int)visible.size(); i+=perBatch) {
+        int batch = std::min(perBatch, (int)visible.size() - i);
+        {
+            PROFILE_STAGE(STAGE_TRANSFORM);
+            cache.resize(batch * vertices);
+            for (j=0; j<batch; j++) {
+                TMat4x4 m = multiplyMatrices(transforms[visible[i + j]], viewProjection);
+                transformVertices(m, mesh, cache, j * vertices);
+            }
+            PROFILE_NEXT_STAGE(STAGE_PROJECTION);
+            assembler.project(cache);
+        }
+        for (j=0; j<batch; j++) {
+            TTextureHandle texture = textures ? textures[visible[i + j]] : NO_TEXTURE;
+            assembler.submit(mesh, cache, textureManager, renderer, j * vertices, texture);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef INSTANCEBATCH_H
+#define INSTANCEBATCH_H
+
+#include <vector>
+#include "mesh.h"
+#include "primitiveassembler.h"
+#include "texturemanager.h"
+#include "tilerenderer.h"
+
+#define INSTANCE_BATCH_VERTICES 4096                                            // positions projected in one pass
+
+// Instanced draws: one mesh drawn once for every transform of an array, each copy optionally with a texture of its
+// own. The box of the mesh is moved by every transform and tested against the view frustum first, so copies outside
+// the view cost a few dozen operations and nothing else. The visible ones are transformed into one shared vertex
+// cache, as many copies at a time as fit into INSTANCE_BATCH_VERTICES, projected in one pass over the batch and handed
+// to the primitive assembler copy by copy. The transforms come anew with every call, so an incremental renderer is
+// always told that the whole frame changed.
+class InstanceBatch
+{
+public:
+    // transforms place the copies in the world; textures, when not NULL, replace the textures of the mesh for every
+    // copy (NO_TEXTURE keeps them)
+    void submit(const TMesh &mesh, const TMat4x4 *transforms, const TTextureHandle *textures, int count,
+                const TMat4x4 &viewProjection, PrimitiveAssembler &assembler, TextureManager *textureManager,
+                TileRenderer *renderer);
+
+private:
+    std::vector<int> visible;
+    TVertexCache cache;
+};
+
+#endif // INSTANCEBATCH_H
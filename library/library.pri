@@ -0,0 +1,17 @@
+# Links a program with the renderer library built by library/library.pro, from a project next to the library
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+# The headers differ with and without the counters, so a program has to be built the same way as the library
+texturing_profile: DEFINES += TEXTURING_PROFILE
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../library/release/ -ltexturing
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../library/debug/ -ltexturing
+else:unix: LIBS += -L$$OUT_PWD/../library/ -ltexturing
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../library/release/libtexturing.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../library/debug/libtexturing.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../library/release/texturing.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../library/debug/texturing.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../library/libtexturing.a
@@ -0,0 +1,10 @@
+QT += gui
+
+TEMPLATE = lib
+CONFIG += c++11 staticlib
+
+TARGET = texturing
+
+# The whole renderer, for programs to link with through library/library.pri
+
+include(../texturing.pri)
@@ -0,0 +1,105 @@
+#include <utility>
+#include "mappedfile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+    data = NULL;
+    size = 0;
+#if defined(_WIN32)
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : MappedFile()
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this == &other) return *this;
+    close();
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+#if defined(_WIN32)
+    std::swap(file, other.file);
+    std::swap(mapping, other.mapping);
+#endif
+    return *this;
+}
+
+bool MappedFile::open(const char *fileName)
+{
+    close();
+
+#if defined(_WIN32)
+    LARGE_INTEGER fileSize;
+
+    file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {         // an empty file can not be mapped
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        close();
+        return false;
+    }
+    data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+#else
+    struct stat info;
+    int fd;
+
+    if ((fd = ::open(fileName, O_RDONLY)) < 0) return false;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);                                                                // the mapping keeps its own reference
+    if (view == MAP_FAILED) return false;
+#if defined(MADV_SEQUENTIAL)
+    madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);                      // decoding reads the file front to back
+#endif
+    data = (const unsigned char *)view;
+    size = (size_t)info.st_size;
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap((void *)data, size);
+#endif
+    data = NULL;
+    size = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+
+// A read-only view of a whole file mapped into memory (mmap on POSIX systems, a file mapping object on Windows).
+// The contents stay valid until close() or the destructor.
+class MappedFile
+{
+public:
+    const unsigned char *data;
+    size_t size;
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;                         // closes the file held before
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const char *fileName);
+    void close();
+    bool isOpen() const { return data != NULL; }
+
+private:
+#if defined(_WIN32)
+    void *file;
+    void *mapping;
+#endif
+};
+
+#endif // MAPPEDFILE_H
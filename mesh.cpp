@@ -0,0 +1,329 @@
+#include <QtMath>
+#include <algorithm>
+#include "mesh.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MESH_SSE2
+#include <emmintrin.h>
+#endif
+
+int TMesh::addVertex(float x, float y, float z)
+{
+    int i;
+
+    for (i=0; i<vertexCount(); i++) {                                           // meshes built this way are small
+        if (this->x[i] == x && this->y[i] == y && this->z[i] == z) return i;
+    }
+    this->x.push_back(x);
+    this->y.push_back(y);
+    this->z.push_back(z);
+    return vertexCount() - 1;
+}
+
+void TMesh::addTriangle(const TTriangle &triangle, TTextureHandle texture)
+{
+    const TVertex corners[3] = { triangle.V1, triangle.V2, triangle.V3 };
+
+    addTriangle(corners, texture);
+}
+
+void TMesh::addTriangle(const TVertex (&corners)[3], TTextureHandle texture)
+{
+    for (const TVertex &corner : corners) {
+        indices.push_back(addVertex(corner.x, corner.y, corner.z));
+        u.push_back(corner.u);
+        v.push_back(corner.v);
+    }
+    textures.push_back(texture);
+}
+
+void TVertexCache::resize(int count)
+{
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    w.resize(count);
+    screenX.resize(count);
+    screenY.resize(count);
+    screenZ.resize(count);
+}
+
+TMat4x4 makeIdentity()
+{
+    TMat4x4 m;
+    m.m[0][0] = 1.0f;
+    m.m[1][1] = 1.0f;
+    m.m[2][2] = 1.0f;
+    m.m[3][3] = 1.0f;
+    return m;
+}
+
+TMat4x4 makeRotationX(float angle)
+{
+    TMat4x4 m;
+    m.m[0][0] = 1.0f;
+    m.m[1][1] = cosf(angle);
+    m.m[1][2] = sinf(angle);
+    m.m[2][1] = -sinf(angle);
+    m.m[2][2] = cosf(angle);
+    m.m[3][3] = 1.0f;
+    return m;
+}
+
+TMat4x4 makeRotationY(float angle)
+{
+    TMat4x4 m;
+    m.m[0][0] = cosf(angle);
+    m.m[0][2] = -sinf(angle);
+    m.m[1][1] = 1.0f;
+    m.m[2][0] = sinf(angle);
+    m.m[2][2] = cosf(angle);
+    m.m[3][3] = 1.0f;
+    return m;
+}
+
+TMat4x4 makeRotationZ(float angle)
+{
+    TMat4x4 m;
+    m.m[0][0] = cosf(angle);
+    m.m[0][1] = sinf(angle);
+    m.m[1][0] = -sinf(angle);
+    m.m[1][1] = cosf(angle);
+    m.m[2][2] = 1.0f;
+    m.m[3][3] = 1.0f;
+    return m;
+}
+
+TMat4x4 makeTranslation(float x, float y, float z)
+{
+    TMat4x4 m = makeIdentity();
+    m.m[3][0] = x;
+    m.m[3][1] = y;
+    m.m[3][2] = z;
+    return m;
+}
+
+TMat4x4 makeProjection(float fov, float aspectRatio, float zNear, float zFar, float scale)
+{
+    TMat4x4 m;
+    float fovRad = 1.0f / tanf(fov * 0.5f /180.0f * M_PI);
+
+    m.m[0][0] = scale * aspectRatio * fovRad;
+    m.m[1][1] = -scale * fovRad;
+    m.m[2][2] = scale * zFar / (zFar - zNear);
+    m.m[3][2] = (-zFar * zNear) / (zFar - zNear);
+    m.m[2][3] = 1.0f;
+    m.m[3][3] = 0.0f;
+    return m;
+}
+
+TMat4x4 multiplyMatrices(const TMat4x4 &a, const TMat4x4 &b)
+{
+    TMat4x4 o;
+    int r, c;
+
+    for (r=0; r<4; r++) {
+        for (c=0; c<4; c++) {
+            o.m[r][c] = a.m[r][0] * b.m[0][c] + a.m[r][1] * b.m[1][c] + a.m[r][2] * b.m[2][c] + a.m[r][3] * b.m[3][c];
+        }
+    }
+    return o;
+}
+
+void multiplyMatrixVector(TVertex &i, TVertex &o, TMat4x4 &m)
+{
+    float w;
+    o.x = i.x * m.m[0][0] + i.y * m.m[1][0] + i.z * m.m[2][0] + m.m[3][0];
+    o.y = i.x * m.m[0][1] + i.y * m.m[1][1] + i.z * m.m[2][1] + m.m[3][1];
+    o.z = i.x * m.m[0][2] + i.y * m.m[1][2] + i.z * m.m[2][2] + m.m[3][2];
+    w   = i.x * m.m[0][3] + i.y * m.m[1][3] + i.z * m.m[2][3] + m.m[3][3];
+
+    if (w != 0.0f) {
+        o.x /= w;
+        o.y /= w;
+        o.z /= w;
+    }
+
+}
+
+TBounds computeBounds(const TMesh &mesh)
+{
+    TBounds b = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    int i;
+
+    if (mesh.vertexCount() == 0) return b;
+    b = { mesh.x[0], mesh.y[0], mesh.z[0], mesh.x[0], mesh.y[0], mesh.z[0] };
+    for (i=1; i<mesh.vertexCount(); i++) {
+        b.minX = std::min(b.minX, mesh.x[i]); b.maxX = std::max(b.maxX, mesh.x[i]);
+        b.minY = std::min(b.minY, mesh.y[i]); b.maxY = std::max(b.maxY, mesh.y[i]);
+        b.minZ = std::min(b.minZ, mesh.z[i]); b.maxZ = std::max(b.maxZ, mesh.z[i]);
+    }
+    return b;
+}
+
+// Every axis of the result is the translation plus, per input axis, whichever end of the box adds less (or more)
+TBounds transformBounds(const TBounds &b, const TMat4x4 &m)
+{
+    const float lo[3] = { b.minX, b.minY, b.minZ };
+    const float hi[3] = { b.maxX, b.maxY, b.maxZ };
+    float outLo[3], outHi[3];
+    int i, j;
+
+    for (j=0; j<3; j++) {
+        outLo[j] = outHi[j] = m.m[3][j];
+        for (i=0; i<3; i++) {
+            float a = m.m[i][j] * lo[i], c = m.m[i][j] * hi[i];
+            outLo[j] += std::min(a, c);
+            outHi[j] += std::max(a, c);
+        }
+    }
+    return { outLo[0], outLo[1], outLo[2], outHi[0], outHi[1], outHi[2] };
+}
+
+TBounds mergeBounds(const TBounds &a, const TBounds &b)
+{
+    return { std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::min(a.minZ, b.minZ),
+             std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY), std::max(a.maxZ, b.maxZ) };
+}
+
+// The planes of the clip space tests of the assembler (x and y within w, w between the depth planes) applied to the
+// columns of the matrix, which gives them in the space the matrix is applied to
+TFrustum makeFrustum(const TMat4x4 &viewProjection, float zNear, float zFar)
+{
+    const TMat4x4 &m = viewProjection;
+    TFrustum f;
+    int i;
+
+    for (i=0; i<4; i++) {
+        f.planes[0][i] = m.m[i][3] + m.m[i][0];
+        f.planes[1][i] = m.m[i][3] - m.m[i][0];
+        f.planes[2][i] = m.m[i][3] + m.m[i][1];
+        f.planes[3][i] = m.m[i][3] - m.m[i][1];
+        f.planes[4][i] = m.m[i][3];
+        f.planes[5][i] = -m.m[i][3];
+    }
+    f.planes[4][3] -= zNear;
+    f.planes[5][3] += zFar;
+    return f;
+}
+
+// Tests a box against the planes left in planeMask. Returns false when it is wholly outside one of them, otherwise
+// drops the planes it is wholly inside of from the mask.
+bool clipBounds(const TBounds &b, const TFrustum &frustum, unsigned &planeMask)
+{
+    int p;
+
+    for (p=0; p<FRUSTUM_PLANES; p++) {
+        if (!(planeMask & (1u << p))) continue;
+
+        const float *plane = frustum.planes[p];
+        float inner = plane[3] + plane[0] * (plane[0] > 0.0f ? b.maxX : b.minX)
+                               + plane[1] * (plane[1] > 0.0f ? b.maxY : b.minY)
+                               + plane[2] * (plane[2] > 0.0f ? b.maxZ : b.minZ);
+        if (inner < 0.0f) return false;                                         // even the corner furthest in is outside
+        float outer = plane[3] + plane[0] * (plane[0] > 0.0f ? b.minX : b.maxX)
+                               + plane[1] * (plane[1] > 0.0f ? b.minY : b.maxY)
+                               + plane[2] * (plane[2] > 0.0f ? b.minZ : b.maxZ);
+        if (outer >= 0.0f) planeMask &= ~(1u << p);
+    }
+    return true;
+}
+
+void transformVertices(const TMat4x4 &m, const TMesh &mesh, TVertexCache &cache)
+{
+    cache.resize(mesh.vertexCount());
+    transformVertices(m, mesh, cache, 0);
+}
+
+// Transforms every position of the mesh into clip space, stored from position first of the cache on. The SIMD path
+// evaluates four vertices per step in the same order of operations as the scalar tail, so both give identical results.
+void transformVertices(const TMat4x4 &m, const TMesh &mesh, TVertexCache &cache, int first)
+{
+    int count = mesh.vertexCount();
+    int i = 0;
+    float *outX = cache.x.data() + first, *outY = cache.y.data() + first;
+    float *outZ = cache.z.data() + first, *outW = cache.w.data() + first;
+
+#if defined(MESH_SSE2)
+    __m128 m00 = _mm_set1_ps(m.m[0][0]), m01 = _mm_set1_ps(m.m[0][1]), m02 = _mm_set1_ps(m.m[0][2]), m03 = _mm_set1_ps(m.m[0][3]);
+    __m128 m10 = _mm_set1_ps(m.m[1][0]), m11 = _mm_set1_ps(m.m[1][1]), m12 = _mm_set1_ps(m.m[1][2]), m13 = _mm_set1_ps(m.m[1][3]);
+    __m128 m20 = _mm_set1_ps(m.m[2][0]), m21 = _mm_set1_ps(m.m[2][1]), m22 = _mm_set1_ps(m.m[2][2]), m23 = _mm_set1_ps(m.m[2][3]);
+    __m128 m30 = _mm_set1_ps(m.m[3][0]), m31 = _mm_set1_ps(m.m[3][1]), m32 = _mm_set1_ps(m.m[3][2]), m33 = _mm_set1_ps(m.m[3][3]);
+
+    for (; i+4<=count; i+=4) {
+        __m128 x = _mm_loadu_ps(&mesh.x[i]);
+        __m128 y = _mm_loadu_ps(&mesh.y[i]);
+        __m128 z = _mm_loadu_ps(&mesh.z[i]);
+        _mm_storeu_ps(&outX[i], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_mul_ps(z, m20)), m30));
+        _mm_storeu_ps(&outY[i], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_mul_ps(z, m21)), m31));
+        _mm_storeu_ps(&outZ[i], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_mul_ps(z, m22)), m32));
+        _mm_storeu_ps(&outW[i], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m03), _mm_mul_ps(y, m13)), _mm_mul_ps(z, m23)), m33));
+    }
+#endif
+    for (; i<count; i++) {
+        float x = mesh.x[i], y = mesh.y[i], z = mesh.z[i];
+        outX[i] = x * m.m[0][0] + y * m.m[1][0] + z * m.m[2][0] + m.m[3][0];
+        outY[i] = x * m.m[0][1] + y * m.m[1][1] + z * m.m[2][1] + m.m[3][1];
+        outZ[i] = x * m.m[0][2] + y * m.m[1][2] + z * m.m[2][2] + m.m[3][2];
+        outW[i] = x * m.m[0][3] + y * m.m[1][3] + z * m.m[2][3] + m.m[3][3];
+    }
+}
+
+// Perspective divide and viewport transform of the whole cache. Like multiplyMatrixVector(), a vertex with w == 0
+// is left undivided.
+void projectVertices(TVertexCache &cache, int width, int height, float depthRange)
+{
+    int count = (int)cache.x.size();
+    int i = 0;
+    float scaleX = 0.5f * width;
+    float scaleY = 0.5f * height;
+    float scaleZ = 0.5f * depthRange;
+
+#if defined(MESH_SSE2)
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sx = _mm_set1_ps(scaleX), sy = _mm_set1_ps(scaleY), sz = _mm_set1_ps(scaleZ);
+
+    for (; i+4<=count; i+=4) {
+        __m128 w = _mm_loadu_ps(&cache.w[i]);
+        __m128 divide = _mm_cmpneq_ps(w, _mm_setzero_ps());
+        __m128 x = _mm_loadu_ps(&cache.x[i]);
+        __m128 y = _mm_loadu_ps(&cache.y[i]);
+        __m128 z = _mm_loadu_ps(&cache.z[i]);
+        __m128 safeW = _mm_or_ps(_mm_and_ps(divide, w), _mm_andnot_ps(divide, one));
+        x = _mm_div_ps(x, safeW);
+        y = _mm_div_ps(y, safeW);
+        z = _mm_div_ps(z, safeW);
+        _mm_storeu_ps(&cache.screenX[i], _mm_mul_ps(_mm_add_ps(x, one), sx));
+        _mm_storeu_ps(&cache.screenY[i], _mm_mul_ps(_mm_add_ps(y, one), sy));
+        _mm_storeu_ps(&cache.screenZ[i], _mm_mul_ps(z, sz));
+    }
+#endif
+    for (; i<count; i++) {
+        float x = cache.x[i], y = cache.y[i], z = cache.z[i], w = cache.w[i];
+        if (w != 0.0f) {
+            x /= w;
+            y /= w;
+            z /= w;
+        }
+        cache.screenX[i] = (x + 1.0f) * scaleX;
+        cache.screenY[i] = (y + 1.0f) * scaleY;
+        cache.screenZ[i] = z * scaleZ;
+    }
+}
+
+void assembleTriangle(const TMesh &mesh, const TVertexCache &cache, int triangle, TTriangle &t, int baseVertex)
+{
+    TVertex *corners[3] = { &t.V1, &t.V2, &t.V3 };
+    int c;
+
+    for (c=0; c<3; c++) {
+        int corner = triangle * 3 + c;
+        int index = baseVertex + mesh.indices[corner];
+        corners[c]->x = cache.screenX[index];
+        corners[c]->y = cache.screenY[index];
+        corners[c]->z = cache.screenZ[index];
+        corners[c]->u = mesh.u[corner];
+        corners[c]->v = mesh.v[corner];
+        corners[c]->w = (cache.w[index] > 0.0f) ? 1.0f / cache.w[index] : 0.0f;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include "rasterizer.h"
+#include "texturemanager.h"
+
+// Indexed mesh. Positions are kept as a structure of arrays so the vertex stage can transform a whole batch of them
+// at once; every triangle corner references a position by index and carries its own texture coordinates (the faces
+// of the cube share their corners but not u and v), so a position is transformed once however many faces use it.
+struct TMesh
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<int> indices;                                                   // three positions per triangle
+    std::vector<float> u;                                                       // per corner, parallel to indices
+    std::vector<float> v;
+    std::vector<TTextureHandle> textures;                                       // one per triangle, resolved every frame
+
+    int vertexCount() const { return (int)x.size(); }
+    int triangleCount() const { return (int)textures.size(); }
+
+    int addVertex(float x, float y, float z);                                   // reuses an equal position
+    void addTriangle(const TTriangle &triangle, TTextureHandle texture);
+    void addTriangle(const TVertex (&corners)[3], TTextureHandle texture);      // positions and u, v only
+};
+
+// Post-transform cache of a mesh for the current frame: clip space positions and the same positions after the
+// perspective divide, in screen coordinates
+struct TVertexCache
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> w;
+    std::vector<float> screenX;
+    std::vector<float> screenY;
+    std::vector<float> screenZ;
+
+    void resize(int count);
+};
+
+struct TMat4x4 {
+    float m[4][4] = { 0 };
+};
+
+// Axis aligned bounding box
+struct TBounds
+{
+    float minX, minY, minZ;
+    float maxX, maxY, maxZ;
+};
+
+#define FRUSTUM_PLANES  6
+#define ALL_PLANES      ((1u << FRUSTUM_PLANES) - 1)
+
+// The planes of a view frustum as a, b, c, d with a * x + b * y + c * z + d >= 0 inside
+struct TFrustum
+{
+    float planes[FRUSTUM_PLANES][4];
+};
+
+// Matrices act on row vectors (v * m), so multiplyMatrices(a, b) applies a first and b second. The projection puts
+// the distance from the camera into w.
+TMat4x4 makeIdentity();
+TMat4x4 makeRotationX(float angle);
+TMat4x4 makeRotationY(float angle);
+TMat4x4 makeRotationZ(float angle);
+TMat4x4 makeTranslation(float x, float y, float z);
+TMat4x4 makeProjection(float fov, float aspectRatio, float zNear, float zFar, float scale);
+TMat4x4 multiplyMatrices(const TMat4x4 &a, const TMat4x4 &b);
+
+void multiplyMatrixVector(TVertex &i, TVertex &o, TMat4x4 &m);
+
+TBounds computeBounds(const TMesh &mesh);                                       // all zero for an empty mesh
+TBounds transformBounds(const TBounds &b, const TMat4x4 &m);                    // the box around b moved by an affine m
+TBounds mergeBounds(const TBounds &a, const TBounds &b);
+
+TFrustum makeFrustum(const TMat4x4 &viewProjection, float zNear, float zFar);
+bool clipBounds(const TBounds &b, const TFrustum &frustum, unsigned &planeMask);
+
+void transformVertices(const TMat4x4 &m, const TMesh &mesh, TVertexCache &cache);
+void transformVertices(const TMat4x4 &m, const TMesh &mesh, TVertexCache &cache, int first);   // into a larger cache
+void projectVertices(TVertexCache &cache, int width, int height, float depthRange);
+void assembleTriangle(const TMesh &mesh, const TVertexCache &cache, int triangle, TTriangle &t, int baseVertex = 0);
+
+#endif // MESH_H
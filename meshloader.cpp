@@ -0,0 +1,560 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <map>
+#include <QDebug>
+#include "mappedfile.h"
+#include "meshloader.h"
+
+#define OBJ_CHUNK_SIZE      (1 << 20)                                           // bytes of text per parallel task
+#define MESH_CACHE_MAGIC    0x48534d54                                          // "TMSH"
+#define MESH_CACHE_VERSION  1
+#define MESH_CACHE_ALIGN    16                                                  // every array starts on such a boundary
+
+struct TMeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t materialCount;
+    uint32_t reserved;
+    uint64_t sourceSize;                                                        // of the OBJ file the cache was written for
+    int64_t sourceTime;
+};
+
+// A run of whole lines of an OBJ file. The first pass counts what every chunk defines, which gives each chunk the
+// place of its output in the final arrays; the second pass parses it there.
+struct TObjChunk {
+    const char *begin;
+    const char *end;
+    int positions;
+    int texcoords;
+    int triangles;
+    int positionBase;
+    int texcoordBase;
+    int triangleBase;
+    std::vector<std::string> usedMaterials;                                     // usemtl lines in order
+    std::vector<int> usedMaterialIndex;                                         // the same, as indices into the material table
+    int startMaterial;                                                          // in effect at the first line of the chunk
+    bool failed;
+};
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char *skipBlanks(const char *p, const char *end)
+{
+    while (p < end && isBlank(*p)) p++;
+    return p;
+}
+
+static inline bool isKeyword(const char *p, const char *end, const char *keyword, int length)
+{
+    return end - p > length && !memcmp(p, keyword, length) && isBlank(p[length]);
+}
+
+static const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Locale independent and without strtod()'s allocations and checks; exact for the up to 7 significant digits that
+// OBJ exporters write, within a unit in the last place otherwise
+static const char *parseFloat(const char *p, const char *end, float &value)
+{
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool negative = false;
+
+    p = skipBlanks(p, end);
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    const char *start = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;                                             // leading zeros do not count
+        }
+        else {
+            exponent++;                                                         // digits beyond the precision of the mantissa
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (p == start) return NULL;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int e = 0;
+        bool negativeExponent = false;
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (e < 1000) e = e * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0) result = exponent >= -22 ? result / powersOf10[-exponent] : result * pow(10.0, exponent);
+    else if (exponent > 0) result = exponent <= 22 ? result * powersOf10[exponent] : result * pow(10.0, exponent);
+    value = (float)(negative ? -result : result);
+    return p;
+}
+
+static const char *parseInt(const char *p, const char *end, int &value)
+{
+    bool negative = false;
+    int result = 0;
+
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    const char *start = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        result = result * 10 + (*p - '0');
+    }
+    if (p == start) return NULL;
+    value = negative ? -result : result;
+    return p;
+}
+
+static std::string restOfLine(const char *p, const char *end)
+{
+    p = skipBlanks(p, end);
+    while (end > p && isBlank(end[-1])) end--;
+    return std::string(p, end - p);
+}
+
+static std::string directoryOf(const char *fileName)
+{
+    const char *slash = strrchr(fileName, '/');
+    const char *backslash = strrchr(fileName, '\\');
+    if (backslash > slash) slash = backslash;
+    return slash ? std::string(fileName, slash + 1 - fileName) : std::string();
+}
+
+// Reads the newmtl / map_Kd pairs of a material library; options in front of the file name are skipped
+static void loadMaterialLibrary(const std::string &fileName, const std::string &directory,
+                                std::map<std::string, std::string> &textures)
+{
+    MappedFile file;
+    std::string material;
+
+    if (!file.open(fileName.c_str())) {
+        qDebug() << "Error opening file " << fileName.c_str();
+        return;
+    }
+    const char *p = (const char *)file.data, *end = p + file.size;
+    while (p < end) {
+        const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+        if (lineEnd == NULL) lineEnd = end;
+        const char *q = skipBlanks(p, lineEnd);
+
+        if (isKeyword(q, lineEnd, "newmtl", 6)) {
+            material = restOfLine(q + 6, lineEnd);
+        }
+        else if (isKeyword(q, lineEnd, "map_Kd", 6) && !material.empty()) {
+            std::string arguments = restOfLine(q + 6, lineEnd);
+            size_t last = arguments.find_last_of(" \t");
+            textures[material] = directory + (last == std::string::npos ? arguments : arguments.substr(last + 1));
+        }
+        p = lineEnd + 1;
+    }
+}
+
+static int countFaceCorners(const char *p, const char *end)
+{
+    int corners = 0;
+
+    for (;;) {
+        p = skipBlanks(p, end);
+        if (p >= end || *p == '#') return corners;
+        corners++;
+        while (p < end && !isBlank(*p)) p++;
+    }
+}
+
+static void countChunk(TObjChunk &chunk, std::vector<std::string> &libraries)
+{
+    const char *p = chunk.begin;
+
+    while (p < chunk.end) {
+        const char *lineEnd = (const char *)memchr(p, '\n', chunk.end - p);
+        if (lineEnd == NULL) lineEnd = chunk.end;
+        const char *q = skipBlanks(p, lineEnd);
+
+        if (isKeyword(q, lineEnd, "v", 1)) {
+            chunk.positions++;
+        }
+        else if (isKeyword(q, lineEnd, "vt", 2)) {
+            chunk.texcoords++;
+        }
+        else if (isKeyword(q, lineEnd, "f", 1)) {
+            int corners = countFaceCorners(q + 1, lineEnd);
+            if (corners >= 3) chunk.triangles += corners - 2;
+        }
+        else if (isKeyword(q, lineEnd, "usemtl", 6)) {
+            chunk.usedMaterials.push_back(restOfLine(q + 6, lineEnd));
+        }
+        else if (isKeyword(q, lineEnd, "mtllib", 6)) {
+            libraries.push_back(restOfLine(q + 6, lineEnd));
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Resolves a 1-based or negative (relative) OBJ index to a 0-based one, -1 when it is out of range
+static inline int resolveIndex(int index, int defined, int total)
+{
+    if (index > 0 && index <= total) return index - 1;
+    if (index < 0 && defined + index >= 0) return defined + index;
+    return -1;
+}
+
+static void parseChunk(TObjChunk &chunk, TMeshImport &import, std::vector<int> &texcoordIndices,
+                       std::vector<float> &texcoordU, std::vector<float> &texcoordV)
+{
+    TMesh &mesh = import.mesh;
+    int position = chunk.positionBase, texcoord = chunk.texcoordBase, triangle = chunk.triangleBase;
+    int totalPositions = mesh.vertexCount(), totalTexcoords = (int)texcoordU.size();
+    int material = chunk.startMaterial, used = 0;
+    int corner[3], cornerTexcoord[3];
+    const char *p = chunk.begin;
+
+    while (p < chunk.end) {
+        const char *lineEnd = (const char *)memchr(p, '\n', chunk.end - p);
+        if (lineEnd == NULL) lineEnd = chunk.end;
+        const char *q = skipBlanks(p, lineEnd);
+
+        if (isKeyword(q, lineEnd, "v", 1)) {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            if (!(q = parseFloat(q + 1, lineEnd, x)) || !(q = parseFloat(q, lineEnd, y)) ||
+                !(q = parseFloat(q, lineEnd, z))) {
+                chunk.failed = true;
+                return;
+            }
+            mesh.x[position] = x;
+            mesh.y[position] = y;
+            mesh.z[position] = -z;
+            position++;
+        }
+        else if (isKeyword(q, lineEnd, "vt", 2)) {
+            float u = 0.0f, v = 0.0f;
+            if (!(q = parseFloat(q + 2, lineEnd, u))) {
+                chunk.failed = true;
+                return;
+            }
+            parseFloat(q, lineEnd, v);                                          // v is optional
+            texcoordU[texcoord] = u;
+            texcoordV[texcoord] = 1.0f - v;
+            texcoord++;
+        }
+        else if (isKeyword(q, lineEnd, "f", 1)) {
+            int n = 0;
+            q++;
+            for (;;) {
+                int index, uv = 0;
+                q = skipBlanks(q, lineEnd);
+                if (q >= lineEnd || *q == '#') break;
+                if (!(q = parseInt(q, lineEnd, index))) {
+                    chunk.failed = true;
+                    return;
+                }
+                if (q < lineEnd && *q == '/') {                                 // v/vt, v//vn or v/vt/vn
+                    q++;
+                    if (q < lineEnd && *q != '/' && !(q = parseInt(q, lineEnd, uv))) {
+                        chunk.failed = true;
+                        return;
+                    }
+                    while (q < lineEnd && !isBlank(*q)) q++;                    // the normal is not used
+                }
+                int v = resolveIndex(index, position, totalPositions);
+                int t = uv ? resolveIndex(uv, texcoord, totalTexcoords) : -1;
+                if (v < 0 || (uv && t < 0)) {
+                    chunk.failed = true;
+                    return;
+                }
+                if (n < 2) {
+                    corner[n] = v;
+                    cornerTexcoord[n] = t;
+                }
+                else {                                                          // fan around the first corner
+                    corner[2] = v;
+                    cornerTexcoord[2] = t;
+                    memcpy(&mesh.indices[triangle * 3], corner, sizeof(corner));
+                    memcpy(&texcoordIndices[triangle * 3], cornerTexcoord, sizeof(cornerTexcoord));
+                    import.materials[triangle] = material;
+                    triangle++;
+                    corner[1] = corner[2];
+                    cornerTexcoord[1] = cornerTexcoord[2];
+                }
+                n++;
+            }
+        }
+        else if (isKeyword(q, lineEnd, "usemtl", 6)) {
+            material = chunk.usedMaterialIndex[used++];
+        }
+        p = lineEnd + 1;
+    }
+}
+
+bool MeshLoader::loadOBJ(const char *fileName, TMeshImport &import, ThreadPool *pool)
+{
+    MappedFile file;
+    std::vector<TObjChunk> chunks;
+    std::vector<std::string> libraries;
+    std::vector<int> texcoordIndices;
+    std::vector<float> texcoordU, texcoordV;
+    size_t i;
+
+    if (!file.open(fileName)) {
+        qDebug() << "Error opening file " << fileName;
+        return false;
+    }
+
+    const char *text = (const char *)file.data, *end = text + file.size;
+    for (const char *p = text; p < end; ) {                                     // chunks end after a line break
+        const char *chunkEnd = end - p > OBJ_CHUNK_SIZE ? p + OBJ_CHUNK_SIZE : end;
+        const char *lineEnd = (const char *)memchr(chunkEnd - 1, '\n', end - (chunkEnd - 1));
+        chunkEnd = lineEnd ? lineEnd + 1 : end;
+        TObjChunk chunk = {};
+        chunk.begin = p;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+        p = chunkEnd;
+    }
+
+    std::vector<std::vector<std::string>> chunkLibraries(chunks.size());
+    auto count = [&](int index) { countChunk(chunks[index], chunkLibraries[index]); };
+    if (pool) pool->parallelFor((int)chunks.size(), count);
+    else for (i=0; i<chunks.size(); i++) count((int)i);
+
+    // Place every chunk in the output and number the materials in the order they are first used
+    std::map<std::string, int> materialIndex;
+    std::vector<std::string> materialNames;
+    int positions = 0, texcoords = 0, triangles = 0, material = -1;
+    for (i=0; i<chunks.size(); i++) {
+        TObjChunk &chunk = chunks[i];
+        chunk.positionBase = positions;
+        chunk.texcoordBase = texcoords;
+        chunk.triangleBase = triangles;
+        chunk.startMaterial = material;
+        positions += chunk.positions;
+        texcoords += chunk.texcoords;
+        triangles += chunk.triangles;
+        for (const std::string &name : chunk.usedMaterials) {
+            auto found = materialIndex.find(name);
+            if (found == materialIndex.end()) {
+                found = materialIndex.insert(std::make_pair(name, (int)materialNames.size())).first;
+                materialNames.push_back(name);
+            }
+            material = found->second;
+            chunk.usedMaterialIndex.push_back(material);
+        }
+        libraries.insert(libraries.end(), chunkLibraries[i].begin(), chunkLibraries[i].end());
+    }
+
+    TMesh &mesh = import.mesh;
+    mesh = TMesh();
+    mesh.x.resize(positions);
+    mesh.y.resize(positions);
+    mesh.z.resize(positions);
+    mesh.indices.resize(triangles * 3);
+    mesh.u.resize(triangles * 3);
+    mesh.v.resize(triangles * 3);
+    import.materials.resize(triangles);
+    texcoordIndices.resize(triangles * 3);
+    texcoordU.resize(texcoords);
+    texcoordV.resize(texcoords);
+
+    auto parse = [&](int index) { parseChunk(chunks[index], import, texcoordIndices, texcoordU, texcoordV); };
+    if (pool) pool->parallelFor((int)chunks.size(), parse);
+    else for (i=0; i<chunks.size(); i++) parse((int)i);
+
+    for (i=0; i<chunks.size(); i++) {
+        if (chunks[i].failed) {
+            qDebug() << "Not a valid OBJ file " << fileName;
+            return false;
+        }
+    }
+
+    // Texture coordinates may be defined after the faces using them, so they are looked up once everything is read
+    for (i=0; i<texcoordIndices.size(); i++) {
+        int t = texcoordIndices[i];
+        mesh.u[i] = t >= 0 ? texcoordU[t] : 0.0f;
+        mesh.v[i] = t >= 0 ? texcoordV[t] : 0.0f;
+    }
+
+    std::map<std::string, std::string> textures;
+    std::string directory = directoryOf(fileName);
+    for (const std::string &library : libraries) {
+        loadMaterialLibrary(directory + library, directory, textures);
+    }
+    import.textures.clear();
+    for (const std::string &name : materialNames) {
+        auto found = textures.find(name);
+        import.textures.push_back(found == textures.end() ? std::string() : found->second);
+    }
+    return true;
+}
+
+static inline size_t alignCache(size_t offset)
+{
+    return (offset + MESH_CACHE_ALIGN - 1) & ~(size_t)(MESH_CACHE_ALIGN - 1);
+}
+
+// Layout of the arrays behind the header: x, y, z, indices, u, v, materials, then the texture names
+static void cacheLayout(uint32_t vertexCount, uint32_t triangleCount, size_t offsets[8], size_t sizes[7])
+{
+    size_t offset = alignCache(sizeof(TMeshCacheHeader));
+    int i;
+
+    sizes[0] = sizes[1] = sizes[2] = (size_t)vertexCount * sizeof(float);
+    sizes[3] = (size_t)triangleCount * 3 * sizeof(int32_t);
+    sizes[4] = sizes[5] = (size_t)triangleCount * 3 * sizeof(float);
+    sizes[6] = (size_t)triangleCount * sizeof(int32_t);
+    for (i=0; i<7; i++) {
+        offsets[i] = offset;
+        offset = alignCache(offset + sizes[i]);
+    }
+    offsets[7] = offset;
+}
+
+bool MeshLoader::saveCache(const char *fileName, const TMeshImport &import, uint64_t sourceSize, int64_t sourceTime)
+{
+    const TMesh &mesh = import.mesh;
+    TMeshCacheHeader header = {};
+    size_t offsets[8], sizes[7];
+    static const char padding[MESH_CACHE_ALIGN] = { 0 };
+    int i;
+
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexCount = (uint32_t)mesh.vertexCount();
+    header.triangleCount = (uint32_t)(mesh.indices.size() / 3);
+    header.materialCount = (uint32_t)import.textures.size();
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    cacheLayout(header.vertexCount, header.triangleCount, offsets, sizes);
+
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL) return false;
+
+    const void *arrays[7] = { mesh.x.data(), mesh.y.data(), mesh.z.data(), mesh.indices.data(), mesh.u.data(),
+                              mesh.v.data(), import.materials.data() };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    size_t written = sizeof(header);
+    for (i=0; i<7 && ok; i++) {                                                 // padding up to the array, then the array
+        ok = fwrite(padding, 1, offsets[i] - written, file) == offsets[i] - written &&
+             (sizes[i] == 0 || fwrite(arrays[i], 1, sizes[i], file) == sizes[i]);
+        written = offsets[i] + sizes[i];
+    }
+    ok = ok && fwrite(padding, 1, offsets[7] - written, file) == offsets[7] - written;
+    for (const std::string &name : import.textures) {
+        uint32_t length = (uint32_t)name.size();
+        ok = ok && fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(name.data(), 1, length, file) == length;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) remove(fileName);                                                  // never leave a truncated cache behind
+    return ok;
+}
+
+bool MeshLoader::loadCache(const char *fileName, TMeshImport &import, uint64_t *sourceSize, int64_t *sourceTime)
+{
+    MappedFile file;
+    TMeshCacheHeader header;
+    size_t offsets[8], sizes[7];
+    uint32_t i;
+
+    if (!file.open(fileName)) return false;
+    if (file.size < sizeof(header)) return false;
+    memcpy(&header, file.data, sizeof(header));
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION) return false;
+    if (header.vertexCount > (1u << 28) || header.triangleCount > (1u << 28)) return false;
+    cacheLayout(header.vertexCount, header.triangleCount, offsets, sizes);
+    if (file.size < offsets[7]) return false;
+
+    TMesh &mesh = import.mesh;
+    const float *x = (const float *)(file.data + offsets[0]);
+    const float *y = (const float *)(file.data + offsets[1]);
+    const float *z = (const float *)(file.data + offsets[2]);
+    const int32_t *indices = (const int32_t *)(file.data + offsets[3]);
+    const float *u = (const float *)(file.data + offsets[4]);
+    const float *v = (const float *)(file.data + offsets[5]);
+    const int32_t *materials = (const int32_t *)(file.data + offsets[6]);
+    uint32_t corners = header.triangleCount * 3;
+
+    for (i=0; i<corners; i++) {                                                 // a damaged cache must not crash the renderer
+        if ((uint32_t)indices[i] >= header.vertexCount) return false;
+    }
+    for (i=0; i<header.triangleCount; i++) {
+        if (materials[i] < -1 || materials[i] >= (int32_t)header.materialCount) return false;
+    }
+
+    std::vector<std::string> textures;
+    size_t offset = offsets[7];
+    for (i=0; i<header.materialCount; i++) {
+        uint32_t length;
+        if (file.size - offset < sizeof(length)) return false;
+        memcpy(&length, file.data + offset, sizeof(length));
+        offset += sizeof(length);
+        if (file.size - offset < length) return false;
+        textures.push_back(std::string((const char *)file.data + offset, length));
+        offset += length;
+    }
+
+    mesh = TMesh();
+    mesh.x.assign(x, x + header.vertexCount);
+    mesh.y.assign(y, y + header.vertexCount);
+    mesh.z.assign(z, z + header.vertexCount);
+    mesh.indices.assign(indices, indices + corners);
+    mesh.u.assign(u, u + corners);
+    mesh.v.assign(v, v + corners);
+    import.materials.assign(materials, materials + header.triangleCount);
+    import.textures.swap(textures);
+    if (sourceSize) *sourceSize = header.sourceSize;
+    if (sourceTime) *sourceTime = header.sourceTime;
+    return true;
+}
+
+bool MeshLoader::load(const char *fileName, TMesh &mesh, TextureManager *textureManager, ThreadPool *pool)
+{
+    TMeshImport import;
+    struct stat source;
+    uint64_t cachedSize;
+    int64_t cachedTime;
+    std::string cacheName = std::string(fileName) + ".mesh";
+    size_t i;
+
+    bool haveSource = stat(fileName, &source) == 0;
+    bool cached = loadCache(cacheName.c_str(), import, &cachedSize, &cachedTime);
+    if (cached && haveSource && (cachedSize != (uint64_t)source.st_size || cachedTime != (int64_t)source.st_mtime)) {
+        cached = false;                                                         // the OBJ file has changed since
+    }
+    if (!cached) {
+        if (!loadOBJ(fileName, import, pool)) return false;
+        if (!saveCache(cacheName.c_str(), import, (uint64_t)source.st_size, (int64_t)source.st_mtime)) {
+            qDebug() << "Can not write the mesh cache " << cacheName.c_str();
+        }
+    }
+
+    std::vector<TTextureHandle> handles;
+    for (const std::string &name : import.textures) {
+        handles.push_back(textureManager && !name.empty() ? textureManager->load(name.c_str(), WRAP_REPEAT) : NO_TEXTURE);
+    }
+    mesh = std::move(import.mesh);
+    mesh.textures.resize(import.materials.size());
+    for (i=0; i<import.materials.size(); i++) {
+        mesh.textures[i] = import.materials[i] >= 0 ? handles[import.materials[i]] : NO_TEXTURE;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "texturemanager.h"
+#include "threadpool.h"
+
+// A mesh as imported, before its textures are handed to a TextureManager
+struct TMeshImport
+{
+    TMesh mesh;                                                                 // textures left empty
+    std::vector<std::string> textures;                                          // file of every material, "" - none
+    std::vector<int32_t> materials;                                             // material of every triangle, -1 - none
+};
+
+class MeshLoader
+{
+public:
+    // Loads a mesh through its binary cache: fileName + ".mesh" is used when it was written for the current size and
+    // modification time of fileName, otherwise the OBJ file is parsed and the cache (re)written next to it. Textures
+    // of the materials are queued on textureManager (which may be NULL) with WRAP_REPEAT.
+    static bool load(const char *fileName, TMesh &mesh, TextureManager *textureManager, ThreadPool *pool = NULL);
+
+    // Parses positions, texture coordinates, faces (fanned into triangles) and the map_Kd textures of the materials
+    // of a Wavefront OBJ file. The text is split into chunks at line breaks which are counted and then parsed on the
+    // pool, straight into the final arrays. Positions are mirrored in z and texture coordinates in v, to turn the
+    // right-handed, counter-clockwise, bottom-up OBJ conventions into the ones of this renderer.
+    static bool loadOBJ(const char *fileName, TMeshImport &import, ThreadPool *pool = NULL);
+
+    // The binary cache: a header and the arrays of the mesh as they are in memory, read back with one copy per array
+    static bool saveCache(const char *fileName, const TMeshImport &import, uint64_t sourceSize = 0,
+                          int64_t sourceTime = 0);
+    static bool loadCache(const char *fileName, TMeshImport &import, uint64_t *sourceSize = NULL,
+                          int64_t *sourceTime = NULL);
+};
+
+#endif // MESHLOADER_H
@@ -0,0 +1,222 @@
+#include <math.h>
+#include <algorithm>
+#include "primitiveassembler.h"
+#include "profiler.h"
+
+enum {
+    PLANE_NEAR,
+    PLANE_FAR,
+    PLANE_LEFT,
+    PLANE_RIGHT,
+    PLANE_TOP,
+    PLANE_BOTTOM,
+    PLANE_COUNT
+};
+
+#define MAX_CLIPPED_VERTICES    (3 + PLANE_COUNT)                               // every plane adds at most one corner
+
+PrimitiveAssembler::PrimitiveAssembler()
+{
+    mode = CULL_BACK;
+    drawFlags = 0;
+    zNear = 0.1f;
+    zFar = 1000.0f;
+    setViewport(1, 1, 1.0f);
+}
+
+void PrimitiveAssembler::setViewport(int width, int height, float depthRange)
+{
+    this->width = width;
+    this->height = height;
+    this->depthRange = depthRange;
+    guardX = 1.0f + 2.0f * GUARD_BAND / width;
+    guardY = 1.0f + 2.0f * GUARD_BAND / height;
+}
+
+void PrimitiveAssembler::setDepthPlanes(float zNear, float zFar)
+{
+    this->zNear = zNear;
+    this->zFar = zFar;
+}
+
+void PrimitiveAssembler::project(TVertexCache &cache) const
+{
+    projectVertices(cache, width, height, depthRange);
+}
+
+// The rectangle around the eight corners of the box on the screen, a pixel wider on every side for rounding, or the
+// whole viewport when a corner lies behind the near plane. Whatever a mesh inside the box draws falls within it.
+TRect PrimitiveAssembler::screenBounds(const TBounds &b, const TMat4x4 &viewProjection) const
+{
+    const TMat4x4 &m = viewProjection;
+    TRect viewport = { 0, 0, width, height };
+    float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+    int i;
+
+    for (i=0; i<8; i++) {
+        float x = (i & 1) ? b.maxX : b.minX, y = (i & 2) ? b.maxY : b.minY, z = (i & 4) ? b.maxZ : b.minZ;
+        float w = x * m.m[0][3] + y * m.m[1][3] + z * m.m[2][3] + m.m[3][3];
+        if (w < zNear) return viewport;
+
+        float sx = ((x * m.m[0][0] + y * m.m[1][0] + z * m.m[2][0] + m.m[3][0]) / w + 1.0f) * (0.5f * width);
+        float sy = ((x * m.m[0][1] + y * m.m[1][1] + z * m.m[2][1] + m.m[3][1]) / w + 1.0f) * (0.5f * height);
+        if (i == 0 || sx < minX) minX = sx;
+        if (i == 0 || sx > maxX) maxX = sx;
+        if (i == 0 || sy < minY) minY = sy;
+        if (i == 0 || sy > maxY) maxY = sy;
+    }
+
+    minX = std::max(minX, -1.0f);                                               // far off the screen, keep the ints small
+    minY = std::max(minY, -1.0f);
+    maxX = std::min(maxX, (float)width + 1.0f);
+    maxY = std::min(maxY, (float)height + 1.0f);
+    TRect r = { (int)floorf(minX) - 1, (int)floorf(minY) - 1, (int)ceilf(maxX) + 2, (int)ceilf(maxY) + 2 };
+    return intersectRects(r, viewport);
+}
+
+// Signed distance of a clip space position from a plane, positive inside. The projection puts the distance from
+// the camera into w, so the near and far planes are tested there.
+float PrimitiveAssembler::planeDistance(const TClipVertex &v, int plane) const
+{
+    switch (plane) {
+    case PLANE_NEAR:    return v.w - zNear;
+    case PLANE_FAR:     return zFar - v.w;
+    case PLANE_LEFT:    return v.x + guardX * v.w;
+    case PLANE_RIGHT:   return guardX * v.w - v.x;
+    case PLANE_TOP:     return v.y + guardY * v.w;
+    default:            return guardY * v.w - v.y;
+    }
+}
+
+// Sutherland-Hodgman clipping of a convex polygon against the planes whose bits are set. Attributes are interpolated
+// before the perspective divide, which keeps them perspective correct. Returns the number of corners left in polygon.
+int PrimitiveAssembler::clipPolygon(TClipVertex *polygon, int count, int planes, TClipVertex *scratch) const
+{
+    int plane, i;
+
+    for (plane=0; plane<PLANE_COUNT && count>=3; plane++) {
+        if (!(planes & (1 << plane))) continue;
+
+        int clipped = 0;
+        for (i=0; i<count; i++) {
+            const TClipVertex &a = polygon[i];
+            const TClipVertex &b = polygon[(i + 1) % count];
+            float da = planeDistance(a, plane);
+            float db = planeDistance(b, plane);
+
+            if (da >= 0.0f) scratch[clipped++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {                                 // the edge crosses the plane
+                float t = da / (da - db);
+                TClipVertex &o = scratch[clipped++];
+                o.x = a.x + t * (b.x - a.x);
+                o.y = a.y + t * (b.y - a.y);
+                o.z = a.z + t * (b.z - a.z);
+                o.w = a.w + t * (b.w - a.w);
+                o.u = a.u + t * (b.u - a.u);
+                o.v = a.v + t * (b.v - a.v);
+            }
+        }
+        for (i=0; i<clipped; i++) polygon[i] = scratch[i];
+        count = clipped;
+    }
+    return count;
+}
+
+bool PrimitiveAssembler::isCulled(const TVertex &a, const TVertex &b, const TVertex &c) const
+{
+    float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);         // twice the signed area, y goes down
+
+    if (area == 0.0f) return true;
+    if (mode == CULL_BACK) return area < 0.0f;
+    if (mode == CULL_FRONT) return area > 0.0f;
+    return false;
+}
+
+// Same arithmetic as projectVertices(), so corners which were not clipped land exactly where they would without it
+void PrimitiveAssembler::toScreen(const TClipVertex &c, TVertex &v) const
+{
+    v.x = (c.x / c.w + 1.0f) * (0.5f * width);
+    v.y = (c.y / c.w + 1.0f) * (0.5f * height);
+    v.z = c.z / c.w * (0.5f * depthRange);
+    v.u = c.u;
+    v.v = c.v;
+    v.w = (c.w > 0.0f) ? 1.0f / c.w : 0.0f;
+}
+
+void PrimitiveAssembler::submit(const TMesh &mesh, const TVertexCache &cache, TextureManager *textureManager,
+                                TileRenderer *renderer, int baseVertex, TTextureHandle texture)
+{
+    TClipVertex polygon[MAX_CLIPPED_VERTICES], scratch[MAX_CLIPPED_VERTICES];
+    TTriangle triangle;
+    TTextureHandle cachedHandle = NO_TEXTURE;
+    Texture *cached = NULL;
+    int i, c;
+    PROFILE_STAGE(STAGE_ASSEMBLY);
+
+    triangle.color = 0;
+    triangle.flags = drawFlags;
+
+    // Faces of one texture come in runs, so the manager and its lock are asked once a run, a replacement only once
+    auto resolve = [&](int face) {
+        TTextureHandle handle = (texture != NO_TEXTURE) ? texture : mesh.textures[face];
+        if (cached == NULL || handle != cachedHandle) {
+            cached = textureManager->texture(handle);
+            cachedHandle = handle;
+        }
+        return cached;
+    };
+
+    int count = mesh.vertexCount();
+    outcodes.resize(count);
+    for (i=0; i<count; i++) {                                                   // once per vertex, not per corner
+        int k = baseVertex + i;
+        TClipVertex v = { cache.x[k], cache.y[k], cache.z[k], cache.w[k], 0.0f, 0.0f };
+        int code = 0;
+        for (int plane=0; plane<PLANE_COUNT; plane++) {
+            if (planeDistance(v, plane) < 0.0f) code |= 1 << plane;
+        }
+        outcodes[i] = (uint8_t)code;
+    }
+
+    for (i=0; i<mesh.triangleCount(); i++) {
+        const int *index = &mesh.indices[i * 3];
+        int outside = outcodes[index[0]] | outcodes[index[1]] | outcodes[index[2]];
+
+        PROFILE_COUNT(COUNTER_TRIANGLES_ASSEMBLED, 1);
+        if (outcodes[index[0]] & outcodes[index[1]] & outcodes[index[2]]) {     // all corners beyond one plane
+            PROFILE_COUNT(COUNTER_TRIANGLES_CULLED, 1);
+            continue;
+        }
+
+        if (outside == 0) {                                                     // the common case, nothing to clip
+            assembleTriangle(mesh, cache, i, triangle, baseVertex);
+            if (isCulled(triangle.V1, triangle.V2, triangle.V3)) {
+                PROFILE_COUNT(COUNTER_TRIANGLES_BACKFACING, 1);
+                continue;
+            }
+            triangle.texture = resolve(i);
+            renderer->submit(triangle);
+            continue;
+        }
+
+        PROFILE_COUNT(COUNTER_TRIANGLES_CLIPPED, 1);
+        for (c=0; c<3; c++) {
+            int corner = i * 3 + c;
+            int k = baseVertex + index[c];
+            polygon[c] = { cache.x[k], cache.y[k], cache.z[k], cache.w[k], mesh.u[corner], mesh.v[corner] };
+        }
+        int corners = clipPolygon(polygon, 3, outside, scratch);
+        if (corners < 3) continue;
+
+        Texture *resolved = NULL;
+        toScreen(polygon[0], triangle.V1);
+        for (c=1; c+1<corners; c++) {
+            toScreen(polygon[c], triangle.V2);
+            toScreen(polygon[c + 1], triangle.V3);
+            if (isCulled(triangle.V1, triangle.V2, triangle.V3)) continue;       // also drops slivers of zero area
+            if (resolved == NULL) resolved = resolve(i);
+            triangle.texture = resolved;
+            renderer->submit(triangle);
+        }
+    }
+}
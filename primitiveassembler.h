@@ -0,0 +1,69 @@
+#ifndef PRIMITIVEASSEMBLER_H
+#define PRIMITIVEASSEMBLER_H
+
+#include <stdint.h>
+#include <vector>
+#include "mesh.h"
+#include "texturemanager.h"
+#include "tilerenderer.h"
+
+#define GUARD_BAND  1024                                                        // pixels beyond every edge of the viewport
+
+enum TCullMode {
+    CULL_NONE,
+    CULL_BACK,                                                                  // faces wound clockwise on the screen
+    CULL_FRONT
+};
+
+// Primitive assembly between the vertex stage and the tile renderer. Triangles are built from the post-transform
+// cache of a mesh and
+//   - rejected at once when all three corners are outside the same clipping plane,
+//   - clipped in homogeneous space against the near and far planes (as distances along w) and against a guard band
+//     of GUARD_BAND pixels around the viewport, so the rasterizers only ever see corners in front of the camera and
+//     no more than GUARD_BAND pixels off the viewport; anything inside the guard band is left to their scissor
+//     rectangles,
+//   - culled when their area on the screen is zero or when they face away (see setCullMode()).
+// The pieces of a clipped triangle are submitted as a fan.
+class PrimitiveAssembler
+{
+public:
+    PrimitiveAssembler();
+
+    void setViewport(int width, int height, float depthRange);                 // must match projectVertices()
+    void setDepthPlanes(float zNear, float zFar);
+    float nearPlane() const { return zNear; }
+    float farPlane() const { return zFar; }
+    TCullMode cullMode() const { return mode; }
+    void setCullMode(TCullMode mode) { this->mode = mode; }
+    void setDrawFlags(uint32_t flags) { drawFlags = flags; }                   // TDrawFlags of every triangle submitted
+
+    void project(TVertexCache &cache) const;                                    // projectVertices() into this viewport
+    TRect screenBounds(const TBounds &bounds, const TMat4x4 &viewProjection) const;    // of a world space box, may be empty
+    // The mesh's positions start at baseVertex in the cache; a texture other than NO_TEXTURE replaces the mesh's own
+    void submit(const TMesh &mesh, const TVertexCache &cache, TextureManager *textureManager, TileRenderer *renderer,
+                int baseVertex = 0, TTextureHandle texture = NO_TEXTURE);
+
+private:
+    struct TClipVertex {
+        float x, y, z, w;
+        float u, v;
+    };
+
+    TCullMode mode;
+    uint32_t drawFlags;
+    int width;
+    int height;
+    float depthRange;
+    float zNear;
+    float zFar;
+    float guardX;                                                               // the guard band in clip space units of w
+    float guardY;
+    std::vector<uint8_t> outcodes;
+
+    float planeDistance(const TClipVertex &v, int plane) const;
+    int clipPolygon(TClipVertex *polygon, int count, int planes, TClipVertex *scratch) const;
+    bool isCulled(const TVertex &a, const TVertex &b, const TVertex &c) const;
+    void toScreen(const TClipVertex &c, TVertex &v) const;
+};
+
+#endif // PRIMITIVEASSEMBLER_H
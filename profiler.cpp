@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <QPainter>
+#include "profiler.h"
+
+struct TTraceEvent {
+    TProfileStage stage;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct TThreadProfile {
+    uint64_t counters[COUNTER_COUNT];
+    uint64_t stageTime[STAGE_COUNT];                                            // nanoseconds
+    std::vector<TTraceEvent> events;
+    int index;
+};
+
+static const char *stageNames[STAGE_COUNT] = {
+    "frame", "scene", "culling", "transform", "projection", "assembly", "binning", "rasterize", "tile", "setup", "spans",
+    "resolve", "present"
+};
+
+static const bool stageTraced[STAGE_COUNT] = {                                  // the per triangle stages would swamp a trace
+    true, true, true, false, false, true, false, true, true, false, false, true, true
+};
+
+static const char *counterNames[COUNTER_COUNT] = {
+    "objects visible", "objects culled", "triangles assembled", "triangles backfacing", "triangles clipped",
+    "triangles submitted", "triangles culled", "triangles occluded", "triangles rasterized", "triangles to scanline",
+    "fragments tested", "fragments passed", "pixels redrawn", "pixels covered", "texels fetched",
+    "frames dropped", "heap allocations"
+};
+
+static std::mutex profileLock;
+static std::vector<std::unique_ptr<TThreadProfile>> threadProfiles;
+static thread_local TThreadProfile *threadProfile = NULL;
+static std::atomic<bool> capturing(false);
+static bool overlay = false;
+static uint64_t captureStart = 0;
+static uint64_t lastFrameEnd = 0;
+static std::vector<TProfileFrame> history;                                      // ring of the last PROFILE_HISTORY frames
+static int historyNext = 0;
+static std::atomic<uint64_t> heapAllocations(0);                                // kept apart from the thread records,
+static uint64_t lastHeapAllocations = 0;                                        // which are allocated themselves
+
+static TThreadProfile *currentThread()
+{
+    if (threadProfile == NULL) {
+        std::lock_guard<std::mutex> guard(profileLock);
+        threadProfiles.emplace_back(new TThreadProfile());
+        threadProfile = threadProfiles.back().get();
+        threadProfile->index = (int)threadProfiles.size() - 1;
+    }
+    return threadProfile;
+}
+
+void Profiler::count(TProfileCounter counter, uint64_t n)
+{
+    currentThread()->counters[counter] += n;
+}
+
+void Profiler::countAllocation()
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::allocations()
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+#if defined(TEXTURING_PROFILE)
+// Counts every allocation made with new (new[] and the nothrow forms end up here as well), so a frame loop that is
+// meant to run out of retained buffers can be checked to make none
+void *operator new(size_t size)
+{
+    Profiler::countAllocation();
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+#endif
+
+uint64_t Profiler::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::addStage(TProfileStage stage, uint64_t start, uint64_t end)
+{
+    TThreadProfile *profile = currentThread();
+
+    profile->stageTime[stage] += end - start;
+    if (stageTraced[stage] && capturing.load(std::memory_order_relaxed) && profile->events.size() < PROFILE_MAX_EVENTS) {
+        profile->events.push_back({ stage, start, end });
+    }
+}
+
+void Profiler::endFrame()
+{
+    TProfileFrame frame = {};
+    int i;
+    uint64_t t = now();
+
+    std::lock_guard<std::mutex> guard(profileLock);
+    for (auto &profile : threadProfiles) {
+        for (i=0; i<COUNTER_COUNT; i++) {
+            frame.counters[i] += profile->counters[i];
+            profile->counters[i] = 0;
+        }
+        for (i=0; i<STAGE_COUNT; i++) {
+            frame.stageTime[i] += profile->stageTime[i] * 1e-6;
+            profile->stageTime[i] = 0;
+        }
+    }
+    uint64_t allocations = heapAllocations.load(std::memory_order_relaxed);
+    frame.counters[COUNTER_HEAP_ALLOCATIONS] = allocations - lastHeapAllocations;
+    lastHeapAllocations = allocations;
+    frame.frameTime = lastFrameEnd ? (t - lastFrameEnd) * 1e-6 : 0.0;
+    lastFrameEnd = t;
+
+    if (history.capacity() == 0) history.reserve(PROFILE_HISTORY);
+    if ((int)history.size() < PROFILE_HISTORY) {
+        history.push_back(frame);
+    }
+    else {
+        history[historyNext] = frame;
+    }
+    historyNext = (historyNext + 1) % PROFILE_HISTORY;
+}
+
+TProfileFrame Profiler::lastFrame()
+{
+    std::lock_guard<std::mutex> guard(profileLock);
+    if (history.empty()) return TProfileFrame();
+    return history[(historyNext + PROFILE_HISTORY - 1) % PROFILE_HISTORY];
+}
+
+TProfileFrame Profiler::average()
+{
+    TProfileFrame sum = {};
+    int i;
+
+    std::lock_guard<std::mutex> guard(profileLock);
+    if (history.empty()) return sum;
+    for (const TProfileFrame &frame : history) {
+        for (i=0; i<COUNTER_COUNT; i++) sum.counters[i] += frame.counters[i];
+        for (i=0; i<STAGE_COUNT; i++) sum.stageTime[i] += frame.stageTime[i];
+        sum.frameTime += frame.frameTime;
+    }
+    for (i=0; i<COUNTER_COUNT; i++) sum.counters[i] /= history.size();
+    for (i=0; i<STAGE_COUNT; i++) sum.stageTime[i] /= history.size();
+    sum.frameTime /= history.size();
+    return sum;
+}
+
+std::string Profiler::summary()
+{
+    TProfileFrame frame = average();
+    char line[128];
+    std::string text;
+    int i;
+
+    snprintf(line, sizeof(line), "%-22s %10.2f ms %8.1f fps\n", "frame interval", frame.frameTime,
+             frame.frameTime > 0.0 ? 1000.0 / frame.frameTime : 0.0);
+    text += line;
+    for (i=0; i<COUNTER_COUNT; i++) {
+        snprintf(line, sizeof(line), "%-22s %10llu\n", counterNames[i], (unsigned long long)frame.counters[i]);
+        text += line;
+    }
+    uint64_t passed = frame.counters[COUNTER_FRAGMENTS_PASSED], covered = frame.counters[COUNTER_PIXELS_COVERED];
+    snprintf(line, sizeof(line), "%-22s %10llu\n", "fragments overdrawn", (unsigned long long)(passed > covered ? passed - covered : 0));
+    text += line;
+    for (i=0; i<STAGE_COUNT; i++) {
+        snprintf(line, sizeof(line), "%-22s %10.3f ms\n", stageNames[i], frame.stageTime[i]);
+        text += line;
+    }
+    return text;
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> guard(profileLock);
+    for (auto &profile : threadProfiles) {
+        memset(profile->counters, 0, sizeof(profile->counters));
+        memset(profile->stageTime, 0, sizeof(profile->stageTime));
+    }
+    history.clear();
+    historyNext = 0;
+    lastFrameEnd = 0;
+}
+
+void Profiler::setOverlay(bool enabled)
+{
+    overlay = enabled;
+}
+
+void Profiler::drawOverlay(QImage &image)
+{
+    size_t start, end;
+    int y = 14;
+
+    if (!overlay) return;
+
+    std::string text = summary();
+    int lines = (int)std::count(text.begin(), text.end(), '\n');
+    QPainter painter(&image);
+    painter.fillRect(QRect(4, 2, 300, 14 * lines + 4), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    for (start=0; start<text.size(); start=end+1) {
+        end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        painter.drawText(8, y, QString::fromStdString(text.substr(start, end - start)));
+        y += 14;
+    }
+}
+
+void Profiler::beginCapture()
+{
+    std::lock_guard<std::mutex> guard(profileLock);
+    for (auto &profile : threadProfiles) {
+        profile->events.clear();
+    }
+    captureStart = now();
+    capturing = true;
+}
+
+bool Profiler::writeTrace(const char *fileName)
+{
+    bool first = true;
+
+    capturing = false;
+    std::lock_guard<std::mutex> guard(profileLock);
+
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (auto &profile : threadProfiles) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                first ? "" : ",\n", profile->index, profile->index);
+        first = false;
+        for (const TTraceEvent &event : profile->events) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    stageNames[event.stage], profile->index, ((double)event.start - (double)captureStart) * 1e-3,
+                    (event.end - event.start) * 1e-3);
+        }
+        profile->events.clear();
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    return true;
+}
+
+const char *Profiler::stageName(TProfileStage stage)
+{
+    return stageNames[stage];
+}
+
+const char *Profiler::counterName(TProfileCounter counter)
+{
+    return counterNames[counter];
+}
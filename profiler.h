@@ -0,0 +1,140 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <string>
+#include <QImage>
+
+// Built-in instrumentation of the pipeline. Everything below is compiled out unless TEXTURING_PROFILE is defined
+// (qmake CONFIG+=texturing_profile): the macros then expand to nothing and no counter or timer touches the hot loops.
+//
+// Every thread counts into and times into its own record, endFrame() sums the records of all threads up into one
+// frame of statistics and keeps the last PROFILE_HISTORY frames for the rolling averages. Stages marked as traced
+// also leave an event per scope while a capture runs, which writeTrace() saves in the Chrome trace-event format
+// (chrome://tracing, Perfetto).
+//
+// COUNTER_HEAP_ALLOCATIONS is counted apart from the records: the profiling build replaces the global operator new,
+// which together with alignedAlloc() counts every allocation made by any thread between two frames.
+
+#define PROFILE_HISTORY     120                                                 // frames in the rolling statistics
+#define PROFILE_MAX_EVENTS  (1 << 20)                                           // trace events kept per thread
+
+enum TProfileCounter {
+    COUNTER_OBJECTS_VISIBLE,                                                    // scene graph nodes drawn
+    COUNTER_OBJECTS_CULLED,                                                     // outside the frustum, whole subtrees at once
+    COUNTER_TRIANGLES_ASSEMBLED,
+    COUNTER_TRIANGLES_BACKFACING,                                               // or of zero area
+    COUNTER_TRIANGLES_CLIPPED,
+    COUNTER_TRIANGLES_SUBMITTED,
+    COUNTER_TRIANGLES_CULLED,                                                   // outside the view, rejected before binning
+    COUNTER_TRIANGLES_OCCLUDED,                                                 // rejected by the depth pyramid, per tile
+    COUNTER_TRIANGLES_RASTERIZED,                                               // set up and walked, per tile
+    COUNTER_TRIANGLES_FALLBACK,                                                 // left by the edge rasterizer to drawTriangle()
+    COUNTER_FRAGMENTS_TESTED,
+    COUNTER_FRAGMENTS_PASSED,
+    COUNTER_PIXELS_REDRAWN,                                                     // cleared and drawn, all unless incremental
+    COUNTER_PIXELS_COVERED,                                                     // pixels written at least once
+    COUNTER_TEXELS_FETCHED,
+    COUNTER_FRAMES_DROPPED,                                                     // replaced by a newer one before presented
+    COUNTER_HEAP_ALLOCATIONS,                                                   // new and alignedAlloc(), on any thread
+    COUNTER_COUNT
+};
+
+enum TProfileStage {
+    STAGE_FRAME,
+    STAGE_SCENE,                                                                // everything the scene submits
+    STAGE_CULLING,                                                              // world transforms, BVH refit and traversal
+    STAGE_TRANSFORM,
+    STAGE_PROJECTION,
+    STAGE_ASSEMBLY,
+    STAGE_BINNING,
+    STAGE_RASTERIZE,                                                            // all tiles, as seen by the caller
+    STAGE_TILE,
+    STAGE_SETUP,                                                                // per triangle
+    STAGE_SPANS,                                                                // per triangle
+    STAGE_RESOLVE,                                                              // visibility buffer shading, per tile
+    STAGE_PRESENT,                                                              // handing the frame over to the GUI thread
+    STAGE_COUNT
+};
+
+struct TProfileFrame {
+    uint64_t counters[COUNTER_COUNT];
+    double stageTime[STAGE_COUNT];                                              // milliseconds, summed over all threads
+    double frameTime;                                                           // milliseconds from one endFrame() to the next
+};
+
+class Profiler
+{
+public:
+    static void count(TProfileCounter counter, uint64_t n);
+    static void countAllocation();                                              // safe to call from operator new
+    static uint64_t allocations();                                              // counted so far, 0 unless profiling
+    static uint64_t now();                                                      // nanoseconds
+    static void addStage(TProfileStage stage, uint64_t start, uint64_t end);
+
+    static void endFrame();                                                     // no other thread may be drawing meanwhile
+    static TProfileFrame lastFrame();
+    static TProfileFrame average();
+    static std::string summary();                                               // the averages, one line per counter and stage
+    static void reset();                                                        // forgets the history and the counts so far
+
+    static void setOverlay(bool enabled);
+    static void drawOverlay(QImage &image);
+
+    static void beginCapture();
+    static bool writeTrace(const char *fileName);                               // saves the captured events and ends the capture
+
+    static const char *stageName(TProfileStage stage);
+    static const char *counterName(TProfileCounter counter);
+};
+
+// Times the rest of the enclosing scope as one stage; next() closes it and starts another one at the same moment
+class ProfileScope
+{
+public:
+    explicit ProfileScope(TProfileStage stage) { this->stage = stage; running = true; start = Profiler::now(); }
+    ~ProfileScope() { stop(); }
+
+    void next(TProfileStage stage) { uint64_t t = Profiler::now(); close(t); this->stage = stage; start = t; running = true; }
+    void stop() { if (running) close(Profiler::now()); }
+
+private:
+    TProfileStage stage;
+    uint64_t start;
+    bool running;
+
+    void close(uint64_t t) { Profiler::addStage(stage, start, t); running = false; }
+};
+
+inline int profilePopcount(unsigned mask)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    int n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+#endif
+}
+
+#if defined(TEXTURING_PROFILE)
+#define PROFILE_ONLY(code)              code
+#define PROFILE_COUNT(counter, n)       Profiler::count(counter, (uint64_t)(n))
+#define PROFILE_STAGE(stage)            ProfileScope profileScope(stage)
+#define PROFILE_NEXT_STAGE(stage)       profileScope.next(stage)
+#define PROFILE_STOP()                  profileScope.stop()
+#define PROFILE_FRAME()                 Profiler::endFrame()
+#define PROFILE_FRAGMENTS(tested, passed, textured) \
+    do { PROFILE_COUNT(COUNTER_FRAGMENTS_TESTED, tested); PROFILE_COUNT(COUNTER_FRAGMENTS_PASSED, passed); \
+         PROFILE_COUNT(COUNTER_TEXELS_FETCHED, (textured) ? (passed) : 0); } while (0)
+#else
+#define PROFILE_ONLY(code)
+#define PROFILE_COUNT(counter, n)       do {} while (0)
+#define PROFILE_STAGE(stage)            do {} while (0)
+#define PROFILE_NEXT_STAGE(stage)       do {} while (0)
+#define PROFILE_STOP()                  do {} while (0)
+#define PROFILE_FRAME()                 do {} while (0)
+#define PROFILE_FRAGMENTS(tested, passed, textured) do {} while (0)
+#endif
+
+#endif // PROFILER_H
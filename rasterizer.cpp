@@ -0,0 +1,378 @@
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include "rasterizer.h"
+#include "profiler.h"
+
+template <class T>
+void swap_data(T& x, T& y)
+{
+    T temp;
+    temp = x;
+    x = y;
+    y = temp;
+}
+
+struct TSpanContext;
+typedef void (*TSpanFunc)(int y, int x_start, int x_end, float z, float u, float v, float q, const TSpanContext &c);
+
+struct TSpanContext {
+    TSpanFunc spanFunc;                                                         // picked for the features of the triangle
+    Texture *texture;
+    QRgb color;
+    FrameBuffer *frameBuffer;
+    DepthBuffer *depthBuffer;
+    TRect clip;
+    int level;                                                                  // mipmap level picked for the whole triangle
+    float dZdX;
+    float dUdX;                                                                 // of u*q and v*q in perspective
+    float dVdX;
+    float dQdX;
+    int span;                                                                   // perspectiveSpan(), 0 - affine
+};
+
+static std::atomic<int> spanPixels(PERSPECTIVE_SPAN_DEFAULT);
+
+int perspectiveSpan()
+{
+    return spanPixels.load(std::memory_order_relaxed);
+}
+
+void setPerspectiveSpan(int pixels)
+{
+    int span = 0;
+
+    if (pixels > 0) {
+        span = PERSPECTIVE_SPAN_MIN;
+        while (span * 2 <= std::min(pixels, PERSPECTIVE_SPAN_MAX)) span *= 2;
+    }
+    spanPixels.store(span, std::memory_order_relaxed);
+}
+
+bool isPerspective(const TTriangle &t)
+{
+    return t.texture && perspectiveSpan() > 0 && t.V1.w > 0.0f && t.V2.w > 0.0f && t.V3.w > 0.0f;
+}
+
+// u and v at pixel x of a span drawn in perspective, from u*q, v*q and q = 1/w given for the span starting at first
+static inline void perspectiveAt(int x, int first, float u, float v, float q, const TSpanContext &c, float &pu, float &pv)
+{
+    float steps = (float)(x - first + 1);                                       // advanced before every pixel, see below
+    float w = 1.0f / (q + steps * c.dQdX);
+    pu = (u + steps * c.dUdX) * w;
+    pv = (v + steps * c.dVdX) * w;
+}
+
+// Draws the pixels [x_start, x_end) of one row, limited to the clip rectangle. Interpolants are advanced before
+// every pixel, the same way the span loops always did; the ones a variant does not use are never touched.
+// In perspective u and v are divided by q at the ends of every subspan of c.span pixels and stepped linearly inside
+// it. The subspans are aligned to the screen and limited to the unclipped span, so a pixel gets the same texel
+// whatever clip rectangle it is drawn with.
+template <unsigned Features, TWrapMode Mode, bool Pow2, TTextureFormat Format>
+void drawSpan(int y, int x_start, int x_end, float z, float u, float v, float q, const TSpanContext &c)
+{
+    int x;
+    uint32_t *colorLine = c.frameBuffer->scanLine(y);
+    float *depthLine = c.depthBuffer->line(y);
+    int first = x_start, last = x_end - 1;
+    int next, from = 0, end = first - 1;                                        // perspective: the subspan held
+    float su = 0.0f, sv = 0.0f, dU = 0.0f, dV = 0.0f, eu = 0.0f, ev = 0.0f;
+
+    if (x_start < c.clip.x0) {                                                  // skip the part left of the clip rectangle
+        int skip = c.clip.x0 - x_start;
+        z += skip * c.dZdX;
+        if (!(Features & SPAN_PERSPECTIVE)) {                                   // taken from the start of the span there
+            u += skip * c.dUdX;
+            v += skip * c.dVdX;
+        }
+        x_start = c.clip.x0;
+    }
+    if (x_end > c.clip.x1) x_end = c.clip.x1;
+    next = x_start;
+    PROFILE_ONLY(int passed = 0;)
+
+    for (x=x_start; x<x_end; x++) {
+        z += c.dZdX;
+        if (Features & SPAN_PERSPECTIVE) {
+            if (x == next) {                                                    // u and v at both ends of the next subspan
+                int start = x & -c.span;
+                int a = std::max(start, first);
+                int b = std::min(start + c.span, last);
+                next = std::min(start + c.span, x_end);
+                if (a == end) {                                                 // where the previous one ended
+                    su = eu;
+                    sv = ev;
+                }
+                else {
+                    perspectiveAt(a, first, u, v, q, c, su, sv);
+                }
+                perspectiveAt(b, first, u, v, q, c, eu, ev);
+                float scale = (b > a) ? 1.0f / (b - a) : 0.0f;
+                dU = (eu - su) * scale;
+                dV = (ev - sv) * scale;
+                from = a;
+                end = b;
+            }
+        }
+        else if (Features & SPAN_TEXTURED) {
+            u += c.dUdX;
+            v += c.dVdX;
+        }
+        if ((Features & SPAN_DEPTH_TEST) && !(depthLine[x] > z)) continue;
+        if (Features & SPAN_DEPTH_WRITE) depthLine[x] = z;
+        if (Features & SPAN_PERSPECTIVE) {
+            float steps = (float)(x - from);
+            colorLine[x] = c.texture->fetch<Mode, Pow2, Format>(c.level, (int)(su + dU * steps), (int)(sv + dV * steps));
+        }
+        else {
+            colorLine[x] = (Features & SPAN_TEXTURED) ? c.texture->fetch<Mode, Pow2, Format>(c.level, (int)u, (int)v) : c.color;
+        }
+        PROFILE_ONLY(passed++;)
+    }
+
+    PROFILE_FRAGMENTS(std::max(x_end - x_start, 0), passed, Features & SPAN_TEXTURED);
+}
+
+static const TSpanFunc spanFuncs[SPAN_VARIANTS][3][2][TEXTURE_FORMATS] = SPAN_TABLE(drawSpan);
+
+unsigned spanFeatures(const TTriangle &t, bool inFront)
+{
+    unsigned features = 0;
+
+    if (!(t.flags & DRAW_NO_DEPTH_TEST) && !inFront) features |= SPAN_DEPTH_TEST;
+    if (!(t.flags & DRAW_NO_DEPTH_WRITE)) features |= SPAN_DEPTH_WRITE;
+    if (t.texture) features |= SPAN_TEXTURED;
+    if (isPerspective(t)) features |= SPAN_PERSPECTIVE;
+    return features;
+}
+
+bool triangleExtent(const TTriangle &t, const TRect &clip, TRect &bounds, float &minZ, float &maxZ)
+{
+    float minX = std::min(t.V1.x, std::min(t.V2.x, t.V3.x));
+    float maxX = std::max(t.V1.x, std::max(t.V2.x, t.V3.x));
+    float minY = std::min(t.V1.y, std::min(t.V2.y, t.V3.y));
+    float maxY = std::max(t.V1.y, std::max(t.V2.y, t.V3.y));
+
+    bounds.x0 = std::max((int)floorf(minX) - 1, clip.x0);                       // a pixel of slack for the span walker rounding
+    bounds.y0 = std::max((int)floorf(minY) - 1, clip.y0);
+    bounds.x1 = std::min((int)ceilf(maxX) + 2, clip.x1);
+    bounds.y1 = std::min((int)ceilf(maxY) + 2, clip.y1);
+    if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) return false;
+
+    // The engines do not interpolate depth exactly at the vertices - pad the range by a unit plus a pixel step
+    float x21 = t.V2.x - t.V1.x, y21 = t.V2.y - t.V1.y, z21 = t.V2.z - t.V1.z;
+    float x31 = t.V3.x - t.V1.x, y31 = t.V3.y - t.V1.y, z31 = t.V3.z - t.V1.z;
+    float det = x21 * y31 - x31 * y21;
+    float pad = 1.0f;
+    if (det != 0.0f) {
+        pad += (fabsf(z21 * y31 - z31 * y21) + fabsf(z31 * x21 - z21 * x31)) / fabsf(det);
+    }
+    minZ = std::min(t.V1.z, std::min(t.V2.z, t.V3.z)) - pad;
+    maxZ = std::max(t.V1.z, std::max(t.V2.z, t.V3.z)) + pad;
+    return true;
+}
+
+#define SUB_PIX(a) (ceil(a)-a)
+
+static void walkTriangle(const TTriangle &triangle, TSpanContext &c)
+{
+    TVertex V1 = triangle.V1, V2 = triangle.V2, V3 = triangle.V3;               // sorted and, in perspective, scaled by q
+
+    if (V1.y > V2.y) {                                                  // sort the vertices (V1,V2,V3) by their Y values
+        swap_data(V1, V2);
+    }
+    if (V1.y > V3.y) {
+        swap_data(V1, V3);
+    }
+    if (V2.y > V3.y) {
+        swap_data(V2, V3);
+    }
+
+    if ((int)V1.y == (int)V3.y) return;                                 // check if we have more than a zero height triangle
+
+    // We have to decide whether V2 is on the left side or the right one. We could do that by findng the V4, and
+    // check the disatnce from V4 to V2 (V4.y = V2.y). V4 is one the edge (V1V3)
+    // Using formula : I(t) = A + t(B-A) we find y = V1.y + t(V3.y - V1.y) and y = V2.y
+    // V2.y - V1.y = t(V3.y - V1.y) -->  t = (V2.y - V1.y)/(V3.y - V1.y)
+    // V4.x = V1.x + t(V3.x - V1.x) and V4.y = V2.y
+    // float distance = V4.x - V2.x
+    // if (distance > 0) then the middle vertex is on the left side (V1V3 is the longest edge on the right side)
+
+    float uScale = c.texture ? c.texture->width - 1 : 0;                        // texels across, once per triangle
+    float vScale = c.texture ? c.texture->height - 1 : 0;
+
+    float dY21 = 1.0 / ceil(V2.y - V1.y);
+    float dY31 = 1.0 / ceil(V3.y - V1.y);
+    float dY32 = 1.0 / ceil(V3.y - V2.y);
+
+    float dXdY21 = (float)(V2.x - V1.x) * dY21;                             // dXdY means deltaX/deltaY
+    float dXdY31 = (float)(V3.x - V1.x) * dY31;
+    float dXdY32 = (float)(V3.x - V2.x) * dY32;
+    float dXdY31tmp = dXdY31;
+
+    float dX = 1.0 / ((V3.x - V1.x)*ceil(V2.y - V1.y) + (V1.x - V2.x)*ceil(V3.y - V1.y));
+
+    // we calculate delta values ​​to find the z value
+    float dZdY21 = (float)(V2.z - V1.z) * dY21;
+    float dZdY31 = (float)(V3.z - V1.z) * dY31;
+    float dZdY32 = (float)(V3.z - V2.z) * dY32;
+    float dZdX   = (float)((V3.z - V1.z)*ceil(V2.y - V1.y) + (V1.z - V2.z)*ceil(V3.y - V1.y)) * dX;
+
+    // we calculate delta values ​​to find the u-value of the texture
+    float dUdY21 = (float)(V2.u - V1.u) * dY21 * uScale;
+    float dUdY31 = (float)(V3.u - V1.u) * dY31 * uScale;
+    float dUdY32 = (float)(V3.u - V2.u) * dY32 * uScale;
+    float dUdX   = (float)((V3.u - V1.u)*ceil(V2.y - V1.y) + (V1.u - V2.u)*ceil(V3.y - V1.y)) * dX * uScale;
+
+    // we calculate delta values ​​to find the v-value of the texture
+    float dVdY21 = (float)(V2.v - V1.v) * dY21 * vScale;
+    float dVdY31 = (float)(V3.v - V1.v) * dY31 * vScale;
+    float dVdY32 = (float)(V3.v - V2.v) * dY32 * vScale;
+    float dVdX   = (float)((V3.v - V1.v)*ceil(V2.y - V1.y) + (V1.v - V2.v)*ceil(V3.y - V1.y)) * dX * vScale;
+
+    c.dZdX = dZdX;
+    c.dUdX = dUdX;
+    c.dVdX = dVdX;
+
+    // Texel steps per row, without the part that comes from moving along x with the V1V3 edge
+    float dUdY = dUdY31 - dUdX * dXdY31;
+    float dVdY = dVdY31 - dVdX * dXdY31;
+    c.level = c.texture ? c.texture->selectLevel(dUdX, dVdX, dUdY, dVdY) : 0;
+
+    // In perspective u and v are walked as u*q and v*q, which change linearly on the screen like q = 1/w does. The
+    // mipmap level is still picked from the affine steps above.
+    float dQdY21 = 0.0f, dQdY31 = 0.0f, dQdY32 = 0.0f;
+    c.dQdX = 0.0f;
+    c.span = isPerspective(triangle) ? perspectiveSpan() : 0;
+    if (c.span) {
+        V1.u *= V1.w;  V1.v *= V1.w;
+        V2.u *= V2.w;  V2.v *= V2.w;
+        V3.u *= V3.w;  V3.v *= V3.w;
+
+        dUdY21 = (float)(V2.u - V1.u) * dY21 * uScale;
+        dUdY31 = (float)(V3.u - V1.u) * dY31 * uScale;
+        dUdY32 = (float)(V3.u - V2.u) * dY32 * uScale;
+        c.dUdX = (float)((V3.u - V1.u)*ceil(V2.y - V1.y) + (V1.u - V2.u)*ceil(V3.y - V1.y)) * dX * uScale;
+
+        dVdY21 = (float)(V2.v - V1.v) * dY21 * vScale;
+        dVdY31 = (float)(V3.v - V1.v) * dY31 * vScale;
+        dVdY32 = (float)(V3.v - V2.v) * dY32 * vScale;
+        c.dVdX = (float)((V3.v - V1.v)*ceil(V2.y - V1.y) + (V1.v - V2.v)*ceil(V3.y - V1.y)) * dX * vScale;
+
+        dQdY21 = (V2.w - V1.w) * dY21;
+        dQdY31 = (V3.w - V1.w) * dY31;
+        dQdY32 = (V3.w - V2.w) * dY32;
+        c.dQdX = (float)((V3.w - V1.w)*ceil(V2.y - V1.y) + (V1.w - V2.w)*ceil(V3.y - V1.y)) * dX;
+    }
+
+    if (dXdY21 > dXdY31) {
+        swap_data(dXdY21, dXdY31);
+        dZdY21 = dZdY31;
+        dUdY21 = dUdY31;
+        dVdY21 = dVdY31;
+        dQdY21 = dQdY31;
+    }
+
+    int prestep = SUB_PIX(V1.y);
+    float x_left = V1.x + prestep * dXdY21;
+    float x_right = V1.x + prestep * dXdY31;
+    int y = ceil(V1.y);
+    float z, u, v;
+    float zp = (V1.z + prestep * dZdY21);
+    float up = (V1.u + prestep * dUdY21) * uScale;
+    float vp = (V1.v + prestep * dVdY21) * vScale;
+    float qp = V1.w + prestep * dQdY21;
+
+    while (y < V2.y) {
+        if (y >= c.clip.y1) return;                                       // the rest of the triangle is below the clip rectangle
+        if (y >= c.clip.y0) {
+            z = ceil(zp);
+            u = c.span ? up : ceil(up);                                   // u*q and v*q are far below a texel
+            v = c.span ? vp : ceil(vp);
+            if (x_left < x_right) {
+                c.spanFunc(y, ceil(x_left), ceil(x_right), z, u, v, qp, c);
+            }
+            else {
+                c.spanFunc(y, ceil(x_right), x_left, z, u, v, qp, c);
+            }
+        }
+        x_left  += dXdY21;
+        x_right += dXdY31;
+        zp += dZdY21;
+        up += dUdY21;
+        vp += dVdY21;
+        qp += dQdY21;
+        y += 1.0;
+    }
+
+    dXdY31 = dXdY31tmp;
+    if (dXdY32 < dXdY31) {
+        swap_data(dXdY31, dXdY32);
+        dZdY32 = dZdY31;
+        dUdY32 = dUdY31;
+        dVdY32 = dVdY31;
+        dQdY32 = dQdY31;
+    }
+
+    prestep = SUB_PIX(V2.y);
+    if ((V2.x - V1.x) * (V3.y - V1.y) > (V3.x - V1.x) * (V2.y - V1.y)) {                    // V2 right of V4, see above
+        x_right = V2.x + prestep * dXdY31;
+    }
+    else {
+        x_left = V2.x + SUB_PIX(V2.y) * dXdY32;
+        zp = (V2.z + prestep * dZdY32);
+        up = (V2.u + prestep * dUdY32) * uScale;
+        vp = (V2.v + prestep * dVdY32) * vScale;
+        qp = V2.w + prestep * dQdY32;
+    }
+
+    while (y < V3.y) {
+        if (y >= c.clip.y1) return;
+        if (y >= c.clip.y0) {
+            z = ceil(zp);
+            u = c.span ? up : ceil(up);
+            v = c.span ? vp : ceil(vp);
+            c.spanFunc(y, ceil(x_left), ceil(x_right), z, u, v, qp, c);
+        }
+        x_left  += dXdY32;
+        x_right += dXdY31;
+        zp += dZdY32;
+        up += dUdY32;
+        vp += dVdY32;
+        qp += dQdY32;
+        y += 1.0;
+
+    }
+
+    return;
+}
+
+void drawTriangle(const TTriangle &t, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, const TRect &clip)
+{
+    TSpanContext c;
+    float minZ, maxZ;
+    PROFILE_STAGE(STAGE_SETUP);
+
+    if (!triangleExtent(t, clip, c.clip, minZ, maxZ)) return;
+    bool depthTest = !(t.flags & DRAW_NO_DEPTH_TEST);
+    if (depthTest && depthBuffer->isOccluded(c.clip, minZ)) {                   // hierarchical-Z rejection
+        PROFILE_COUNT(COUNTER_TRIANGLES_OCCLUDED, 1);
+        return;
+    }
+
+    c.texture = t.texture;
+    c.color = t.color;
+    c.frameBuffer = frameBuffer;
+    c.depthBuffer = depthBuffer;
+    depthBuffer->prepare(c.clip);
+    unsigned features = spanFeatures(t, depthTest && depthBuffer->isInFront(c.clip, maxZ));
+    int wrap = t.texture ? t.texture->wrapMode : WRAP_CLAMP;
+    int format = t.texture ? t.texture->format : TEXTURE_RGB32;
+    c.spanFunc = spanFuncs[features][wrap][t.texture && t.texture->isPow2][format];
+
+    PROFILE_NEXT_STAGE(STAGE_SPANS);
+    PROFILE_COUNT(COUNTER_TRIANGLES_RASTERIZED, 1);
+    walkTriangle(t, c);                                                         // spans are clipped to the triangle extent
+
+    if (features & SPAN_DEPTH_WRITE) depthBuffer->update(c.clip);
+}
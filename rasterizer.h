@@ -0,0 +1,91 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <stdint.h>
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "texture.h"
+
+struct TVertex {
+    float x;
+    float y;
+    float z;
+    float u;
+    float v;
+    float w;                                                                    // 1/w of the clip position, 0 - unknown
+};
+
+// State of the draw a triangle belongs to, 0 being the default: depth tested and written
+enum TDrawFlags {
+    DRAW_NO_DEPTH_TEST  = 1 << 0,
+    DRAW_NO_DEPTH_WRITE = 1 << 1
+};
+
+struct TTriangle {
+    TVertex V1;
+    TVertex V2;
+    TVertex V3;
+    Texture *texture;                                                           // NULL - filled with color
+    QRgb color;
+    uint32_t flags;                                                             // TDrawFlags
+};
+
+// What the pixel loops of both engines are compiled for. Every combination is instantiated for every wrap mode and
+// texture format (the untextured ones only once) and picked per triangle from a table, so a fragment only runs the
+// code its draw needs.
+enum TSpanFeatures {
+    SPAN_DEPTH_TEST     = 1 << 0,
+    SPAN_DEPTH_WRITE    = 1 << 1,
+    SPAN_TEXTURED       = 1 << 2,
+    SPAN_PERSPECTIVE    = 1 << 3,                                               // u and v divided by 1/w, see below
+    SPAN_VARIANTS       = 1 << 4
+};
+
+// The features a triangle needs. inFront - it is closer than everything already drawn where it goes, which makes
+// the depth test pointless.
+unsigned spanFeatures(const TTriangle &t, bool inFront);
+
+// A table [features][wrap mode][power of two][format] of the instantiations of a template <unsigned Features,
+// TWrapMode Mode, bool Pow2, TTextureFormat Format> function; clamping ignores Pow2 and untextured variants ignore all
+// (perspective included)
+#define SPAN_INSTANCE(func, f, mode, pow2, format) \
+    func<((f) & SPAN_TEXTURED) ? (f) : ((f) & ~SPAN_PERSPECTIVE), ((f) & SPAN_TEXTURED) ? (mode) : WRAP_CLAMP, \
+         ((f) & SPAN_TEXTURED) && (mode) != WRAP_CLAMP && (pow2), ((f) & SPAN_TEXTURED) ? (format) : TEXTURE_RGB32>
+#define SPAN_FORMATS(func, f, mode, pow2) { \
+    SPAN_INSTANCE(func, f, mode, pow2, TEXTURE_RGB32), SPAN_INSTANCE(func, f, mode, pow2, TEXTURE_INDEXED8), \
+    SPAN_INSTANCE(func, f, mode, pow2, TEXTURE_RGB565), SPAN_INSTANCE(func, f, mode, pow2, TEXTURE_RGB555), \
+    SPAN_INSTANCE(func, f, mode, pow2, TEXTURE_BC1) }
+#define SPAN_WRAP_MODES(func, f) { \
+    { SPAN_FORMATS(func, f, WRAP_CLAMP, false), SPAN_FORMATS(func, f, WRAP_CLAMP, true) }, \
+    { SPAN_FORMATS(func, f, WRAP_REPEAT, false), SPAN_FORMATS(func, f, WRAP_REPEAT, true) }, \
+    { SPAN_FORMATS(func, f, WRAP_MIRROR, false), SPAN_FORMATS(func, f, WRAP_MIRROR, true) } }
+#define SPAN_TABLE(func) { \
+    SPAN_WRAP_MODES(func, 0), SPAN_WRAP_MODES(func, 1), SPAN_WRAP_MODES(func, 2), SPAN_WRAP_MODES(func, 3), \
+    SPAN_WRAP_MODES(func, 4), SPAN_WRAP_MODES(func, 5), SPAN_WRAP_MODES(func, 6), SPAN_WRAP_MODES(func, 7), \
+    SPAN_WRAP_MODES(func, 8), SPAN_WRAP_MODES(func, 9), SPAN_WRAP_MODES(func, 10), SPAN_WRAP_MODES(func, 11), \
+    SPAN_WRAP_MODES(func, 12), SPAN_WRAP_MODES(func, 13), SPAN_WRAP_MODES(func, 14), SPAN_WRAP_MODES(func, 15) }
+
+// Perspective correction. Textures are mapped with u/w, v/w and 1/w interpolated across the screen, but the division
+// that turns them back into u and v is only done at the ends of spans of this many pixels, aligned to the screen (and
+// at the first and last pixel of every row of a triangle); u and v are stepped linearly in between. 0 maps textures
+// affinely, like before. Triangles whose vertices have no 1/w (TVertex::w == 0) are always drawn affinely. Meant to
+// be set before drawing starts.
+#define PERSPECTIVE_SPAN_DEFAULT    16
+#define PERSPECTIVE_SPAN_MIN        8                                           // no shorter than an AVX2 group
+#define PERSPECTIVE_SPAN_MAX        64
+
+int perspectiveSpan();
+void setPerspectiveSpan(int pixels);                                            // 0 or rounded down to a power of two
+bool isPerspective(const TTriangle &t);                                         // drawn with SPAN_PERSPECTIVE
+
+// Draws a triangle given in screen coordinates, textured or filled with its color. Only pixels inside the clip
+// rectangle are touched, so several threads may draw into the same frame buffer at once as long as their clip
+// rectangles do not overlap (and, for the depth buffer, do not share a depth block). Depth tested triangles hidden
+// according to the depth pyramid are rejected before any pixel is visited.
+void drawTriangle(const TTriangle &t, FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, const TRect &clip);
+
+// The rectangle inside clip and the depth range a triangle may write to, padded for the rounding of both
+// rasterization engines. Returns false when the triangle misses the clip rectangle.
+bool triangleExtent(const TTriangle &t, const TRect &clip, TRect &bounds, float &minZ, float &maxZ);
+
+#endif // RASTERIZER_H
@@ -0,0 +1,56 @@
+#include "profiler.h"
+#include "rendercontext.h"
+
+RenderContext::RenderContext(int width, int height, TextureManager *textureManager, ThreadPool *pool)
+{
+    frameWidth = width;
+    frameHeight = height;
+    this->textureManager = textureManager;
+    if (pool == NULL) {
+        ownPool.reset(new ThreadPool());
+        pool = ownPool.get();
+    }
+    tileRenderer.reset(new TileRenderer(pool));
+    primitiveAssembler.setViewport(width, height, primitiveAssembler.farPlane());
+    viewProjection = makeIdentity();
+    currentTarget = NULL;
+    currentDepth = NULL;
+}
+
+// The buffers of the context follow with the next beginFrame(), keeping their memory when they shrink
+void RenderContext::resize(int width, int height)
+{
+    frameWidth = width;
+    frameHeight = height;
+    primitiveAssembler.setViewport(width, height, primitiveAssembler.farPlane());
+}
+
+void RenderContext::beginFrame(QRgb clearColor, FrameBuffer *target, DepthBuffer *depth)
+{
+    if (target == NULL) {                                                       // allocated with the first frame that needs them
+        if (ownFrameBuffer.width != frameWidth || ownFrameBuffer.height != frameHeight) {
+            ownFrameBuffer.resize(frameWidth, frameHeight);
+        }
+        target = &ownFrameBuffer;
+    }
+    if (depth == NULL) {
+        if (ownDepthBuffer.width != frameWidth || ownDepthBuffer.height != frameHeight) {
+            ownDepthBuffer.resize(frameWidth, frameHeight);
+        }
+        depth = &ownDepthBuffer;
+    }
+    currentTarget = target;
+    currentDepth = depth;
+    commandBuffer.clear();
+    tileRenderer->beginFrame(target, depth, clearColor);
+}
+
+void RenderContext::endFrame()
+{
+    {
+        PROFILE_STAGE(STAGE_SCENE);
+        commandBuffer.execute(viewProjection, primitiveAssembler, textureManager, tileRenderer.get());
+    }
+    commandBuffer.clear();
+    tileRenderer->endFrame();
+}
@@ -0,0 +1,69 @@
+#ifndef RENDERCONTEXT_H
+#define RENDERCONTEXT_H
+
+#include <memory>
+#include "commandbuffer.h"
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "mesh.h"
+#include "primitiveassembler.h"
+#include "texturemanager.h"
+#include "threadpool.h"
+#include "tilerenderer.h"
+
+// Everything one stream of frames is drawn with: a tile renderer, a primitive assembler set up for the viewport, a
+// command buffer and a frame and depth buffer of its own. A frame goes
+//
+//     context.beginFrame(clearColor);              // or into buffers of the caller
+//     context.commands().drawMesh(mesh, world);    // any number of draws, sorted at the end
+//     context.endFrame();                          // frameBuffer() now holds the frame
+//
+// Triangles may also be submitted to renderer() directly (a scene graph, an instance batch); they are binned before
+// the recorded draws. The recorded draws are seen through the camera set with setViewProjection(). Calling
+// TextureManager::beginFrame() between frames is left to whoever owns the texture manager.
+//
+// Contexts share nothing but the texture manager and the thread pool they are given, so several of them may draw on
+// as many threads at once. A context given no pool makes one of its own. A shared pool runs one parallelFor() at a
+// time, so contexts drawing at once are better off with pools of their own. The process-wide settings - the edge
+// SIMD level, the perspective span, the texture search paths and the profiler - apply to all contexts, and a shared
+// texture manager must not evict textures (see TextureManager::setMemoryBudget()) while any context is drawing.
+class RenderContext
+{
+public:
+    RenderContext(int width, int height, TextureManager *textureManager, ThreadPool *pool = NULL);
+
+    RenderContext(const RenderContext &) = delete;
+    RenderContext &operator=(const RenderContext &) = delete;
+
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+    void resize(int width, int height);                                         // from the next frame on
+    void setViewProjection(const TMat4x4 &viewProjection) { this->viewProjection = viewProjection; }
+
+    // target and depth replace the buffers of the context for this frame, they must be width x height
+    void beginFrame(QRgb clearColor, FrameBuffer *target = NULL, DepthBuffer *depth = NULL);
+    void endFrame();                                                            // executes and clears the commands
+
+    TileRenderer &renderer() { return *tileRenderer; }
+    PrimitiveAssembler &assembler() { return primitiveAssembler; }
+    CommandBuffer &commands() { return commandBuffer; }
+    TextureManager *textures() const { return textureManager; }
+    FrameBuffer *frameBuffer() const { return currentTarget; }                  // of the frame last begun
+    DepthBuffer *depthBuffer() const { return currentDepth; }
+
+private:
+    int frameWidth;
+    int frameHeight;
+    TextureManager *textureManager;
+    std::unique_ptr<ThreadPool> ownPool;
+    std::unique_ptr<TileRenderer> tileRenderer;
+    PrimitiveAssembler primitiveAssembler;
+    CommandBuffer commandBuffer;
+    TMat4x4 viewProjection;
+    FrameBuffer ownFrameBuffer;
+    DepthBuffer ownDepthBuffer;
+    FrameBuffer *currentTarget;
+    DepthBuffer *currentDepth;
+};
+
+#endif // RENDERCONTEXT_H
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <chrono>
+#include "profiler.h"
+#include "renderthread.h"
+
+RenderThread::RenderThread(int width, int height, int bufferCount)
+{
+    int i;
+
+    this->bufferCount = std::max(2, std::min(bufferCount, RENDER_MAX_BUFFERS));
+    for (i=0; i<this->bufferCount; i++) {
+        frameBuffers[i].resize(width, height);
+        frameBuffers[i].clear(qRgb(0, 0, 0));
+        states[i] = BUFFER_FREE;
+    }
+    depthBuffer.resize(width, height);
+    ready = -1;
+    presenting = -1;
+    damage = { 0, 0, 0, 0 };
+    pacing = PACING_FIXED;
+    interval = 10;
+    stopping = false;
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+}
+
+void RenderThread::setPacing(TFramePacing pacing, int interval)
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+    this->pacing = pacing;
+    this->interval = std::max(1, interval);
+    changed.notify_all();
+}
+
+void RenderThread::start(const TRenderFunction &render)
+{
+    if (thread.joinable()) return;
+
+    this->render = render;
+    stopping = false;
+    thread = std::thread(&RenderThread::threadMain, this);
+}
+
+void RenderThread::stop()
+{
+    if (!thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+        changed.notify_all();
+    }
+    thread.join();
+}
+
+FrameBuffer *RenderThread::acquire(TRect *damage)
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+    if (ready < 0) return NULL;
+
+    if (damage) *damage = this->damage;
+    this->damage = { 0, 0, 0, 0 };
+    presenting = ready;
+    states[presenting] = BUFFER_PRESENTING;
+    ready = -1;
+    changed.notify_all();                                                       // PACING_VSYNC waits for this
+    return &frameBuffers[presenting];
+}
+
+void RenderThread::release()
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+    if (presenting < 0) return;
+
+    states[presenting] = BUFFER_FREE;
+    presenting = -1;
+    changed.notify_all();
+}
+
+// A free buffer if there is one. Without one PACING_VSYNC and PACING_FIXED wait for the GUI, PACING_UNLIMITED takes
+// the ready frame back (the next one would drop it anyway). PACING_VSYNC also waits until the ready frame was taken.
+// -1 when stopping.
+int RenderThread::nextBuffer(std::unique_lock<std::mutex> &lock)
+{
+    int i;
+
+    for (;;) {
+        if (stopping) return -1;
+        if (pacing != PACING_VSYNC || ready < 0) {
+            for (i=0; i<bufferCount; i++) {
+                if (states[i] == BUFFER_FREE) return i;
+            }
+            if (pacing == PACING_UNLIMITED && ready >= 0) {
+                int buffer = ready;
+                ready = -1;
+                PROFILE_COUNT(COUNTER_FRAMES_DROPPED, 1);
+                return buffer;
+            }
+        }
+        changed.wait(lock);
+    }
+}
+
+void RenderThread::publish(int buffer, const TRect &changed)
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+    damage = mergeRects(damage, changed);
+    if (ready >= 0) {                                                           // never presented, the GUI was too slow
+        states[ready] = BUFFER_FREE;
+        PROFILE_COUNT(COUNTER_FRAMES_DROPPED, 1);
+    }
+    states[buffer] = BUFFER_READY;
+    ready = buffer;
+}
+
+void RenderThread::threadMain()
+{
+    auto deadline = std::chrono::steady_clock::now();
+    int frame = 0;
+
+    for (;;) {
+        int buffer;
+        {
+            std::unique_lock<std::mutex> lock(stateLock);
+            if (pacing == PACING_FIXED) {                                       // until the next tick, or to stop
+                changed.wait_until(lock, deadline, [this]() { return stopping || pacing != PACING_FIXED; });
+                deadline = std::max(deadline + std::chrono::milliseconds(interval), std::chrono::steady_clock::now());
+            }
+            buffer = nextBuffer(lock);
+            if (buffer >= 0) states[buffer] = BUFFER_RENDERING;
+        }
+        if (buffer < 0) return;
+
+        {
+            PROFILE_STAGE(STAGE_FRAME);
+            TRect changed = render(&frameBuffers[buffer], &depthBuffer, frame);
+            PROFILE_NEXT_STAGE(STAGE_PRESENT);
+            publish(buffer, changed);
+        }
+        PROFILE_FRAME();
+        frame++;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "depthbuffer.h"
+#include "framebuffer.h"
+
+#define RENDER_MAX_BUFFERS  3
+
+enum TFramePacing {
+    PACING_FIXED,                                                               // every interval, no catching up
+    PACING_UNLIMITED,                                                           // as fast as possible, drops frames
+    PACING_VSYNC                                                                // one per presented frame
+};
+
+// Renders frames on a thread of its own into a ring of two or three frame buffers, so the GUI thread only presents
+// and never waits for the rasterizer. Every buffer is free, being rendered, ready (the latest finished frame, at most
+// one at a time) or being presented. A finished frame replaces the ready one, which is dropped, so the GUI always
+// gets the newest frame. With three buffers the render thread can always go on: one may be presented, one ready
+// and the third rendered into. With two it waits for the GUI instead, unless the pacing allows it to take the
+// ready buffer back.
+//
+// The render function returns the area of the frame it changed. The areas of all frames finished since the last
+// acquire(), the dropped ones included, are handed to the GUI with the next frame, so it only has to copy those.
+class RenderThread
+{
+public:
+    typedef std::function<TRect(FrameBuffer *, DepthBuffer *, int)> TRenderFunction; // draws the frame number given
+
+    RenderThread(int width, int height, int bufferCount = RENDER_MAX_BUFFERS);
+    ~RenderThread();
+
+    RenderThread(const RenderThread &) = delete;
+    RenderThread &operator=(const RenderThread &) = delete;
+
+    void setPacing(TFramePacing pacing, int interval = 10);                     // milliseconds, for PACING_FIXED
+    void start(const TRenderFunction &render);
+    void stop();
+
+    // The newest frame finished since the last call, or NULL if there is none. The buffer is left alone by the render
+    // thread until release() is called, which has to happen before the next acquire(). damage, when given, receives
+    // the area that changed since the frame acquired before.
+    FrameBuffer *acquire(TRect *damage = NULL);
+    void release();
+
+private:
+    enum TBufferState {
+        BUFFER_FREE,
+        BUFFER_RENDERING,
+        BUFFER_READY,
+        BUFFER_PRESENTING
+    };
+
+    FrameBuffer frameBuffers[RENDER_MAX_BUFFERS];
+    TBufferState states[RENDER_MAX_BUFFERS];
+    DepthBuffer depthBuffer;                                                    // render thread only
+    int bufferCount;
+    int ready;                                                                  // the ready buffer, -1 if none
+    int presenting;                                                             // held by the GUI, -1 if none
+    TRect damage;                                                               // since the last acquire()
+
+    TRenderFunction render;
+    TFramePacing pacing;
+    int interval;
+    std::thread thread;
+    std::mutex stateLock;
+    std::condition_variable changed;
+    bool stopping;
+
+    void threadMain();
+    int nextBuffer(std::unique_lock<std::mutex> &lock);
+    void publish(int buffer, const TRect &changed);
+};
+
+#endif // RENDERTHREAD_H
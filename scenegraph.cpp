@@ -0,0 +1,243 @@
+#include <string.h>
+#include <algorithm>
+#include "profiler.h"
+#include "scenegraph.h"
+
+SceneGraph::SceneGraph()
+{
+    dirty = false;
+    rebuild = false;
+    damageTracked = false;
+    damageTextures = 0;
+}
+
+TNodeHandle SceneGraph::addNode(TNodeHandle parent, const TMesh *mesh)
+{
+    TSceneNode node;
+
+    node.parent = parent < (int)nodes.size() ? parent : NO_NODE;                // parents come first, see update()
+    node.mesh = NULL;
+    node.local = makeIdentity();
+    node.world = node.local;
+    node.meshBounds = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    node.bounds = node.meshBounds;
+    node.leaf = -1;
+    node.dirty = true;
+    node.moved = false;
+    node.damaged = false;
+    node.drawn = false;
+    node.drawnBounds = node.bounds;
+    nodes.push_back(node);
+    dirty = true;
+
+    TNodeHandle handle = (TNodeHandle)nodes.size() - 1;
+    if (mesh) setMesh(handle, mesh);
+    return handle;
+}
+
+void SceneGraph::setMesh(TNodeHandle node, const TMesh *mesh)
+{
+    if ((nodes[node].mesh == NULL) != (mesh == NULL)) rebuild = true;          // the set of objects changes
+    nodes[node].mesh = mesh;
+    if (mesh) nodes[node].meshBounds = computeBounds(*mesh);
+    nodes[node].dirty = true;
+    nodes[node].damaged = true;
+    dirty = true;
+}
+
+void SceneGraph::setTransform(TNodeHandle node, const TMat4x4 &local)
+{
+    nodes[node].local = local;
+    nodes[node].dirty = true;
+    dirty = true;
+}
+
+void SceneGraph::update()
+{
+    int i;
+
+    if (!dirty && !rebuild) return;
+
+    for (i=0; i<(int)nodes.size(); i++) {
+        TSceneNode &node = nodes[i];
+        node.moved = node.dirty || (node.parent != NO_NODE && nodes[node.parent].moved);
+        node.dirty = false;
+        if (!node.moved) continue;
+        node.damaged = true;
+
+        node.world = node.parent == NO_NODE ? node.local : multiplyMatrices(node.local, nodes[node.parent].world);
+        if (node.mesh) {
+            node.bounds = transformBounds(node.meshBounds, node.world);
+            if (!rebuild) bvh[node.leaf].refit = true;
+        }
+    }
+
+    if (rebuild) {
+        objects.clear();
+        for (i=0; i<(int)nodes.size(); i++) {
+            if (nodes[i].mesh) objects.push_back(i);
+        }
+        bvh.clear();
+        if (!objects.empty()) buildBvh(0, (int)objects.size(), -1);
+        rebuild = false;
+    }
+    else {
+        refitBvh();
+    }
+    dirty = false;
+}
+
+// Top down, every node split at the median of the centres of its boxes along the longest axis they spread over
+int SceneGraph::buildBvh(int first, int count, int parent)
+{
+    TBvhNode node;
+    int i;
+
+    node.bounds = nodes[objects[first]].bounds;
+    for (i=1; i<count; i++) node.bounds = mergeBounds(node.bounds, nodes[objects[first + i]].bounds);
+    node.parent = parent;
+    node.left = -1;
+    node.right = -1;
+    node.first = first;
+    node.count = count;
+    node.refit = false;
+
+    int index = (int)bvh.size();
+    bvh.push_back(node);
+    if (count <= BVH_LEAF_SIZE) {
+        for (i=0; i<count; i++) nodes[objects[first + i]].leaf = index;
+        return index;
+    }
+
+    auto centre = [&](TNodeHandle handle, int axis) {
+        const TBounds &b = nodes[handle].bounds;
+        if (axis == 0) return b.minX + b.maxX;
+        if (axis == 1) return b.minY + b.maxY;
+        return b.minZ + b.maxZ;
+    };
+    float lo[3], hi[3];
+    int axis;
+    for (axis=0; axis<3; axis++) {
+        lo[axis] = hi[axis] = centre(objects[first], axis);
+        for (i=1; i<count; i++) {
+            lo[axis] = std::min(lo[axis], centre(objects[first + i], axis));
+            hi[axis] = std::max(hi[axis], centre(objects[first + i], axis));
+        }
+    }
+    axis = 0;
+    if (hi[1] - lo[1] > hi[axis] - lo[axis]) axis = 1;
+    if (hi[2] - lo[2] > hi[axis] - lo[axis]) axis = 2;
+
+    int half = count / 2;
+    std::nth_element(objects.begin() + first, objects.begin() + first + half, objects.begin() + first + count,
+                     [&](TNodeHandle a, TNodeHandle b) { return centre(a, axis) < centre(b, axis); });
+    int left = buildBvh(first, half, index);
+    int right = buildBvh(first + half, count - half, index);
+    bvh[index].left = left;
+    bvh[index].right = right;
+    return index;
+}
+
+// Children are stored after their parent, so going backwards refits every flagged node after its children
+void SceneGraph::refitBvh()
+{
+    int i, j;
+
+    for (i=(int)bvh.size()-1; i>=0; i--) {
+        TBvhNode &node = bvh[i];
+        if (!node.refit) continue;
+
+        if (node.left < 0) {
+            node.bounds = nodes[objects[node.first]].bounds;
+            for (j=1; j<node.count; j++) node.bounds = mergeBounds(node.bounds, nodes[objects[node.first + j]].bounds);
+        }
+        else {
+            node.bounds = mergeBounds(bvh[node.left].bounds, bvh[node.right].bounds);
+        }
+        node.refit = false;
+        if (node.parent >= 0) bvh[node.parent].refit = true;
+    }
+}
+
+void SceneGraph::cullBvh(int index, const TFrustum &frustum, unsigned planeMask)
+{
+    const TBvhNode &node = bvh[index];
+    int i;
+
+    if (!clipBounds(node.bounds, frustum, planeMask)) {
+        PROFILE_COUNT(COUNTER_OBJECTS_CULLED, node.count);
+        return;
+    }
+    if (planeMask == 0) {                                                       // wholly inside, nothing left to test
+        visible.insert(visible.end(), objects.begin() + node.first, objects.begin() + node.first + node.count);
+        return;
+    }
+    if (node.left >= 0) {
+        cullBvh(node.left, frustum, planeMask);
+        cullBvh(node.right, frustum, planeMask);
+        return;
+    }
+    for (i=0; i<node.count; i++) {
+        unsigned mask = planeMask;
+        TNodeHandle handle = objects[node.first + i];
+        if (clipBounds(nodes[handle].bounds, frustum, mask)) visible.push_back(handle);
+        else PROFILE_COUNT(COUNTER_OBJECTS_CULLED, 1);
+    }
+}
+
+// Adds where the damaged meshes were in the last frame drawn and where they are now. Returns false when the whole
+// frame was damaged instead.
+bool SceneGraph::addDamage(const TMat4x4 &viewProjection, const PrimitiveAssembler &assembler,
+                           TextureManager *textureManager, TileRenderer *renderer)
+{
+    uint64_t textures = textureManager ? textureManager->generation() : 0;
+    bool all = !damageTracked || textures != damageTextures ||
+               memcmp(&viewProjection, &damageViewProjection, sizeof(TMat4x4)) != 0;
+    int i;
+
+    for (i=0; i<(int)nodes.size(); i++) {
+        TSceneNode &node = nodes[i];
+        if (!node.damaged) continue;
+
+        if (!all && node.drawn) renderer->addDamage(assembler.screenBounds(node.drawnBounds, viewProjection));
+        if (!all && node.mesh) renderer->addDamage(assembler.screenBounds(node.bounds, viewProjection));
+        node.drawn = node.mesh != NULL;
+        node.drawnBounds = node.bounds;
+        node.damaged = false;
+    }
+    if (all) renderer->invalidate();
+
+    damageTracked = true;
+    damageViewProjection = viewProjection;
+    damageTextures = textures;
+    return !all;
+}
+
+void SceneGraph::submit(const TMat4x4 &viewProjection, PrimitiveAssembler &assembler, TextureManager *textureManager,
+                        TileRenderer *renderer)
+{
+    PROFILE_STAGE(STAGE_CULLING);
+
+    update();
+    bool partial = false;                                                       // only the damage is drawn
+    if (renderer->isIncremental()) partial = addDamage(viewProjection, assembler, textureManager, renderer);
+    else damageTracked = false;
+
+    TFrustum frustum = makeFrustum(viewProjection, assembler.nearPlane(), assembler.farPlane());     // in world space
+    visible.clear();
+    if (!bvh.empty()) cullBvh(0, frustum, ALL_PLANES);
+    PROFILE_COUNT(COUNTER_OBJECTS_VISIBLE, visible.size());
+    PROFILE_STOP();
+
+    for (TNodeHandle handle : visible) {
+        const TSceneNode &node = nodes[handle];
+        if (partial && !renderer->isDamaged(assembler.screenBounds(node.bounds, viewProjection))) continue;
+        {
+            PROFILE_STAGE(STAGE_TRANSFORM);
+            transformVertices(multiplyMatrices(node.world, viewProjection), *node.mesh, cache);
+            PROFILE_NEXT_STAGE(STAGE_PROJECTION);
+            assembler.project(cache);
+        }
+        assembler.submit(*node.mesh, cache, textureManager, renderer);
+    }
+}
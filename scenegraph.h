@@ -0,0 +1,91 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <stdint.h>
+#include <vector>
+#include "mesh.h"
+#include "primitiveassembler.h"
+#include "texturemanager.h"
+#include "tilerenderer.h"
+
+typedef int TNodeHandle;                                                        // index of a node in its scene graph
+
+#define NO_NODE         (-1)
+#define BVH_LEAF_SIZE   4                                                       // meshes per leaf of the hierarchy
+
+// A hierarchy of nodes, each with a transform relative to its parent and optionally a mesh (which the graph does not
+// own, many nodes may share one). Setting a transform only marks the node dirty; update() then recomputes the world
+// matrices of the dirty nodes and their descendants and nothing else. A parent is always added before its children,
+// so one pass in node order sees every parent up to date before its children.
+//
+// The world space boxes of the meshes are kept in a bounding volume hierarchy. It is built once for the set of
+// nodes and afterwards only refit, from the leaves of the moved meshes up to the root. submit() walks it against the
+// view frustum, so a subtree outside the view costs one box test however many meshes it holds, and a subtree wholly
+// inside is taken without testing any further box; only the meshes left are transformed and assembled.
+//
+// With an incremental renderer submit() also adds the damage: for every mesh moved or changed since the previous
+// frame the screen rectangles of its box before and after. Meshes that do not touch the damage are skipped. A camera
+// that moved, or a texture that was loaded or evicted in the meantime, damages the whole frame.
+class SceneGraph
+{
+public:
+    SceneGraph();
+
+    TNodeHandle addNode(TNodeHandle parent = NO_NODE, const TMesh *mesh = NULL);
+    void setMesh(TNodeHandle node, const TMesh *mesh);                          // also after the mesh itself was changed
+    void setTransform(TNodeHandle node, const TMat4x4 &local);
+    const TMat4x4 &worldTransform(TNodeHandle node) const { return nodes[node].world; }
+    const TBounds &worldBounds(TNodeHandle node) const { return nodes[node].bounds; }
+    int nodeCount() const { return (int)nodes.size(); }
+
+    void update();                                                              // called by submit(), when anything is dirty
+    void submit(const TMat4x4 &viewProjection, PrimitiveAssembler &assembler, TextureManager *textureManager,
+                TileRenderer *renderer);
+
+private:
+    struct TSceneNode {
+        TNodeHandle parent;
+        const TMesh *mesh;
+        TMat4x4 local;
+        TMat4x4 world;
+        TBounds meshBounds;                                                     // of the mesh in its own space
+        TBounds bounds;                                                         // the same box in world space
+        int leaf;                                                               // BVH node holding the mesh
+        bool dirty;
+        bool moved;                                                             // world matrix changed in this update()
+        bool damaged;                                                           // moved or changed since the last frame drawn
+        bool drawn;                                                             // had a mesh in the last frame drawn
+        TBounds drawnBounds;                                                    // bounds in the last frame drawn
+    };
+
+    // Nodes are stored in depth first order, so children always follow their parent. Every node covers a range of
+    // objects, the mesh nodes sorted so that each subtree is contiguous.
+    struct TBvhNode {
+        TBounds bounds;
+        int parent;
+        int left;                                                               // children, -1 for a leaf
+        int right;
+        int first;
+        int count;
+        bool refit;
+    };
+
+    std::vector<TSceneNode> nodes;
+    std::vector<TBvhNode> bvh;
+    std::vector<TNodeHandle> objects;
+    std::vector<TNodeHandle> visible;
+    TVertexCache cache;
+    bool dirty;
+    bool rebuild;
+    bool damageTracked;                                                         // the fields below hold the last frame
+    TMat4x4 damageViewProjection;
+    uint64_t damageTextures;                                                    // TextureManager::generation()
+
+    int buildBvh(int first, int count, int parent);
+    void refitBvh();
+    void cullBvh(int index, const TFrustum &frustum, unsigned planeMask);
+    bool addDamage(const TMat4x4 &viewProjection, const PrimitiveAssembler &assembler, TextureManager *textureManager,
+                   TileRenderer *renderer);
+};
+
+#endif // SCENEGRAPH_H
@@ -1,40 +1,613 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
 #include "texture.h"
 
-void Texture::draw(QPainter *painter)
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIPMAP_SSE2
+#endif
+
+#define MIPMAP_PARALLEL_TEXELS  (256 * 256)                                     // smaller levels are not worth splitting up
+
+Texture::Texture()
+{
+    width = 0;
+    height = 0;
+    data = NULL;
+    isPow2 = false;
+    wrapMode = WRAP_CLAMP;
+    layout = LAYOUT_MORTON;
+    format = TEXTURE_RGB32;
+    mapPixels = false;
+    levelCount = 0;
+    levels[0].data = NULL;
+    levels[0].packed = NULL;
+}
+
+Texture::Texture(Texture &&other) noexcept : Texture()
 {
-    int x;
-    int y;
-    int offset;
-    QColor Color;
+    *this = std::move(other);
+}
+
+// The texels stay where they are, only the palette moves with the object
+Texture &Texture::operator=(Texture &&other) noexcept
+{
+    int level;
+
+    if (this == &other) return *this;
+    data = other.data;
+    width = other.width;
+    height = other.height;
+    isPow2 = other.isPow2;
+    wrapMode = other.wrapMode;
+    layout = other.layout;
+    format = other.format;
+    mapPixels = other.mapPixels;
+    levelCount = other.levelCount;
+    std::copy(other.levels, other.levels + MAX_MIP_LEVELS, levels);
+    std::copy(other.palette, other.palette + 256, palette);
+    for (level=0; level<levelCount; level++) {
+        if (levels[level].palette) levels[level].palette = palette;
+    }
+    pixels = std::move(other.pixels);
+    mipData = std::move(other.mipData);
+    packedData = std::move(other.packedData);
+    offsetData = std::move(other.offsetData);
+    mapping = std::move(other.mapping);
 
-    if (data == NULL) {
+    other.data = NULL;
+    other.width = 0;
+    other.height = 0;
+    other.levelCount = 0;
+    other.levels[0].data = NULL;
+    other.levels[0].packed = NULL;
+    return *this;
+}
+
+void Texture::draw(FrameBuffer *frameBuffer)
+{
+    int x, y;
+    int lineWidth;
+    int lines;
+
+    if (!isLoaded()) {
         return;
     }
 
-    offset = 0;
-    for (y=0; y<height; y++) {
-        for (x=0; x<width; x++) {
-            painter->setPen(QColor::fromRgb((QRgb)data[x + offset]));
-            painter->drawPoint(x, y);
+    lineWidth = (width < frameBuffer->width) ? width : frameBuffer->width;       // clip the texture to the frame buffer
+    lines = (height < frameBuffer->height) ? height : frameBuffer->height;
+    for (y=0; y<lines; y++) {
+        uint32_t *pixels = frameBuffer->scanLine(y);
+        if (data == NULL) {                                                     // a compact format, decoded texel by texel
+            for (x=0; x<lineWidth; x++) {
+                pixels[x] = getColor(x, y);
+            }
+            continue;
+        }
+        const QRgb *row = data + levels[0].yOffset[y];
+        if (levels[0].xOffset[lineWidth - 1] == (uint32_t)(lineWidth - 1)) {   // linear rows can be copied as a whole
+            memcpy(pixels, row, lineWidth * sizeof(QRgb));
+            continue;
+        }
+        for (x=0; x<lineWidth; x++) {
+            pixels[x] = row[levels[0].xOffset[x]];
         }
-        offset += width;
     }
 }
 
-int Texture::loadFromBitmap(const char *fileName)
+int Texture::loadFromBitmap(const char *fileName, ThreadPool *pool)
 {
-    if ((data = BMPLoader::loadTexture(fileName, width, height)) != NULL) {
-        return 1;
+    if ((data = BMPLoader::loadTexture(fileName, width, height, pixels, pool, mapPixels ? &mapping : NULL)) == NULL) {
+        return 0;
+    }
+
+    bool pow2 = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+    if (mapping.isOpen() && pow2 && layout != LAYOUT_LINEAR) {                  // swizzling rearranges the texels in place
+        if (!pixels.allocate((size_t)width * height * sizeof(QRgb))) return 0;
+        memcpy(pixels.get(), data, (size_t)width * height * sizeof(QRgb));
+        data = pixels.as<QRgb>();
+        mapping.close();
     }
 
-    return 0;
+    generateMipmaps(pool);
+    encode();
+    return 1;
+}
+
+QRgb *Texture::create(int width, int height)
+{
+    mapping.close();
+    pixels.allocate((size_t)width * height * sizeof(QRgb));
+    this->width = width;
+    this->height = height;
+    data = pixels.as<QRgb>();
+    return data;
+}
+
+// Box filters the rows [y0, y1) of the next level from src. Odd sizes repeat the last column or row.
+static void downsampleRows(const TMipLevel &src, const TMipLevel &dst, int y0, int y1)
+{
+    int x, y, c;
+
+    for (y=y0; y<y1; y++) {
+        const QRgb *row0 = src.data + std::min(2 * y, src.height - 1) * src.width;
+        const QRgb *row1 = src.data + std::min(2 * y + 1, src.height - 1) * src.width;
+        QRgb *out = dst.data + y * dst.width;
+        x = 0;
+
+#if defined(MIPMAP_SSE2)
+        // Four source texels of both rows give two destination texels
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        for (; 2 * x + 3 < src.width && x + 1 < dst.width; x+=2) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(row0 + 2 * x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(row1 + 2 * x));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));    // texels 0 and 1
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));    // texels 2 and 3
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), round), 2);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(sum, zero));
+        }
+#endif
+
+        for (; x<dst.width; x++) {
+            int x0 = std::min(2 * x, src.width - 1);
+            int x1 = std::min(2 * x + 1, src.width - 1);
+            const unsigned char *t00 = (const unsigned char *)(row0 + x0);
+            const unsigned char *t01 = (const unsigned char *)(row0 + x1);
+            const unsigned char *t10 = (const unsigned char *)(row1 + x0);
+            const unsigned char *t11 = (const unsigned char *)(row1 + x1);
+            unsigned char *o = (unsigned char *)(out + x);
+            for (c=0; c<4; c++) {
+                o[c] = (t00[c] + t01[c] + t10[c] + t11[c] + 2) >> 2;
+            }
+        }
+    }
+}
+
+void Texture::generateMipmaps(ThreadPool *pool)
+{
+    int level;
+    size_t texels = 0;
+
+    mipData.release();
+    isPow2 = width > 0 && height > 0 && (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+    levels[0].data = data;
+    levels[0].packed = NULL;
+    levels[0].palette = NULL;
+    levels[0].width = width;
+    levels[0].height = height;
+    levelCount = 1;
+    if (data == NULL) return;
+
+    // The levels are filtered in linear order and rearranged into the requested layout afterwards
+
+    while (levelCount < MAX_MIP_LEVELS &&                                       // sizes of the smaller levels down to 1x1
+           (levels[levelCount-1].width > 1 || levels[levelCount-1].height > 1)) {
+        TMipLevel &next = levels[levelCount];
+        next.width = std::max(levels[levelCount-1].width / 2, 1);
+        next.height = std::max(levels[levelCount-1].height / 2, 1);
+        next.packed = NULL;
+        next.palette = NULL;
+        texels += (size_t)next.width * next.height;
+        levelCount++;
+    }
+    if (levelCount == 1) {
+        buildAddressTables();
+        return;
+    }
+
+    mipData.allocate(texels * sizeof(QRgb));
+    QRgb *p = mipData.as<QRgb>();
+    for (level=1; level<levelCount; level++) {
+        levels[level].data = p;
+        p += (size_t)levels[level].width * levels[level].height;
+    }
+
+    for (level=1; level<levelCount; level++) {
+        const TMipLevel &src = levels[level-1];
+        const TMipLevel &dst = levels[level];
+        if (pool && pool->threadCount() > 1 && (size_t)dst.width * dst.height >= MIPMAP_PARALLEL_TEXELS) {
+            int bands = pool->threadCount() * 4;                                // a few bands per thread to balance the load
+            pool->parallelFor(bands, [&](int band) {
+                downsampleRows(src, dst, band * dst.height / bands, (band + 1) * dst.height / bands);
+            });
+        }
+        else {
+            downsampleRows(src, dst, 0, dst.height);
+        }
+    }
+
+    buildAddressTables();
+}
+
+// Spreads the lower 16 bits of x to the even bit positions
+static inline uint32_t spreadBits(uint32_t x)
+{
+    x &= 0xFFFF;
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+void Texture::buildAddressTables()
+{
+    int level, x, y;
+    size_t entries = 0;
+
+    for (level=0; level<levelCount; level++) {
+        entries += levels[level].width + levels[level].height;
+    }
+    offsetData.allocate(entries * sizeof(uint32_t));
+
+    uint32_t *p = offsetData.as<uint32_t>();
+    TextureStorage linear;                                                      // taken when the first level is reordered
+    for (level=0; level<levelCount; level++) {
+        TMipLevel &l = levels[level];
+        uint32_t *xOffset = l.xOffset = p;
+        uint32_t *yOffset = l.yOffset = p + l.width;
+        p += l.width + l.height;
+
+        if (layout == LAYOUT_MORTON && isPow2) {
+            // Square blocks of the shorter side in Z-order, placed one after another along the longer side
+            int side = std::min(l.width, l.height);
+            int bits = 0;
+            while ((1 << bits) < side) bits++;
+            for (x=0; x<l.width; x++) {
+                xOffset[x] = spreadBits(x & (side - 1)) + (uint32_t)(x >> bits) * side * side;
+            }
+            for (y=0; y<l.height; y++) {
+                yOffset[y] = (spreadBits(y & (side - 1)) << 1) + (uint32_t)(y >> bits) * side * side;
+            }
+        }
+        else if (layout == LAYOUT_TILED && isPow2 && l.width >= 4 && l.height >= 4) {
+            for (x=0; x<l.width; x++) {
+                xOffset[x] = (x >> 2) * 16 + (x & 3);
+            }
+            for (y=0; y<l.height; y++) {
+                yOffset[y] = (y >> 2) * (l.width * 4) + (y & 3) * 4;
+            }
+        }
+        else {
+            for (x=0; x<l.width; x++) {
+                xOffset[x] = x;
+            }
+            for (y=0; y<l.height; y++) {
+                yOffset[y] = y * l.width;
+            }
+            continue;                                                           // already in place
+        }
+
+        // A copy of the level to reorder from; the levels only get smaller, so the pool block of the first one does
+        if (!linear) linear.allocate((size_t)l.width * l.height * sizeof(QRgb));
+        QRgb *source = linear.as<QRgb>();
+        std::copy(l.data, l.data + (size_t)l.width * l.height, source);
+        for (y=0; y<l.height; y++) {
+            for (x=0; x<l.width; x++) {
+                l.data[xOffset[x] + yOffset[y]] = source[x + y * l.width];
+            }
+        }
+    }
+}
+
+static size_t formatBytes(TTextureFormat format, int width, int height)
+{
+    size_t texels = (size_t)width * height;
+
+    switch (format) {
+    case TEXTURE_INDEXED8:
+        return texels;
+    case TEXTURE_RGB565:
+    case TEXTURE_RGB555:
+        return texels * sizeof(uint16_t);
+    case TEXTURE_BC1:
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BC1_BLOCK_BYTES;
+    default:
+        return texels * sizeof(QRgb);
+    }
+}
+
+size_t Texture::levelBytes(int level) const
+{
+    const TMipLevel &l = levels[level];
+    return formatBytes(l.data ? TEXTURE_RGB32 : format, l.width, l.height);
+}
+
+static inline uint16_t pack565(QRgb c)
+{
+    return (uint16_t)(((qRed(c) * 31 + 127) / 255) << 11 | ((qGreen(c) * 63 + 127) / 255) << 5 | (qBlue(c) * 31 + 127) / 255);
+}
+
+static inline uint16_t pack555(QRgb c)
+{
+    return (uint16_t)(((qRed(c) * 31 + 127) / 255) << 10 | ((qGreen(c) * 31 + 127) / 255) << 5 | (qBlue(c) * 31 + 127) / 255);
+}
+
+static inline int colorDistance(QRgb a, QRgb b)
+{
+    int dr = qRed(a) - qRed(b), dg = qGreen(a) - qGreen(b), db = qBlue(a) - qBlue(b);
+    return dr * dr + dg * dg + db * db;
+}
+
+// The two end colors are the texels farthest apart along the principal axis of the block (a few power iterations on
+// the covariance of its colors), every texel takes the nearest of the four colors they give
+static void encodeBC1Block(const QRgb texels[16], uint8_t *block)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f }, cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, axis[3] = { 1.0f, 1.0f, 1.0f };
+    QRgb colors[4];
+    int i, j, iteration;
+
+    for (i=0; i<16; i++) {
+        mean[0] += qRed(texels[i]) / 16.0f;
+        mean[1] += qGreen(texels[i]) / 16.0f;
+        mean[2] += qBlue(texels[i]) / 16.0f;
+    }
+    for (i=0; i<16; i++) {
+        float r = qRed(texels[i]) - mean[0], g = qGreen(texels[i]) - mean[1], b = qBlue(texels[i]) - mean[2];
+        cov[0] += r * r;  cov[1] += r * g;  cov[2] += r * b;
+        cov[3] += g * g;  cov[4] += g * b;  cov[5] += b * b;
+    }
+    for (iteration=0; iteration<4; iteration++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+        if (length == 0.0f) break;                                              // a single color, any axis will do
+        axis[0] = x / length;  axis[1] = y / length;  axis[2] = z / length;
+    }
+
+    int lo = 0, hi = 0;
+    float loProjection = 0.0f, hiProjection = 0.0f;
+    for (i=0; i<16; i++) {
+        float p = qRed(texels[i]) * axis[0] + qGreen(texels[i]) * axis[1] + qBlue(texels[i]) * axis[2];
+        if (i == 0 || p < loProjection) { lo = i; loProjection = p; }
+        if (i == 0 || p > hiProjection) { hi = i; hiProjection = p; }
+    }
+
+    uint16_t c0 = pack565(texels[hi]), c1 = pack565(texels[lo]);
+    if (c0 < c1) std::swap(c0, c1);                                             // four colors, not three and black
+    uint8_t probe[BC1_BLOCK_BYTES] = { (uint8_t)c0, (uint8_t)(c0 >> 8), (uint8_t)c1, (uint8_t)(c1 >> 8), 0, 0, 0, 0 };
+    uint32_t indices = 0;
+    for (i=0; i<4; i++) {                                                       // the colors as the decoder sees them
+        probe[4] = (uint8_t)i;
+        colors[i] = decodeBC1(probe, 0);
+    }
+    for (i=0; i<16 && c0 != c1; i++) {                                          // equal colors - every index stays 0
+        int best = 0;
+        for (j=1; j<4; j++) {
+            if (colorDistance(texels[i], colors[j]) < colorDistance(texels[i], colors[best])) best = j;
+        }
+        indices |= (uint32_t)best << (2 * i);
+    }
+
+    block[0] = (uint8_t)c0;
+    block[1] = (uint8_t)(c0 >> 8);
+    block[2] = (uint8_t)c1;
+    block[3] = (uint8_t)(c1 >> 8);
+    for (i=0; i<4; i++) {
+        block[4 + i] = (uint8_t)(indices >> (8 * i));
+    }
+}
+
+#define PALETTE_KEY(c)  ((((c) >> 9) & 0x7c00) | (((c) >> 6) & 0x03e0) | (((c) >> 3) & 0x001f))  // 5 bits per channel
+#define PALETTE_HASH_BITS   10                                                  // 1024 slots for at most 257 colors
+
+// The colors of level 0 when there are no more than 256 of them (an 8-bit bitmap keeps its palette exactly), a
+// median cut of a histogram of 5 bits per channel otherwise
+void Texture::buildPalette()
+{
+    std::vector<QRgb> colors;
+    QRgb slots[1 << PALETTE_HASH_BITS];
+    bool used[1 << PALETTE_HASH_BITS] = { false };
+    size_t i, texels = (size_t)width * height;
+    int k;
+
+    for (k=0; k<256; k++) {
+        palette[k] = qRgb(0, 0, 0);
+    }
+    colors.reserve(257);
+    for (i=0; i<texels && colors.size()<=256; i++) {                            // the colors seen so far in a hash set
+        uint32_t slot = ((uint32_t)data[i] * 2654435761u) >> (32 - PALETTE_HASH_BITS);
+        while (used[slot] && slots[slot] != data[i]) slot = (slot + 1) & ((1 << PALETTE_HASH_BITS) - 1);
+        if (used[slot]) continue;
+        used[slot] = true;
+        slots[slot] = data[i];
+        colors.push_back(data[i]);
+    }
+    if (colors.size() <= 256) {
+        std::copy(colors.begin(), colors.end(), palette);
+        return;
+    }
+
+    struct TBox {
+        int first;
+        int count;
+    };
+    auto channel = [](int key, int c) { return (key >> (10 - 5 * c)) & 31; };
+    std::vector<uint32_t> histogram(1 << 15, 0);
+    std::vector<int> keys;
+    for (i=0; i<texels; i++) {
+        histogram[PALETTE_KEY(data[i])]++;
+    }
+    for (k=0; k<(int)histogram.size(); k++) {
+        if (histogram[k]) keys.push_back(k);
+    }
+
+    // Split the box with the widest range of any channel at the median texel along that channel until there are 256
+    std::vector<TBox> boxes = { { 0, (int)keys.size() } };
+    while (boxes.size() < 256) {
+        int widest = -1, widestChannel = 0, widestRange = 0;
+        for (k=0; k<(int)boxes.size(); k++) {
+            for (int c=0; c<3; c++) {
+                int lo = 31, hi = 0;
+                for (int j=boxes[k].first; j<boxes[k].first+boxes[k].count; j++) {
+                    lo = std::min(lo, channel(keys[j], c));
+                    hi = std::max(hi, channel(keys[j], c));
+                }
+                if (hi - lo > widestRange) {
+                    widest = k;
+                    widestChannel = c;
+                    widestRange = hi - lo;
+                }
+            }
+        }
+        if (widest < 0) break;                                                  // every box holds a single color
+
+        TBox box = boxes[widest];
+        std::sort(keys.begin() + box.first, keys.begin() + box.first + box.count,
+                  [&](int a, int b) { return channel(a, widestChannel) < channel(b, widestChannel); });
+        uint64_t total = 0, below = 0;
+        for (k=box.first; k<box.first+box.count; k++) total += histogram[keys[k]];
+        int split = box.first + 1;
+        for (k=box.first; k<box.first+box.count-1; k++) {
+            below += histogram[keys[k]];
+            split = k + 1;
+            if (2 * below >= total) break;
+        }
+        boxes[widest].count = split - box.first;
+        boxes.push_back({ split, box.first + box.count - split });
+    }
+
+    for (k=0; k<(int)boxes.size(); k++) {                                       // the texel weighted mean of every box
+        uint64_t sum[3] = { 0, 0, 0 }, weight = 0;
+        for (int j=boxes[k].first; j<boxes[k].first+boxes[k].count; j++) {
+            for (int c=0; c<3; c++) sum[c] += (uint64_t)histogram[keys[j]] * (channel(keys[j], c) * 255 / 31);
+            weight += histogram[keys[j]];
+        }
+        palette[k] = qRgb((int)(sum[0] / weight), (int)(sum[1] / weight), (int)(sum[2] / weight));
+    }
+}
+
+uint8_t Texture::paletteIndex(QRgb color, std::unordered_map<QRgb, uint8_t> &cache) const
+{
+    int i, best = 0;
+
+    auto found = cache.find(color);
+    if (found != cache.end()) return found->second;
+    for (i=1; i<256; i++) {
+        if (colorDistance(color, palette[i]) < colorDistance(color, palette[best])) best = i;
+    }
+    cache[color] = (uint8_t)best;
+    return (uint8_t)best;
+}
+
+// Every level is encoded from its TEXTURE_RGB32 texels, which are freed afterwards. The 8 and 16-bit formats keep
+// the layout of the texels; BC1 reads the blocks through the address tables and rewrites them for its blocks.
+void Texture::encode()
+{
+    int level, x, y, i;
+    size_t n, bytes = 16;                                                       // slack, the SIMD kernels read 32 bits at a time
+    std::unordered_map<QRgb, uint8_t> indices;
+
+    if (format == TEXTURE_RGB32 || data == NULL) return;
+
+    if (format == TEXTURE_INDEXED8) buildPalette();
+    for (level=0; level<levelCount; level++) {
+        bytes += formatBytes(format, levels[level].width, levels[level].height);
+    }
+    packedData.allocate(bytes);
+    memset(packedData.get(), 0, bytes);
+
+    uint8_t *p = packedData.as<uint8_t>();
+    for (level=0; level<levelCount; level++) {
+        TMipLevel &l = levels[level];
+        size_t texels = (size_t)l.width * l.height;
+        l.packed = p;
+        l.palette = palette;
+        p += formatBytes(format, l.width, l.height);
+
+        switch (format) {
+        case TEXTURE_INDEXED8:
+            for (n=0; n<texels; n++) l.packed[n] = paletteIndex(l.data[n], indices);
+            break;
+        case TEXTURE_RGB565:
+            for (n=0; n<texels; n++) ((uint16_t *)l.packed)[n] = pack565(l.data[n]);
+            break;
+        case TEXTURE_RGB555:
+            for (n=0; n<texels; n++) ((uint16_t *)l.packed)[n] = pack555(l.data[n]);
+            break;
+        default: {
+            int blocksX = (l.width + 3) / 4, blocksY = (l.height + 3) / 4;
+            QRgb block[16];
+            for (y=0; y<blocksY; y++) {
+                for (x=0; x<blocksX; x++) {
+                    for (i=0; i<16; i++) {                                      // edges of small levels repeat the last texel
+                        int tx = std::min(x * 4 + (i & 3), l.width - 1), ty = std::min(y * 4 + (i >> 2), l.height - 1);
+                        block[i] = l.data[l.xOffset[tx] + l.yOffset[ty]];
+                    }
+                    encodeBC1Block(block, l.packed + (size_t)(x + y * blocksX) * BC1_BLOCK_BYTES);
+                }
+            }
+            for (x=0; x<l.width; x++) {
+                l.xOffset[x] = (uint32_t)(x >> 2) << 4 | (x & 3);
+            }
+            for (y=0; y<l.height; y++) {
+                l.yOffset[y] = (uint32_t)((y >> 2) * blocksX) << 4 | (y & 3) << 2;
+            }
+            break;
+        }
+        }
+    }
+
+    for (level=0; level<levelCount; level++) {
+        levels[level].data = NULL;
+    }
+    mapping.close();
+    pixels.release();
+    data = NULL;
+    mipData.release();
+}
+
+size_t Texture::memorySize() const
+{
+    size_t bytes = 0;
+    int level;
+
+    if (!isLoaded()) return 0;
+    for (level=0; level<levelCount; level++) {
+        bytes += levelBytes(level);
+        bytes += (size_t)(levels[level].width + levels[level].height) * sizeof(uint32_t);
+    }
+    if (format == TEXTURE_INDEXED8 && data == NULL) bytes += sizeof(palette);
+    return bytes;
+}
+
+// Picks the level whose texels are about one pixel apart, from the change of the texel coordinates (given in texels
+// of level 0) per pixel step in x and in y
+int Texture::selectLevel(float dUdX, float dVdX, float dUdY, float dVdY) const
+{
+    float rho = std::max(dUdX * dUdX + dVdX * dVdX, dUdY * dUdY + dVdY * dVdY);
+    int level;
+
+    if (!(rho > 1.0f)) return 0;                                                // magnified (or NaN)
+    frexpf(rho, &level);                                                        // rho = m * 2^level, 0.5 <= m < 1
+    level = (level - 1) / 2;                                                    // log2(sqrt(rho)) rounded down
+    return std::min(level, levelCount - 1);
 }
 
 QRgb Texture::getColor(int x, int y)
 {
-    if (x < 0) x = 0;
-    if (x > (width - 1)) x = width -1;
-    if (y < 0) y = 0;
-    if (y > (height - 1)) y = height -1;
-    return data[x + y*width];
+    return getColor(0, x, y);
+}
+
+QRgb Texture::getColor(int level, int x, int y)
+{
+    if (levels[level].data) return fetch<WRAP_CLAMP, false, TEXTURE_RGB32>(level, x, y);
+    switch (format) {
+    case TEXTURE_INDEXED8:
+        return fetch<WRAP_CLAMP, false, TEXTURE_INDEXED8>(level, x, y);
+    case TEXTURE_RGB565:
+        return fetch<WRAP_CLAMP, false, TEXTURE_RGB565>(level, x, y);
+    case TEXTURE_RGB555:
+        return fetch<WRAP_CLAMP, false, TEXTURE_RGB555>(level, x, y);
+    case TEXTURE_BC1:
+        return fetch<WRAP_CLAMP, false, TEXTURE_BC1>(level, x, y);
+    default:
+        return fetch<WRAP_CLAMP, false, TEXTURE_RGB32>(level, x, y);
+    }
 }
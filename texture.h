@@ -1,22 +1,191 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <stdint.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 #include <QPainter>
 #include "bmploader.h"
+#include "framebuffer.h"
+#include "mappedfile.h"
+#include "texturestorage.h"
+#include "threadpool.h"
 
+#define MAX_MIP_LEVELS  16
+#define BC1_BLOCK_BYTES 8
+
+enum TWrapMode {
+    WRAP_CLAMP,
+    WRAP_REPEAT,
+    WRAP_MIRROR
+};
+
+enum TTextureLayout {
+    LAYOUT_LINEAR,                                                              // row after row
+    LAYOUT_TILED,                                                               // 4x4 texel blocks, row after row
+    LAYOUT_MORTON                                                               // Z-order curve
+};
+
+// How the texels are kept in memory. Textures are always loaded and filtered as TEXTURE_RGB32 and encoded into the
+// other formats afterwards; every level of a texture has the same format.
+enum TTextureFormat {
+    TEXTURE_RGB32,                                                              // 0xffRRGGBB
+    TEXTURE_INDEXED8,                                                           // an index into a palette of 256 colors
+    TEXTURE_RGB565,
+    TEXTURE_RGB555,
+    TEXTURE_BC1,                                                                // 4x4 blocks of two 565 colors and 2-bit indices
+    TEXTURE_FORMATS
+};
+
+// Texel addressing: where a texel of a level lives is xOffset[x] + yOffset[y], for every layout. Swizzled layouts
+// are only used for power-of-two levels (and tiles only for levels of at least 4x4), the rest stays linear. In
+// TEXTURE_BC1 the sum holds the index of the block above the lowest four bits and the texel within the block in them,
+// the blocks are always stored row after row.
+struct TMipLevel {
+    QRgb *data;                                                                 // TEXTURE_RGB32 texels, NULL in the other formats
+    uint8_t *packed;                                                            // the texels of the other formats
+    const QRgb *palette;                                                        // TEXTURE_INDEXED8
+    int width;
+    int height;
+    uint32_t *xOffset;
+    uint32_t *yOffset;
+};
+
+inline QRgb expand565(uint32_t c)
+{
+    uint32_t r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return 0xff000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+}
+
+inline QRgb expand555(uint32_t c)
+{
+    uint32_t r = (c >> 10) & 31, g = (c >> 5) & 31, b = c & 31;
+    return 0xff000000 | ((r << 3 | r >> 2) << 16) | ((g << 3 | g >> 2) << 8) | (b << 3 | b >> 2);
+}
+
+// Texel i (0-15, row after row) of a BC1 block: two 565 colors followed by 32 bits of 2-bit indices. With the first
+// color greater the indices 2 and 3 are the colors at a third and two thirds between them, otherwise 2 is the middle
+// and 3 is black.
+inline QRgb decodeBC1(const uint8_t *block, int i)
+{
+    uint32_t c0 = block[0] | block[1] << 8;
+    uint32_t c1 = block[2] | block[3] << 8;
+    uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+    int index = (indices >> (2 * i)) & 3;
+
+    if (index == 0) return expand565(c0);
+    if (index == 1) return expand565(c1);
+    QRgb a = expand565(c0), b = expand565(c1);
+    if (c0 > c1) {
+        if (index == 3) std::swap(a, b);
+        return 0xff000000 | (((2 * qRed(a) + qRed(b)) / 3) << 16) | (((2 * qGreen(a) + qGreen(b)) / 3) << 8) |
+               ((2 * qBlue(a) + qBlue(b)) / 3);
+    }
+    if (index == 3) return 0xff000000;
+    return 0xff000000 | (((qRed(a) + qRed(b)) / 2) << 16) | (((qGreen(a) + qGreen(b)) / 2) << 8) |
+           ((qBlue(a) + qBlue(b)) / 2);
+}
+
+// The texel at offset (xOffset[x] + yOffset[y]) of a level in the format chosen at compile time
+template <TTextureFormat Format>
+inline QRgb readTexel(const TMipLevel &l, uint32_t offset)
+{
+    switch (Format) {
+    case TEXTURE_INDEXED8:
+        return l.palette[l.packed[offset]];
+    case TEXTURE_RGB565:
+        return expand565(((const uint16_t *)l.packed)[offset]);
+    case TEXTURE_RGB555:
+        return expand555(((const uint16_t *)l.packed)[offset]);
+    case TEXTURE_BC1:
+        return decodeBC1(l.packed + (offset >> 4) * 8, offset & 15);
+    default:
+        return l.data[offset];
+    }
+}
+
+// Maps a texel coordinate into [0, size) for the wrap mode chosen at compile time. Pow2 = true lets repeat and
+// mirror use masks instead of a division; every mode is branch-free.
+template <TWrapMode Mode, bool Pow2>
+inline int wrapCoord(int c, int size)
+{
+    if (Mode == WRAP_CLAMP) {
+        c = (c < 0) ? 0 : c;
+        return (c > size - 1) ? size - 1 : c;
+    }
+    else if (Mode == WRAP_REPEAT) {
+        if (Pow2) return c & (size - 1);
+        c %= size;
+        return c + ((c >> 31) & size);                                          // the remainder of a negative c is negative
+    }
+    else {
+        if (Pow2) {
+            int flip = ((c & size) == 0) - 1;                                   // -1 on every odd repetition
+            return (c & (size - 1)) ^ (flip & (size - 1));
+        }
+        int period = 2 * size;
+        c %= period;
+        c += (c >> 31) & period;
+        return (c < size) ? c : period - 1 - c;
+    }
+}
+
+// A texture owns its texels (see TextureStorage) or the mapped file they are read from, so it can be moved but not
+// copied.
 class Texture
 {
 public:
-    QRgb *data;
+    QRgb *data;                                                                 // level 0, the full resolution image (TEXTURE_RGB32)
     int width;
     int height;
+    bool isPow2;                                                                // both sizes are powers of two
+    TWrapMode wrapMode;
+    TTextureLayout layout;                                                      // requested before loading, applied to power-of-two levels
+    TTextureFormat format;                                                      // requested before loading
+    bool mapPixels;                                                             // use the texels of a matching file in place, read-only
+    int levelCount;
+    TMipLevel levels[MAX_MIP_LEVELS];                                           // each level is half the size of the previous one
 
-    Texture() { width = 0; height = 0; data = NULL; }
-    ~Texture() { if (data) delete data; }
+    Texture();
+    Texture(Texture &&other) noexcept;
+    Texture &operator=(Texture &&other) noexcept;
+    Texture(const Texture &) = delete;
+    Texture &operator=(const Texture &) = delete;
 
-    void draw(QPainter *painter);
-    int loadFromBitmap(const char *fileName);
+    void draw(FrameBuffer *frameBuffer);
+    int loadFromBitmap(const char *fileName, ThreadPool *pool = NULL);
+    QRgb *create(int width, int height);                                        // level 0 to be filled in, then generateMipmaps()
+    void generateMipmaps(ThreadPool *pool = NULL);
+    void encode();                                                              // the TEXTURE_RGB32 levels into format
+    bool isLoaded() const { return levels[0].data != NULL || levels[0].packed != NULL; }
+    size_t levelBytes(int level) const;                                         // texels of a level alone
+    size_t memorySize() const;                                                  // texels of all levels and their address tables
+    int selectLevel(float dUdX, float dVdX, float dUdY, float dVdY) const;
     QRgb getColor(int x, int y);
+    QRgb getColor(int level, int x, int y);
+
+    // Texel x, y (in texels of level 0) of a level
+    template <TWrapMode Mode, bool Pow2, TTextureFormat Format>
+    inline QRgb fetch(int level, int x, int y) const
+    {
+        const TMipLevel &l = levels[level];
+        x = wrapCoord<Mode, Pow2>(x >> level, l.width);
+        y = wrapCoord<Mode, Pow2>(y >> level, l.height);
+        return readTexel<Format>(l, l.xOffset[x] + l.yOffset[y]);
+    }
+
+private:
+    TextureStorage pixels;                                                      // level 0 unless mapped
+    TextureStorage mipData;                                                     // levels 1 and above share one block
+    TextureStorage packedData;                                                  // all levels of a compact format
+    QRgb palette[256];
+    TextureStorage offsetData;                                                  // address tables of all levels
+    MappedFile mapping;                                                         // holds level 0 when it is used straight from the file
+
+    void buildAddressTables();
+    void buildPalette();
+    uint8_t paletteIndex(QRgb color, std::unordered_map<QRgb, uint8_t> &cache) const;
 };
 
 #endif // TEXTURE_H
@@ -0,0 +1,259 @@
+#include <string.h>
+#include <algorithm>
+#include "texturemanager.h"
+
+#define PLACEHOLDER_SIZE    8
+#define PLACEHOLDER_CHECKER 2                                                   // texels per square
+
+// Level 0 as stored, in whatever format
+static const unsigned char *texelBytes(const Texture *texture)
+{
+    const TMipLevel &level = texture->levels[0];
+    return level.data ? (const unsigned char *)level.data : level.packed;
+}
+
+static uint64_t hashBytes(uint64_t hash, const unsigned char *bytes, size_t size)
+{
+    uint64_t word;
+    size_t i;
+
+    for (i=0; i+8<=size; i+=8) {
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i<size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Hash of the texels of level 0 (and the palette of an indexed texture), eight bytes at a time
+static uint64_t hashTexels(const Texture *texture)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL ^ ((uint64_t)texture->width << 32) ^ (uint64_t)texture->height;
+
+    hash = hashBytes(hash ^ ((uint64_t)texture->format << 56), texelBytes(texture), texture->levelBytes(0));
+    if (texture->format == TEXTURE_INDEXED8) {
+        hash = hashBytes(hash, (const unsigned char *)texture->levels[0].palette, 256 * sizeof(QRgb));
+    }
+    return hash;
+}
+
+static bool sameTexels(const Texture *a, const Texture *b)
+{
+    if (a->width != b->width || a->height != b->height || a->layout != b->layout || a->format != b->format) return false;
+    if (a->wrapMode != b->wrapMode) return false;
+    if (a->format == TEXTURE_INDEXED8 && memcmp(a->levels[0].palette, b->levels[0].palette, 256 * sizeof(QRgb)) != 0) {
+        return false;
+    }
+    return memcmp(texelBytes(a), texelBytes(b), a->levelBytes(0)) == 0;
+}
+
+TextureManager::TextureManager(int loaderCount, size_t memoryBudget)
+{
+    int i, x, y;
+
+    pending = 0;
+    stopping = false;
+    format = TEXTURE_RGB32;
+    frame = 0;
+    changes = 0;
+    budget = memoryBudget;
+    used = 0;
+
+    placeholder.create(PLACEHOLDER_SIZE, PLACEHOLDER_SIZE);
+    placeholder.wrapMode = WRAP_REPEAT;
+    for (y=0; y<PLACEHOLDER_SIZE; y++) {
+        for (x=0; x<PLACEHOLDER_SIZE; x++) {
+            bool odd = ((x / PLACEHOLDER_CHECKER) ^ (y / PLACEHOLDER_CHECKER)) & 1;
+            placeholder.data[x + y * PLACEHOLDER_SIZE] = odd ? qRgb(255, 0, 255) : qRgb(64, 64, 64);
+        }
+    }
+    placeholder.generateMipmaps();
+
+    if (loaderCount < 1) loaderCount = 1;
+    for (i=0; i<loaderCount; i++) {
+        loaders.push_back(std::thread(&TextureManager::loaderMain, this));
+    }
+}
+
+TextureManager::~TextureManager()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &loader : loaders) {
+        loader.join();
+    }
+}
+
+TTextureHandle TextureManager::load(const char *fileName, TWrapMode wrapMode)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::pair<std::string, int> key(fileName, (int)wrapMode | (int)format << 8);
+
+    auto found = byPath.find(key);
+    if (found != byPath.end()) return found->second;
+
+    TTextureHandle handle = (TTextureHandle)entries.size();
+    TEntry entry;
+    entry.fileName = fileName;
+    entry.wrapMode = wrapMode;
+    entry.format = format;
+    entry.state = STATE_QUEUED;
+    entry.content = NULL;
+    entries.push_back(entry);
+    byPath[key] = handle;
+    enqueue(handle);
+    return handle;
+}
+
+// Called with the lock held
+void TextureManager::enqueue(TTextureHandle handle)
+{
+    entries[handle].state = STATE_QUEUED;
+    queue.push_back(handle);
+    pending++;
+    wake.notify_one();
+}
+
+Texture *TextureManager::texture(TTextureHandle handle)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (handle < 0 || handle >= (int)entries.size()) return &placeholder;
+    TEntry &entry = entries[handle];
+    if (entry.state == STATE_EVICTED) enqueue(handle);
+    if (entry.state != STATE_READY) return &placeholder;
+
+    entry.content->lastUsed = frame;
+    return entry.content->texture.get();
+}
+
+bool TextureManager::isReady(TTextureHandle handle)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return handle >= 0 && handle < (int)entries.size() && entries[handle].state == STATE_READY;
+}
+
+uint64_t TextureManager::generation()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return changes;
+}
+
+void TextureManager::waitForLoads()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    loaded.wait(guard, [this]() { return pending == 0; });
+}
+
+void TextureManager::beginFrame()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    frame++;
+    evict();
+}
+
+void TextureManager::setTextureFormat(TTextureFormat format)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->format = format;
+}
+
+void TextureManager::setMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    budget = bytes;
+}
+
+size_t TextureManager::memoryUsed()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return used;
+}
+
+// Called with the lock held. Textures drawn by the previous frame are kept even when that exceeds the budget.
+void TextureManager::evict()
+{
+    std::vector<std::pair<uint64_t, TContent *>> candidates;                   // last use, texture
+
+    if (budget == 0 || used <= budget) return;
+
+    for (auto &bucket : contents) {
+        for (TContent &content : bucket.second) {
+            if (content.lastUsed + 1 < frame) candidates.push_back(std::make_pair(content.lastUsed, &content));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto &candidate : candidates) {
+        if (used <= budget) break;
+        TContent *content = candidate.second;
+        for (TTextureHandle user : content->users) {
+            entries[user].state = STATE_EVICTED;
+            entries[user].content = NULL;
+        }
+        used -= content->bytes;
+        auto bucket = contents.find(content->key);                              // the others with this hash stay found
+        bucket->second.remove_if([content](const TContent &other) { return &other == content; });
+        if (bucket->second.empty()) contents.erase(bucket);
+        changes++;
+    }
+}
+
+void TextureManager::loaderMain()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+        wake.wait(guard, [this]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+
+        TTextureHandle handle = queue.front();
+        queue.pop_front();
+        std::string fileName = entries[handle].fileName;
+        TWrapMode wrapMode = entries[handle].wrapMode;
+        TTextureFormat format = entries[handle].format;
+
+        guard.unlock();
+        std::shared_ptr<Texture> texture(new Texture);
+        texture->wrapMode = wrapMode;
+        texture->format = format;
+        bool ok = texture->loadFromBitmap(fileName.c_str()) != 0;
+        uint64_t hash = ok ? hashTexels(texture.get()) : 0;
+        guard.lock();
+
+        TEntry &entry = entries[handle];
+        if (!ok) {
+            entry.state = STATE_FAILED;
+        }
+        else {
+            std::pair<uint64_t, int> key(hash, (int)wrapMode);
+            std::list<TContent> &bucket = contents[key];
+            auto found = bucket.begin();
+            while (found != bucket.end() && !sameTexels(found->texture.get(), texture.get())) {
+                ++found;                                                        // a hash collision
+            }
+            if (found == bucket.end()) {
+                found = bucket.insert(bucket.end(), TContent());
+                found->texture = texture;
+                found->bytes = texture->memorySize();
+                found->lastUsed = frame;
+                found->key = key;
+                used += found->bytes;
+            }
+            if (std::find(found->users.begin(), found->users.end(), handle) == found->users.end()) {
+                found->users.push_back(handle);
+            }
+            entry.content = &*found;
+            entry.state = STATE_READY;
+            changes++;
+        }
+
+        if (--pending == 0) loaded.notify_all();
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "texture.h"
+
+typedef int TTextureHandle;                                                     // index of a texture in its manager
+
+#define NO_TEXTURE  (-1)
+
+// Registry of the textures of a scene. load() only queues the file for the background loader threads and returns a
+// handle straight away; texture() resolves a handle to the loaded texture, or to a checkerboard placeholder while the
+// file is still being read. Files are shared by path, and textures that turn out to have identical texels share one
+// copy. When a memory budget is set, beginFrame() evicts the textures that were used least recently (never those
+// used by the previous frame); an evicted texture is loaded again the next time it is asked for. Textures are stored
+// in the format set when load() is called; the placeholder is always TEXTURE_RGB32.
+class TextureManager
+{
+public:
+    explicit TextureManager(int loaderCount = 2, size_t memoryBudget = 0);     // budget in bytes, 0 - unlimited
+    ~TextureManager();
+
+    TextureManager(const TextureManager &) = delete;
+    TextureManager &operator=(const TextureManager &) = delete;
+
+    TTextureHandle load(const char *fileName, TWrapMode wrapMode = WRAP_CLAMP);
+    Texture *texture(TTextureHandle handle);
+    bool isReady(TTextureHandle handle);
+    uint64_t generation();                                                      // changes when any handle resolves differently
+    void waitForLoads();
+
+    void beginFrame();                                                          // call between frames, textures are freed only here
+    void setTextureFormat(TTextureFormat format);                              // for the textures loaded afterwards
+    void setMemoryBudget(size_t bytes);
+    size_t memoryUsed();
+
+private:
+    enum TState {
+        STATE_QUEUED,
+        STATE_READY,
+        STATE_FAILED,
+        STATE_EVICTED
+    };
+
+    struct TContent {
+        std::shared_ptr<Texture> texture;
+        size_t bytes;
+        uint64_t lastUsed;                                                      // frame number
+        std::pair<uint64_t, int> key;                                           // of its list in contents
+        std::vector<TTextureHandle> users;
+    };
+
+    struct TEntry {
+        std::string fileName;
+        TWrapMode wrapMode;
+        TTextureFormat format;
+        TState state;
+        TContent *content;                                                      // in contents when ready
+    };
+
+    std::vector<std::thread> loaders;
+    std::deque<TTextureHandle> queue;
+    std::vector<TEntry> entries;
+    std::map<std::pair<std::string, int>, TTextureHandle> byPath;              // path, wrap mode and format -> handle
+    std::map<std::pair<uint64_t, int>, std::list<TContent>> contents;          // texel hash and wrap mode -> textures
+    Texture placeholder;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable loaded;
+    int pending;                                                                // queued or being loaded
+    bool stopping;
+    uint64_t frame;
+    uint64_t changes;                                                           // textures loaded or evicted so far
+    TTextureFormat format;
+    size_t budget;
+    size_t used;
+
+    void loaderMain();
+    void enqueue(TTextureHandle handle);
+    void evict();
+};
+
+#endif // TEXTUREMANAGER_H
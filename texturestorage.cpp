@@ -0,0 +1,135 @@
+#include <mutex>
+#include <utility>
+#include "alignedmemory.h"
+#include "texturestorage.h"
+
+#define SIZE_CLASSES    240                                                     // four per power of two from 64 bytes
+
+struct TFreeBlock {
+    TFreeBlock *next;
+};
+
+static std::mutex poolLock;
+static TFreeBlock *freeLists[SIZE_CLASSES];
+static size_t retained = 0;
+static size_t limit = TEXTURE_POOL_RETAINED;
+
+// The size class of a request and the size of the blocks in it: 4, 5, 6 or 7 times a power of two, 64 bytes or more
+static int sizeClass(size_t bytes, size_t &capacity)
+{
+    int shift = 4;
+    size_t steps;
+
+    while (((size_t)8 << shift) < bytes) shift++;                               // bytes <= 8 << shift
+    steps = (bytes + ((size_t)1 << shift) - 1) >> shift;                        // 5 to 8 (fewer only for 64 bytes or less)
+    if (steps < 4) steps = 4;
+    if (steps == 8) {
+        steps = 4;
+        shift++;
+    }
+    capacity = steps << shift;
+    return (shift - 4) * 4 + (int)(steps - 4);
+}
+
+// Frees the blocks of the largest classes until no more than limit bytes are kept; the pool lock is held
+static void trimPool()
+{
+    int i;
+    size_t capacity;
+
+    for (i=SIZE_CLASSES-1; i>=0 && retained > limit; i--) {
+        capacity = (size_t)(4 + i % 4) << (i / 4 + 4);
+        while (freeLists[i] && retained > limit) {
+            TFreeBlock *block = freeLists[i];
+            freeLists[i] = block->next;
+            retained -= capacity;
+            alignedFree(block);
+        }
+    }
+}
+
+TextureStorage::TextureStorage(size_t bytes)
+{
+    block = NULL;
+    this->bytes = 0;
+    allocate(bytes);
+}
+
+TextureStorage::TextureStorage(TextureStorage &&other) noexcept
+{
+    block = other.block;
+    bytes = other.bytes;
+    other.block = NULL;
+    other.bytes = 0;
+}
+
+TextureStorage &TextureStorage::operator=(TextureStorage &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        std::swap(block, other.block);
+        std::swap(bytes, other.bytes);
+    }
+    return *this;
+}
+
+bool TextureStorage::allocate(size_t bytes)
+{
+    size_t capacity;
+
+    release();
+    if (bytes == 0) return true;
+    int index = sizeClass(bytes, capacity);
+    {
+        std::lock_guard<std::mutex> guard(poolLock);
+        if (freeLists[index]) {
+            block = freeLists[index];
+            freeLists[index] = freeLists[index]->next;
+            retained -= capacity;
+        }
+    }
+    if (block == NULL) block = alignedAlloc(capacity);
+    if (block == NULL) return false;
+    this->bytes = bytes;
+    return true;
+}
+
+void TextureStorage::release()
+{
+    size_t capacity;
+
+    if (block == NULL) return;
+    int index = sizeClass(bytes, capacity);
+    {
+        std::lock_guard<std::mutex> guard(poolLock);
+        if (retained + capacity <= limit) {
+            TFreeBlock *entry = (TFreeBlock *)block;
+            entry->next = freeLists[index];
+            freeLists[index] = entry;
+            retained += capacity;
+            block = NULL;
+        }
+    }
+    if (block) alignedFree(block);                                              // the pool is full
+    block = NULL;
+    bytes = 0;
+}
+
+size_t TextureStorage::retainedLimit()
+{
+    std::lock_guard<std::mutex> guard(poolLock);
+    return limit;
+}
+
+void TextureStorage::setRetainedLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(poolLock);
+    limit = bytes;
+    trimPool();
+}
+
+size_t TextureStorage::retainedBytes()
+{
+    std::lock_guard<std::mutex> guard(poolLock);
+    return retained;
+}
@@ -0,0 +1,43 @@
+#ifndef TEXTURESTORAGE_H
+#define TEXTURESTORAGE_H
+
+#include <stddef.h>
+
+#define TEXTURE_POOL_RETAINED   (64u << 20)                                     // bytes kept for reuse by default
+
+// The memory of one texel array, aligned to a cache line. Blocks come from a pool shared by all textures: a released
+// block goes on the free list of its size class (sizes are rounded up to 1, 1.25, 1.5 or 1.75 times a power of two,
+// so at most a fifth of a block is wasted) and is handed to the next texture needing about as much, so textures
+// evicted and streamed in again by the texture manager reuse their memory instead of going back to the heap. The
+// pool keeps up to retainedLimit() bytes this way and frees what is released beyond that.
+//
+// A storage owns its block and can be moved but not copied.
+class TextureStorage
+{
+public:
+    TextureStorage() { block = NULL; bytes = 0; }
+    explicit TextureStorage(size_t bytes);
+    ~TextureStorage() { release(); }
+
+    TextureStorage(TextureStorage &&other) noexcept;
+    TextureStorage &operator=(TextureStorage &&other) noexcept;
+    TextureStorage(const TextureStorage &) = delete;
+    TextureStorage &operator=(const TextureStorage &) = delete;
+
+    bool allocate(size_t bytes);                                                // releases the current block first
+    void release();
+    void *get() const { return block; }
+    template <class T> T *as() const { return (T *)block; }
+    size_t size() const { return bytes; }
+    explicit operator bool() const { return block != NULL; }
+
+    static size_t retainedLimit();
+    static void setRetainedLimit(size_t bytes);                                 // frees blocks beyond the new limit
+    static size_t retainedBytes();                                              // in free blocks right now
+
+private:
+    void *block;
+    size_t bytes;                                                               // as requested
+};
+
+#endif // TEXTURESTORAGE_H
@@ -0,0 +1,63 @@
+# Renderer sources, built into a static library by library/library.pro
+
+INCLUDEPATH += $$PWD
+
+# Every SIMD level has to produce the same image, FMA contraction inside the AVX-512 kernel would round differently
+gcc|clang: QMAKE_CXXFLAGS += -ffp-contract=off
+
+# qmake CONFIG+=texturing_profile builds the counters and stage timers in (see profiler.h); library/library.pri
+# passes the same define on to the programs linked with the library
+texturing_profile: DEFINES += TEXTURING_PROFILE
+
+SOURCES += \
+        $$PWD/bmploader.cpp \
+        $$PWD/commandbuffer.cpp \
+        $$PWD/cubescene.cpp \
+        $$PWD/depthbuffer.cpp \
+        $$PWD/dynamicresolution.cpp \
+        $$PWD/edgerasterizer.cpp \
+        $$PWD/framearena.cpp \
+        $$PWD/framebuffer.cpp \
+        $$PWD/framewriter.cpp \
+        $$PWD/instancebatch.cpp \
+        $$PWD/mappedfile.cpp \
+        $$PWD/mesh.cpp \
+        $$PWD/meshloader.cpp \
+        $$PWD/primitiveassembler.cpp \
+        $$PWD/profiler.cpp \
+        $$PWD/rasterizer.cpp \
+        $$PWD/rendercontext.cpp \
+        $$PWD/renderthread.cpp \
+        $$PWD/scenegraph.cpp \
+        $$PWD/texture.cpp \
+        $$PWD/texturemanager.cpp \
+        $$PWD/texturestorage.cpp \
+        $$PWD/threadpool.cpp \
+        $$PWD/tilerenderer.cpp
+
+HEADERS += \
+    $$PWD/alignedmemory.h \
+    $$PWD/bmploader.h \
+    $$PWD/commandbuffer.h \
+    $$PWD/cubescene.h \
+    $$PWD/depthbuffer.h \
+    $$PWD/dynamicresolution.h \
+    $$PWD/edgerasterizer.h \
+    $$PWD/framearena.h \
+    $$PWD/framebuffer.h \
+    $$PWD/framewriter.h \
+    $$PWD/instancebatch.h \
+    $$PWD/mappedfile.h \
+    $$PWD/mesh.h \
+    $$PWD/meshloader.h \
+    $$PWD/primitiveassembler.h \
+    $$PWD/profiler.h \
+    $$PWD/rasterizer.h \
+    $$PWD/rendercontext.h \
+    $$PWD/renderthread.h \
+    $$PWD/scenegraph.h \
+    $$PWD/texture.h \
+    $$PWD/texturemanager.h \
+    $$PWD/texturestorage.h \
+    $$PWD/threadpool.h \
+    $$PWD/tilerenderer.h
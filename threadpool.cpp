@@ -0,0 +1,150 @@
+#include "threadpool.h"
+
+static thread_local int currentIndex = 0;                                       // of the queue the thread works on
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    int i;
+
+    if (threadCount <= 0) {
+        threadCount = (int)std::thread::hardware_concurrency();
+        if (threadCount <= 0) threadCount = 1;
+    }
+
+    currentTask = NULL;
+    remaining = 0;
+    generation = 0;
+    busyWorkers = 0;
+    stopping = false;
+
+    for (i=0; i<threadCount; i++) {
+        queues.push_back(new TWorkQueue);
+        queues[i]->front = 0;
+        queues[i]->back = 0;
+    }
+    for (i=0; i<threadCount-1; i++) {                                           // the calling thread is the last worker
+        workers.push_back(std::thread(&ThreadPool::workerMain, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    for (auto queue : queues) {
+        delete queue;
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &task)
+{
+    int i, q;
+    int queueCount = (int)queues.size();
+
+    if (count <= 0) return;
+    if (workers.empty() || count == 1) {
+        currentIndex = queueCount - 1;
+        for (i=0; i<count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> job(jobLock);
+
+    currentTask = &task;                                                        // published to the workers by the queue locks
+    remaining = count;
+    for (q=0; q<queueCount; q++) {                                              // contiguous ranges keep neighbouring items on one thread
+        std::lock_guard<std::mutex> guard(queues[q]->lock);
+        queues[q]->front = q * count / queueCount;
+        queues[q]->back = (q + 1) * count / queueCount;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(queueCount - 1);
+
+    std::unique_lock<std::mutex> guard(stateLock);
+    done.wait(guard, [this]() { return remaining == 0 && busyWorkers == 0; });
+    currentTask = NULL;
+}
+
+void ThreadPool::workerMain(int index)
+{
+    unsigned seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(stateLock);
+            wake.wait(guard, [&]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            busyWorkers++;
+        }
+
+        runTasks(index);
+
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            busyWorkers--;
+            if (remaining == 0 && busyWorkers == 0) {
+                done.notify_all();
+            }
+        }
+    }
+}
+
+int ThreadPool::currentThread()
+{
+    return currentIndex;
+}
+
+void ThreadPool::runTasks(int index)
+{
+    int item;
+
+    currentIndex = index;
+    while (popLocal(index, item) || steal(index, item)) {
+        (*currentTask)(item);
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> guard(stateLock);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popLocal(int index, int &item)
+{
+    TWorkQueue *queue = queues[index];
+    std::lock_guard<std::mutex> guard(queue->lock);
+
+    if (queue->front == queue->back) return false;
+    item = queue->front++;
+    return true;
+}
+
+bool ThreadPool::steal(int index, int &item)
+{
+    int i;
+    int queueCount = (int)queues.size();
+
+    for (i=1; i<queueCount; i++) {                                              // visit the other queues starting with the next one
+        TWorkQueue *queue = queues[(index + i) % queueCount];
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (queue->front != queue->back) {
+            item = --queue->back;
+            return true;
+        }
+    }
+    return false;
+}
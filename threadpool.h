@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A persistent pool of worker threads. parallelFor() splits the index range into one contiguous queue per thread,
+// every thread works through its own queue from the front and, once it runs dry, steals from the back of the other
+// queues. The calling thread takes part in the work, so a pool with no workers simply runs the loop inline. A queue
+// is only a range of indices, so a parallelFor() allocates nothing.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount = 0);                                   // 0 - one thread per hardware core
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int threadCount() const { return (int)queues.size(); }
+    void parallelFor(int count, const std::function<void(int)> &task);
+    static int currentThread();                                                 // within a task, 0 to threadCount() - 1
+
+private:
+    struct TWorkQueue {
+        std::mutex lock;
+        int front;                                                              // the items left are [front, back)
+        int back;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<TWorkQueue *> queues;                                           // the last queue belongs to the calling thread
+    const std::function<void(int)> *currentTask;
+    std::atomic<int> remaining;
+
+    std::mutex jobLock;                                                         // one parallelFor() at a time
+    std::mutex stateLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned generation;
+    int busyWorkers;
+    bool stopping;
+
+    void workerMain(int index);
+    void runTasks(int index);
+    bool popLocal(int index, int &item);
+    bool steal(int index, int &item);
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include "alignedmemory.h"
+#include "profiler.h"
+#include "tilerenderer.h"
+
+TileRenderer::TileRenderer(ThreadPool *pool)
+{
+    int i;
+
+    this->pool = pool;
+    mode = RASTERIZER_SCANLINE;
+    shading = SHADING_FORWARD;
+    incremental = false;
+    frameBuffer = NULL;
+    depthBuffer = NULL;
+    clearColor = 0;
+    tilesX = 0;
+    tilesY = 0;
+    resolveScratch = NULL;
+    scratchBytes = 0;
+    frame = 0;
+    damaged = { 0, 0, 0, 0 };
+    for (i=0; i<DAMAGE_HISTORY; i++) {                                          // outlive the frame, so not in the arena
+        damageHistory[i].reserve(DAMAGE_RESERVE);
+    }
+    bufferAges.reserve(DAMAGE_HISTORY);
+}
+
+void TileRenderer::beginFrame(FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, QRgb clearColor)
+{
+    int x, y;
+
+    this->frameBuffer = frameBuffer;
+    this->depthBuffer = depthBuffer;
+    depthBuffer->clear();                                                       // O(1), blocks are cleared when first drawn to
+    this->clearColor = clearColor;
+
+    int newTilesX = (frameBuffer->width + TILE_SIZE - 1) / TILE_SIZE;
+    int newTilesY = (frameBuffer->height + TILE_SIZE - 1) / TILE_SIZE;
+    if (newTilesX != tilesX || newTilesY != tilesY) {                           // the frame buffer has been resized
+        tilesX = newTilesX;
+        tilesY = newTilesY;
+        tiles.resize(tilesX * tilesY);
+        for (y=0; y<tilesY; y++) {
+            for (x=0; x<tilesX; x++) {
+                TRect &rect = tiles[x + y * tilesX].rect;
+                rect.x0 = x * TILE_SIZE;
+                rect.y0 = y * TILE_SIZE;
+                rect.x1 = std::min(rect.x0 + TILE_SIZE, frameBuffer->width);
+                rect.y1 = std::min(rect.y0 + TILE_SIZE, frameBuffer->height);
+            }
+        }
+    }
+
+    arena.reset();                                                              // the previous frame is done with
+    for (auto &tile : tiles) {                                                  // sized after the previous frame
+        size_t count = tile.triangles.size();
+        tile.triangles = ArenaVector<int>(ArenaAllocator<int>(&arena));
+        tile.triangles.reserve(count + count / 4);
+        tile.damage = { 0, 0, 0, 0 };
+    }
+    size_t count = frameTriangles.size();
+    frameTriangles = ArenaVector<TTriangle>(ArenaAllocator<TTriangle>(&arena));
+    frameTriangles.reserve(count + count / 4);
+
+    frame++;
+    damageHistory[frame % DAMAGE_HISTORY].clear();
+    damaged = { 0, 0, 0, 0 };
+    uint64_t last = lastFrameIn(frameBuffer);
+    if (!incremental) {
+        invalidate();                                                           // also for the buffers drawn incrementally later
+    }
+    else if (last == 0 || frame - last > DAMAGE_HISTORY) {                      // unknown, resized or too old
+        TRect screen = { 0, 0, frameBuffer->width, frameBuffer->height };
+        damageTiles(screen);
+    }
+    else {
+        for (uint64_t f=last+1; f<frame; f++) {                                 // what changed since the buffer was drawn
+            for (const TRect &rect : damageHistory[f % DAMAGE_HISTORY]) {
+                damageTiles(rect);
+            }
+        }
+    }
+}
+
+// The last frame drawn into the buffer at its current size, 0 if none; the buffer is then marked as holding this one
+uint64_t TileRenderer::lastFrameIn(FrameBuffer *frameBuffer)
+{
+    uint64_t last = 0;
+    size_t i, oldest = 0;
+
+    for (i=0; i<bufferAges.size(); i++) {
+        TBufferAge &age = bufferAges[i];
+        if (age.buffer == frameBuffer) {
+            if (age.width == frameBuffer->width && age.height == frameBuffer->height) last = age.frame;
+            break;
+        }
+        if (age.frame < bufferAges[oldest].frame) oldest = i;
+    }
+    if (i == bufferAges.size()) {
+        if (bufferAges.size() < DAMAGE_HISTORY) bufferAges.push_back(TBufferAge());
+        else i = oldest;
+    }
+    bufferAges[i] = { frameBuffer, frameBuffer->width, frameBuffer->height, frame };
+    return last;
+}
+
+void TileRenderer::addDamage(const TRect &rect)
+{
+    const int mask = DEPTH_BLOCK_SIZE - 1;                                      // blocks are cleared whole, see DepthBuffer
+    TRect screen = { 0, 0, frameBuffer->width, frameBuffer->height };
+    TRect aligned = { rect.x0 & ~mask, rect.y0 & ~mask, (rect.x1 + mask) & ~mask, (rect.y1 + mask) & ~mask };
+
+    aligned = intersectRects(aligned, screen);
+    if (isEmptyRect(aligned)) return;
+    damageHistory[frame % DAMAGE_HISTORY].push_back(aligned);
+    damageTiles(aligned);
+}
+
+void TileRenderer::invalidate()
+{
+    TRect screen = { 0, 0, frameBuffer->width, frameBuffer->height };
+    damageHistory[frame % DAMAGE_HISTORY].clear();                              // covered by this one
+    addDamage(screen);
+}
+
+void TileRenderer::damageTiles(const TRect &rect)
+{
+    int x, y;
+
+    if (isEmptyRect(rect)) return;
+    for (y=rect.y0/TILE_SIZE; y<=(rect.y1-1)/TILE_SIZE; y++) {
+        for (x=rect.x0/TILE_SIZE; x<=(rect.x1-1)/TILE_SIZE; x++) {
+            TTile &tile = tiles[x + y * tilesX];
+            tile.damage = mergeRects(tile.damage, intersectRects(tile.rect, rect));
+        }
+    }
+    damaged = mergeRects(damaged, rect);
+}
+
+bool TileRenderer::isDamaged(const TRect &rect) const
+{
+    TRect screen = { 0, 0, frameBuffer->width, frameBuffer->height };
+    TRect r = intersectRects(rect, screen);
+    int x, y;
+
+    if (isEmptyRect(r)) return false;
+    for (y=r.y0/TILE_SIZE; y<=(r.y1-1)/TILE_SIZE; y++) {
+        for (x=r.x0/TILE_SIZE; x<=(r.x1-1)/TILE_SIZE; x++) {
+            if (!isEmptyRect(intersectRects(tiles[x + y * tilesX].damage, r))) return true;
+        }
+    }
+    return false;
+}
+
+void TileRenderer::submit(const TTriangle &triangle)
+{
+    int x, y;
+    TRect screen = { 0, 0, frameBuffer->width, frameBuffer->height };
+    TRect bounds;
+    float minZ, maxZ;
+    PROFILE_STAGE(STAGE_BINNING);
+
+    PROFILE_COUNT(COUNTER_TRIANGLES_SUBMITTED, 1);
+    if (!triangleExtent(triangle, screen, bounds, minZ, maxZ)) {               // entirely off the screen
+        PROFILE_COUNT(COUNTER_TRIANGLES_CULLED, 1);
+        return;
+    }
+
+    int index = (int)frameTriangles.size();
+    bool binned = false;
+    for (y=bounds.y0/TILE_SIZE; y<=(bounds.y1-1)/TILE_SIZE; y++) {
+        for (x=bounds.x0/TILE_SIZE; x<=(bounds.x1-1)/TILE_SIZE; x++) {
+            TTile &tile = tiles[x + y * tilesX];
+            if (isEmptyRect(intersectRects(tile.damage, bounds))) continue;    // left as it is in this frame
+            tile.triangles.push_back(index);
+            binned = true;
+        }
+    }
+    if (binned) frameTriangles.push_back(triangle);
+}
+
+void TileRenderer::endFrame()
+{
+    PROFILE_STAGE(STAGE_RASTERIZE);
+    if (shading == SHADING_VISIBILITY) {                                        // room for the busiest tile on every thread
+        int largest = 0;
+        for (const TTile &tile : tiles) {
+            largest = std::max(largest, (int)tile.triangles.size());
+        }
+        scratchBytes = resolveScratchBytes(largest);
+        resolveScratch = (char *)arena.allocate(scratchBytes * pool->threadCount(), CACHE_LINE_SIZE);
+    }
+    pool->parallelFor((int)tiles.size(), [this](int index) {
+        drawTile(tiles[index]);
+    });
+}
+
+void TileRenderer::drawTile(TTile &tile)
+{
+    const TRect &rect = tile.damage;                                            // all of it unless incremental
+
+    if (isEmptyRect(rect)) return;
+    PROFILE_STAGE(STAGE_TILE);
+    PROFILE_COUNT(COUNTER_PIXELS_REDRAWN, (rect.x1 - rect.x0) * (rect.y1 - rect.y0));
+    if (shading == SHADING_VISIBILITY) {
+        drawVisibility(tile);
+    }
+    else if (mode == RASTERIZER_EDGE) {
+        frameBuffer->clearRect(rect, clearColor);
+        for (int index : tile.triangles) {
+            drawTriangleEdge(frameTriangles[index], frameBuffer, depthBuffer, rect);
+        }
+    }
+    else {
+        frameBuffer->clearRect(rect, clearColor);
+        for (int index : tile.triangles) {
+            drawTriangle(frameTriangles[index], frameBuffer, depthBuffer, rect);
+        }
+    }
+
+    PROFILE_COUNT(COUNTER_PIXELS_COVERED, depthBuffer->coveredPixels(rect));
+}
+
+void TileRenderer::drawVisibility(TTile &tile)
+{
+    const TRect &rect = tile.damage;
+    int i;
+
+    frameBuffer->fillRect(rect, VISIBILITY_EMPTY);
+    for (i=0; i<(int)tile.triangles.size(); i++) {
+        TTriangle t = frameTriangles[tile.triangles[i]];
+        t.texture = NULL;                                                       // flat, colored with the triangle number
+        t.color = (QRgb)(i + 1);
+        if (mode == RASTERIZER_EDGE) drawTriangleEdge(t, frameBuffer, depthBuffer, rect);
+        else drawTriangle(t, frameBuffer, depthBuffer, rect);
+    }
+
+    PROFILE_STAGE(STAGE_RESOLVE);
+    resolveVisibility(frameTriangles.data(), tile.triangles.data(), (int)tile.triangles.size(), frameBuffer, rect,
+                      clearColor | 0xff000000, resolveScratch + scratchBytes * ThreadPool::currentThread());
+}
@@ -0,0 +1,102 @@
+#ifndef TILERENDERER_H
+#define TILERENDERER_H
+
+#include <vector>
+#include "edgerasterizer.h"
+#include "framearena.h"
+#include "framebuffer.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+
+#define TILE_SIZE       64                                                      // one cell of the depth pyramid
+#define DAMAGE_HISTORY  4                                                       // frames of damage kept for buffers in a ring
+#define DAMAGE_RESERVE  64                                                      // rectangles of a frame with room kept up front
+
+enum TShadingMode {
+    SHADING_FORWARD,                                                            // a texel for every passing fragment
+    SHADING_VISIBILITY                                                          // triangle numbers, then a texel per pixel
+};
+
+// Sort-middle renderer. Triangles submitted during a frame are binned into the screen tiles their bounding boxes
+// overlap; endFrame() then clears and rasterizes every tile on the thread pool. A tile is only ever touched by one
+// thread, and it owns its own rectangle of the color and depth planes (tiles are aligned to the cells of the depth
+// pyramid), so no locking is needed while drawing.
+//
+// With SHADING_VISIBILITY a tile is drawn in two passes. The first rasterizes depth and, instead of a color, the
+// number of the triangle within the tile into the color plane; the second (resolveVisibility()) samples the texture
+// once for every pixel left covered. Hidden fragments then cost a depth test and a store but no texel fetch, so the
+// texturing work follows the resolution of the screen and not the depth complexity of the scene.
+//
+// In incremental mode the frame buffer is expected to hold an earlier frame, and only the damage - the areas added
+// with addDamage() (rounded out to blocks of the depth buffer) - is cleared and drawn again; triangles and whole tiles
+// outside of it are dropped. Damage has to be added after beginFrame() and before the triangles it concerns are
+// submitted. The renderer remembers which frame every buffer last held and adds the damage of the frames since then,
+// so buffers rendered to in turn (see RenderThread) stay correct; a buffer it has not seen lately, or whose size
+// changed, is drawn in full.
+//
+// The triangles of a frame and the bins of the tiles live in a frame arena that beginFrame() resets, and every bin
+// starts with room for as many triangles as it held in the frame before, so a frame no bigger than the previous ones
+// bins without a single allocation. The tables resolveVisibility() works with come from the arena as well.
+class TileRenderer
+{
+public:
+    explicit TileRenderer(ThreadPool *pool);
+
+    TRasterizerMode rasterizerMode() const { return mode; }
+    void setRasterizerMode(TRasterizerMode mode) { this->mode = mode; }
+    TShadingMode shadingMode() const { return shading; }
+    void setShadingMode(TShadingMode shading) { this->shading = shading; }
+    bool isIncremental() const { return incremental; }
+    void setIncremental(bool incremental) { this->incremental = incremental; }
+
+    void beginFrame(FrameBuffer *frameBuffer, DepthBuffer *depthBuffer, QRgb clearColor);
+    void submit(const TTriangle &triangle);
+    void endFrame();
+
+    void addDamage(const TRect &rect);                                          // the area changes in this frame
+    void invalidate();                                                          // the whole frame changes
+    bool isDamaged(const TRect &rect) const;                                    // anything within rect is drawn again
+    TRect damagedRect() const { return damaged; }                               // around all pixels this frame draws
+
+    const ArenaVector<TTriangle> &triangles() const { return frameTriangles; }  // the triangles binned this frame
+
+private:
+    struct TTile {
+        TRect rect;
+        TRect damage;                                                           // the part of rect drawn this frame
+        ArenaVector<int> triangles;                                             // indices into frameTriangles in submission order
+    };
+
+    struct TBufferAge {
+        FrameBuffer *buffer;
+        int width;
+        int height;
+        uint64_t frame;                                                         // the last frame drawn into the buffer
+    };
+
+    ThreadPool *pool;
+    TRasterizerMode mode;
+    TShadingMode shading;
+    bool incremental;
+    FrameBuffer *frameBuffer;
+    DepthBuffer *depthBuffer;
+    QRgb clearColor;
+    int tilesX;
+    int tilesY;
+    std::vector<TTile> tiles;
+    FrameArena arena;                                                           // frameTriangles and the bins
+    ArenaVector<TTriangle> frameTriangles;
+    char *resolveScratch;                                                       // one slice per thread, in the arena
+    size_t scratchBytes;                                                        // in a slice
+    uint64_t frame;
+    std::vector<TRect> damageHistory[DAMAGE_HISTORY];                           // added in frame n, at n % DAMAGE_HISTORY
+    std::vector<TBufferAge> bufferAges;
+    TRect damaged;
+
+    uint64_t lastFrameIn(FrameBuffer *frameBuffer);
+    void damageTiles(const TRect &rect);
+    void drawTile(TTile &tile);
+    void drawVisibility(TTile &tile);
+};
+
+#endif // TILERENDERER_H